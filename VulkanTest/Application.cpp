@@ -7,9 +7,430 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+#include "Parallel.h"
+#include "Profiling.h"
+#include "SyntheticMesh.h"
+#include "VertexTable.h"
+#include "VertexWelder.h"
+
+#include <cstdio>
+#include <iostream>
+#include <limits>
 #include <unordered_map>
 
+namespace {
+
+// processing options a mesh cache was built with, a cache only matches the same set
+enum MeshCacheOptions : uint32_t
+{
+    MeshCacheOption_Optimized = 1 << 0,
+    MeshCacheOption_Lods = 1 << 1,
+    // the parallel weld sums the barycenter in another order, tinyobj rounds some floats differently.
+    // Both serial dedups give the same output, the table used does not matter
+    MeshCacheOption_ParallelWeld = 1 << 2,
+    MeshCacheOption_TinyObj = 1 << 3,
+};
+
+uint64_t hashFloats(const std::vector<float>& values)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (const float value : values)
+    {
+        const auto bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(float); ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// serial dedups, return the memory held by their table
+
+size_t dedupWithVertexTable(const ObjMesh& mesh, std::vector<Vertex>& vertices, std::vector<int>& indices, glm::vec3& barycenter)
+{
+    // a closed triangle mesh has about half as many vertices as triangles, seams add some more
+    VertexTable uniqueVertices(mesh.corners.size() / 3);
+
+    for (const auto& index : mesh.corners)
+    {
+        const Vertex vertex = makeVertex(mesh, index);
+        const auto candidate = static_cast<uint32_t>(vertices.size());
+
+        const auto id = uniqueVertices.findOrInsert(hashVertex(vertex), candidate, [&](uint32_t i)
+        {
+            return vertices[i] == vertex;
+        });
+
+        if (id == candidate)
+        {
+            barycenter += vertex.pos;
+            vertices.push_back(vertex);
+        }
+
+        indices.push_back(id);
+    }
+
+    return uniqueVertices.memoryUsage();
+}
+
+size_t dedupWithUnorderedMap(const ObjMesh& mesh, std::vector<Vertex>& vertices, std::vector<int>& indices, glm::vec3& barycenter)
+{
+    std::unordered_map<Vertex, int> uniqueVertices = {};
+
+    for (const auto& index : mesh.corners)
+    {
+        const Vertex vertex = makeVertex(mesh, index);
+
+        if (!uniqueVertices.count(vertex))
+        {
+            uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+            barycenter += vertex.pos;
+            vertices.push_back(vertex);
+        }
+
+        indices.push_back(uniqueVertices[vertex]);
+    }
+
+    // node: key, value, next pointer and cached hash
+    return uniqueVertices.size() * (sizeof(Vertex) + 3 * sizeof(void*))
+        + uniqueVertices.bucket_count() * sizeof(void*);
+}
+
+}
+
 void Application::loadModel(const char* path)
+{
+    if (runObjLoaderBenchmark)
+    {
+        runObjLoaderComparison();
+    }
+
+    if (runVertexTableBenchmark)
+    {
+        runVertexTableComparison();
+    }
+
+    modelPath = path;
+
+    if (streamsModel())
+    {
+        std::cout << "=> model " << path << " streamed to the GPU at initialization" << std::endl;
+        return;
+    }
+
+    Stopwatch stopwatch;
+
+    const auto cachePath = MeshCache::cachePath(path);
+
+    MeshCacheKey cacheKey;
+    uint32_t cacheOptions = 0;
+    if (useMeshOptimization)
+    {
+        cacheOptions |= MeshCacheOption_Optimized;
+    }
+    if (useLodChain)
+    {
+        cacheOptions |= MeshCacheOption_Lods;
+    }
+    if (useParallelWelding)
+    {
+        cacheOptions |= MeshCacheOption_ParallelWeld;
+    }
+    if (!useNativeObjLoader)
+    {
+        cacheOptions |= MeshCacheOption_TinyObj;
+    }
+
+    const bool cacheable = useMeshCache && MeshCache::computeKey(path, cacheOptions, cacheKey);
+
+    // other ratios give other LOD levels
+    cacheKey.parameterHash = useLodChain ? hashFloats(lodRatios) : 0;
+
+    if (cacheable && meshCache.open(cachePath, cacheKey))
+    {
+        uint64_t vertexBytes = 0;
+        uint64_t indexBytes = 0;
+        vertexData = static_cast<const Vertex*>(meshCache.section(MeshCacheSection_Vertices, &vertexBytes));
+        indexData = static_cast<const int*>(meshCache.section(MeshCacheSection_Indices, &indexBytes));
+
+        if (vertexData != nullptr && indexData != nullptr)
+        {
+            vertexCount = static_cast<uint32_t>(vertexBytes / sizeof(Vertex));
+            indexCount = static_cast<uint32_t>(indexBytes / sizeof(int));
+            boundsMin = meshCache.boundsMin();
+            boundsMax = meshCache.boundsMax();
+
+            uint64_t lodBytes = 0;
+            const auto lodData = static_cast<const LodLevel*>(meshCache.section(MeshCacheSection_Lods, &lodBytes));
+            if (lodData != nullptr)
+            {
+                lodLevels.assign(lodData, lodData + lodBytes / sizeof(LodLevel));
+            }
+            else
+            {
+                lodLevels.assign(1, { 0, indexCount, 0.f });
+            }
+
+            std::cout << "=> model " << path << " mapped from " << cachePath << " (warm) in " << stopwatch.elapsedMs() << " ms" << std::endl;
+            std::cout << "\t - " << vertexCount << " vertices, " << indexCount << " indices in " << lodLevels.size() << " LOD level(s)" << std::endl;
+            return;
+        }
+
+        meshCache.close();
+    }
+
+    parseModel(path);
+
+    if (useMeshOptimization)
+    {
+        optimizeModel();
+    }
+
+    if (useLodChain)
+    {
+        buildLods();
+    }
+    else
+    {
+        lodLevels.assign(1, { 0, static_cast<uint32_t>(indices.size()), 0.f });
+    }
+
+    boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (const auto& vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+
+    vertexData = vertices.data();
+    indexData = indices.data();
+    vertexCount = static_cast<uint32_t>(vertices.size());
+    indexCount = static_cast<uint32_t>(indices.size());
+
+    if (cacheable)
+    {
+        std::vector<MeshCacheSection> sections = {
+            { MeshCacheSection_Vertices, vertices.data(), vertices.size() * sizeof(Vertex) },
+            { MeshCacheSection_Indices, indices.data(), indices.size() * sizeof(int) },
+            { MeshCacheSection_Lods, lodLevels.data(), lodLevels.size() * sizeof(LodLevel) },
+        };
+
+        try
+        {
+            MeshCache::write(cachePath, cacheKey, boundsMin, boundsMax, sections);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "failed to write mesh cache: " << e.what() << std::endl;
+        }
+    }
+
+    std::cout << "=> model " << path << " parsed (cold) in " << stopwatch.elapsedMs() << " ms" << std::endl;
+    std::cout << "\t - " << vertexCount << " vertices, " << indexCount << " indices in " << lodLevels.size() << " LOD level(s)" << std::endl;
+}
+
+void Application::runObjLoaderComparison()
+{
+    const std::string path = "synthetic_benchmark.obj";
+
+    Stopwatch stopwatch;
+    const uint64_t bytes = writeSyntheticObj(path, objBenchmarkBytes);
+    const double megabytes = bytes / (1024.0 * 1024.0);
+
+    std::cout << "=> OBJ loader benchmark, " << megabytes << " MB synthetic grid written in " << stopwatch.elapsedMs() << " ms" << std::endl;
+
+    // the file is in the page cache for both after being written, native first as tinyobj peaks higher
+    for (int native = 1; native >= 0; --native)
+    {
+        ObjMesh mesh;
+
+        stopwatch.reset();
+        if (native)
+        {
+            loadObj(path.c_str(), mesh);
+        }
+        else
+        {
+            loadObjWithTinyObj(path.c_str(), mesh);
+        }
+        const double time = stopwatch.elapsedMs();
+
+        std::cout << "\t - " << (native ? "native" : "tinyobj") << ": " << time << " ms, "
+                  << megabytes * 1000.0 / time << " MB/s, " << mesh.corners.size() << " corners, "
+                  << peakResidentBytes() / (1024.0 * 1024.0) << " MB peak memory so far" << std::endl;
+    }
+
+    std::remove(path.c_str());
+}
+
+void Application::runVertexTableComparison()
+{
+    Stopwatch stopwatch;
+
+    ObjMesh mesh;
+    makeSyntheticGrid(vertexTableBenchmarkCorners, mesh);
+
+    std::cout << "=> vertex table benchmark, " << mesh.corners.size() << " corners of a synthetic grid built in "
+              << stopwatch.elapsedMs() << " ms" << std::endl;
+
+    // the flat table first, the process peak only ever grows and the map needs more
+    for (int flat = 1; flat >= 0; --flat)
+    {
+        std::vector<Vertex> uniqueVertices;
+        std::vector<int> cornerIndices;
+        cornerIndices.reserve(mesh.corners.size());
+        glm::vec3 barycenter(0.f);
+
+        const size_t residentBefore = residentBytes();
+
+        stopwatch.reset();
+        const size_t tableMemory = flat
+            ? dedupWithVertexTable(mesh, uniqueVertices, cornerIndices, barycenter)
+            : dedupWithUnorderedMap(mesh, uniqueVertices, cornerIndices, barycenter);
+        const double time = stopwatch.elapsedMs();
+
+        const size_t peak = peakResidentBytes();
+
+        std::cout << "\t - " << (flat ? "flat table" : "unordered_map") << ": " << time << " ms, "
+                  << mesh.corners.size() / (time * 1e3) << " M lookups/s, " << uniqueVertices.size() << " vertices, "
+                  << tableMemory / (1024.0 * 1024.0) << " MB table, peak +"
+                  << (peak > residentBefore ? peak - residentBefore : 0) / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+}
+
+void Application::parseModel(const char* path)
+{
+    Stopwatch stopwatch;
+
+    ObjMesh mesh;
+
+    if (useNativeObjLoader)
+    {
+        loadObj(path, mesh);
+    }
+    else
+    {
+        loadObjWithTinyObj(path, mesh);
+    }
+
+    const double parseTime = stopwatch.elapsedMs();
+
+    glm::vec3 barycenter(0.f);
+    size_t tableMemory = 0;
+
+    vertices.clear();
+    indices.clear();
+    indices.reserve(mesh.corners.size());
+
+    if (useParallelWelding)
+    {
+        weldVertices(mesh, vertices, indices, barycenter);
+    }
+    else if (useFlatVertexTable)
+    {
+        tableMemory = dedupWithVertexTable(mesh, vertices, indices, barycenter);
+    }
+    else
+    {
+        tableMemory = dedupWithUnorderedMap(mesh, vertices, indices, barycenter);
+    }
+
+    const double dedupTime = stopwatch.elapsedMs() - parseTime;
+
+    if (!useParallelWelding)
+    {
+        barycenter /= (float)vertices.size();
+
+        for (auto& vertice : vertices)
+        {
+            vertice.pos -= barycenter;
+        }
+    }
+
+    const double weldTime = stopwatch.elapsedMs() - parseTime;
+
+    std::cout << "\t - parse (" << (useNativeObjLoader ? "native" : "tinyobj") << "): " << parseTime << " ms" << std::endl;
+    if (useParallelWelding)
+    {
+        std::cout << "\t - weld (parallel, " << workerCount() << " threads): " << weldTime << " ms, "
+                  << mesh.corners.size() / (weldTime * 1e3) << " M corners/s" << std::endl;
+    }
+    else
+    {
+        std::cout << "\t - dedup (" << (useFlatVertexTable ? "flat table" : "unordered_map") << "): " << dedupTime << " ms, "
+                  << mesh.corners.size() / (dedupTime * 1e3) << " M lookups/s, "
+                  << tableMemory / (1024.0 * 1024.0) << " MB table, " << weldTime << " ms with recentering" << std::endl;
+    }
+    std::cout << "\t - peak memory: " << peakResidentBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+void Application::optimizeModel()
+{
+    Stopwatch stopwatch;
+
+    const auto before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+    optimizeTriangleOrder(indices.data(), indices.size(), vertices.data(), vertices.size());
+    optimizeVertexFetch(vertices, indices.data(), indices.size());
+
+    const auto after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+    std::cout << "\t - mesh optimization: " << stopwatch.elapsedMs() << " ms, ACMR "
+              << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+void Application::buildLods()
+{
+    Stopwatch stopwatch;
+
+    const size_t fullCount = indices.size();
+    lodLevels.assign(1, { 0, static_cast<uint32_t>(fullCount), 0.f });
+
+    std::vector<int> simplified(fullCount);
+    float error = 0.f;
+
+    for (const float ratio : lodRatios)
+    {
+        const auto& source = lodLevels.back();
+        const size_t targetCount = static_cast<size_t>(fullCount * ratio) / 3 * 3;
+
+        // start from the previous level, it is smaller and errors add up as an upper bound
+        float levelError = 0.f;
+        const size_t count = simplifyMesh(indices.data() + source.firstIndex, source.indexCount,
+                                          vertices.data(), vertices.size(),
+                                          targetCount, simplified.data(), &levelError);
+
+        if (count == 0 || count >= source.indexCount)
+        {
+            break;
+        }
+
+        if (useMeshOptimization)
+        {
+            optimizeTriangleOrder(simplified.data(), count, vertices.data(), vertices.size());
+        }
+
+        error += levelError;
+
+        lodLevels.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(count), error });
+        indices.insert(indices.end(), simplified.begin(), simplified.begin() + count);
+    }
+
+    std::cout << "\t - LOD chain: " << stopwatch.elapsedMs() << " ms";
+    for (const auto& level : lodLevels)
+    {
+        std::cout << ", " << level.indexCount / 3 << " tris (error " << level.error << ")";
+    }
+    std::cout << std::endl;
+}
+
+void Application::loadObjWithTinyObj(const char* path, ObjMesh& mesh)
 {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
@@ -21,55 +442,77 @@ void Application::loadModel(const char* path)
         throw std::runtime_error(err);
     }
 
-    std::unordered_map<Vertex, int> uniqueVertices = {};
-
-    glm::vec3 barycenter;
+    mesh.positions = std::move(attrib.vertices);
+    mesh.texcoords = std::move(attrib.texcoords);
 
-    for (auto& shape : shapes)
+    for (const auto& shape : shapes)
     {
         for (const auto& index : shape.mesh.indices)
         {
-            Vertex vertex = {};
-            vertex.pos = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 2], // model in z up
-                attrib.vertices[3 * index.vertex_index + 1],
-            };
-            vertex.texCoord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1],
-            };
-            vertex.color = vertex.pos;
+            mesh.corners.push_back({ index.vertex_index, index.texcoord_index });
+        }
+    }
+}
 
+void Application::loadTexture(const char* path)
+{
+    texturePath = path;
 
-            if (!uniqueVertices.count(vertex))
-            {
-                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                barycenter += vertex.pos;
-                vertices.push_back(vertex);
-            }
+    if (usesTextureContainer())
+    {
+        Stopwatch stopwatch;
+
+        const auto containerPath = TextureContainer::containerPath(path);
+
+        MeshCacheKey containerKey;
+        if (MeshCache::computeKey(path, static_cast<uint32_t>(mipFilter), containerKey)
+            && textureContainer.open(containerPath, containerKey))
+        {
+            texWidth = textureContainer.width();
+            texHeight = textureContainer.height();
+            texChannels = textureContainer.sourceChannels();
 
-            indices.push_back(uniqueVertices[vertex]);
+            std::cout << "=> texture " << path << " mapped from " << containerPath << " (warm) in " << stopwatch.elapsedMs() << " ms" << std::endl;
+            return;
         }
     }
 
-    barycenter /= (float)uniqueVertices.size();
+    decodeTexture();
+}
+
+void Application::decodeTexture()
+{
+    Stopwatch stopwatch;
 
-    for (auto& vertice : vertices)
+    texture = stbi_load(texturePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+    if (!texture)
     {
-        vertice.pos -= barycenter;
+        throw std::runtime_error("failed to load texture image");
     }
-}
 
-void Application::loadTexture(const char* path)
-{
-    texture = stbi_load(path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    std::cout << "=> texture " << texturePath << " decoded (cold) in " << stopwatch.elapsedMs() << " ms" << std::endl;
+
+    if (uploadsMipChain())
+    {
+        stopwatch.reset();
 
+        generateMipChain(static_cast<const uint8_t*>(texture), texWidth, texHeight, mipFilter, textureMips);
+
+        std::cout << "\t - mip chain (" << (mipFilter == MipFilter::Box ? "box" : "kaiser") << ", "
+                  << workerCount() << " threads) in " << stopwatch.elapsedMs() << " ms, "
+                  << textureMips.levels.size() + 1 << " levels, "
+                  << textureMips.data.size() / (1024.0 * 1024.0) << " MB below the base image" << std::endl;
+    }
 }
 
 void Application::releaseTexture()
 {
     stbi_image_free(static_cast<stbi_uc*>(texture));
+    texture = nullptr;
+
+    textureMips = MipChain();
+    textureContainer.close();
 }
 
 void Application::run()
@@ -2,10 +2,16 @@
 #define Application_h__
 
 #include "Geometry.h"
+#include "MeshCache.h"
+#include "MeshSimplifier.h"
+#include "MipGenerator.h"
+#include "TextureContainer.h"
 
+#include <string>
 #include <vector>
 
 struct GLFWwindow;
+struct ObjMesh;
 
 class Application
 {
@@ -29,14 +35,82 @@ protected:
     virtual void mainLoop() = 0;
     virtual void cleanup() = 0;
 
+    // true when the model is parsed straight into GPU buffers by initResources instead of by loadModel
+    virtual bool streamsModel() const { return false; }
+
+    // true when loadTexture should build the mip chain on the CPU for the renderer to upload as is
+    virtual bool uploadsMipChain() const { return false; }
+
+    // true when loadTexture should map a ready to upload container instead of decoding the source
+    virtual bool usesTextureContainer() const { return false; }
+
     static std::vector<char> readFile(const std::string& filename);
 
+    static void loadObjWithTinyObj(const char* path, ObjMesh& mesh);
+
+    void runObjLoaderComparison();
+
+    void runVertexTableComparison();
+
+    void parseModel(const char* path);
+    void optimizeModel();
+    void buildLods();
+
+    // stbi decode of texturePath into texture, then the CPU mip chain if asked for
+    void decodeTexture();
+
 protected:
+    // tinyobj is kept around to compare load times against
+    const bool useNativeObjLoader = true;
+
+    // writes a synthetic OBJ of objBenchmarkBytes to the working directory, times the native loader and
+    // tinyobj on it, then deletes it
+    const bool runObjLoaderBenchmark = false;
+    const uint64_t objBenchmarkBytes = 2ull << 30;
+
+    // std::unordered_map is kept around to compare dedup speed against
+    const bool useFlatVertexTable = true;
+
+    // dedups a synthetic grid of vertexTableBenchmarkCorners corners with the flat table, then with
+    // std::unordered_map, and reports lookups per second and memory
+    const bool runVertexTableBenchmark = false;
+    const size_t vertexTableBenchmarkCorners = 50000000;
+
+    // sharded weld on all cores, the serial paths above are kept to compare against
+    const bool useParallelWelding = true;
+
+    // reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch
+    const bool useMeshOptimization = true;
+
+    // simplified copies of the index list appended after it, one per ratio of the full triangle count
+    const bool useLodChain = true;
+    const std::vector<float> lodRatios = { 0.5f, 0.25f, 0.12f, 0.06f };
+
+    const bool useMeshCache = true;
+
+    // downsampling filter of the CPU mip chain
+    const MipFilter mipFilter = MipFilter::Box;
+
+    std::string modelPath;
+    std::string texturePath;
+
     std::vector<Vertex> vertices;
     std::vector<int> indices;
 
+    // point either into vertices/indices or into the mapped mesh cache
+    MeshCache meshCache;
+    const Vertex* vertexData = nullptr;
+    const int* indexData = nullptr;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0; // all LOD levels
+    std::vector<LodLevel> lodLevels;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
     void* texture = nullptr;
     int texWidth, texHeight, texChannels;
+    MipChain textureMips;
+    TextureContainer textureContainer; // open instead of texture when mapped by loadTexture
 
     TrackBallCamera camera;
 
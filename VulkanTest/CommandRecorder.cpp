@@ -0,0 +1,113 @@
+#include "CommandRecorder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+CommandRecorder::CommandRecorder() = default;
+
+CommandRecorder::~CommandRecorder() = default;
+
+void CommandRecorder::init(VkDevice logicalDevice, uint32_t queueFamily, uint32_t threadCount, uint32_t framesInFlight)
+{
+    device = logicalDevice;
+    threads = std::max(threadCount, 1u);
+    pools.resize(threads * framesInFlight);
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+    poolInfo.flags = 0; // reset as a whole
+
+    for (auto& pool : pools)
+    {
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool.commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create recording command pool");
+        }
+    }
+}
+
+void CommandRecorder::destroy()
+{
+    // frees the command buffers along
+    for (auto& pool : pools)
+    {
+        vkDestroyCommandPool(device, pool.commandPool, nullptr);
+    }
+
+    pools.clear();
+    threads = 0;
+}
+
+void CommandRecorder::reset(size_t frame)
+{
+    for (uint32_t thread = 0; thread < threads; ++thread)
+    {
+        auto& framePool = pool(frame, thread);
+        if (framePool.used > 0)
+        {
+            vkResetCommandPool(device, framePool.commandPool, 0);
+            framePool.used = 0;
+        }
+    }
+}
+
+std::vector<VkCommandBuffer> CommandRecorder::record(size_t frame,
+                                                     const VkCommandBufferInheritanceInfo& inheritance,
+                                                     VkCommandBufferUsageFlags flags,
+                                                     size_t drawCount,
+                                                     const RecordFunc& recordDraws)
+{
+    const size_t rangeCount = std::min<size_t>(threads, drawCount);
+    std::vector<VkCommandBuffer> commandBuffers(rangeCount);
+
+    // a range per pool, whichever worker runs it
+    parallelFor(rangeCount, [&](size_t range)
+    {
+        auto commandBuffer = allocate(pool(frame, range));
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritance;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording secondary command buffer");
+        }
+
+        recordDraws(commandBuffer, drawCount * range / rangeCount, drawCount * (range + 1) / rangeCount);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record secondary command buffer");
+        }
+
+        commandBuffers[range] = commandBuffer;
+    });
+
+    return commandBuffers;
+}
+
+VkCommandBuffer CommandRecorder::allocate(Pool& pool)
+{
+    if (pool.used == pool.commandBuffers.size())
+    {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate secondary command buffer");
+        }
+
+        pool.commandBuffers.push_back(commandBuffer);
+    }
+
+    return pool.commandBuffers[pool.used++];
+}
@@ -0,0 +1,60 @@
+#ifndef CommandRecorder_h__
+#define CommandRecorder_h__
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Records secondary command buffers on several threads. Every thread has its own command pool per frame
+// in flight, so no pool is ever touched by two threads and the pools of a frame are reset as a whole once
+// its slot is free. Draws are split in contiguous ranges, one secondary command buffer per range, and the
+// buffers come back in draw order for the primary command buffer to execute.
+class CommandRecorder
+{
+public:
+    // records draws [begin, end) into a secondary command buffer already begun for the render pass
+    using RecordFunc = std::function<void(VkCommandBuffer commandBuffer, size_t begin, size_t end)>;
+
+    CommandRecorder();
+    ~CommandRecorder();
+
+    CommandRecorder(const CommandRecorder&) = delete;
+    CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+    void init(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t framesInFlight);
+
+    // the command buffers must not be pending anymore
+    void destroy();
+
+    // gives every command buffer recorded for the frame back to its pool
+    void reset(size_t frame);
+
+    // splits [0, drawCount) over at most threadCount threads, flags are added to RENDER_PASS_CONTINUE
+    std::vector<VkCommandBuffer> record(size_t frame,
+                                        const VkCommandBufferInheritanceInfo& inheritance,
+                                        VkCommandBufferUsageFlags flags,
+                                        size_t drawCount,
+                                        const RecordFunc& recordDraws);
+
+    uint32_t threadCount() const { return threads; }
+
+private:
+    struct Pool
+    {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> commandBuffers;
+        size_t used = 0;
+    };
+
+    Pool& pool(size_t frame, size_t thread) { return pools[frame * threads + thread]; }
+
+    VkCommandBuffer allocate(Pool& pool);
+
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t threads = 0;
+    std::vector<Pool> pools;
+};
+
+#endif // CommandRecorder_h__
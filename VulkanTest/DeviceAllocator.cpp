@@ -0,0 +1,579 @@
+#include "DeviceAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+const uint32_t none = ~0u;
+
+// 16 size classes per power of two
+const uint32_t secondLevelBits = 4;
+const uint32_t secondLevelCount = 1 << secondLevelBits;
+const uint32_t firstLevelCount = 64;
+
+inline uint32_t highestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+inline uint32_t lowestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+inline void mapping(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    firstLevel = highestBit(size);
+    secondLevel = firstLevel < secondLevelBits ? 0
+        : static_cast<uint32_t>(size >> (firstLevel - secondLevelBits)) - secondLevelCount;
+}
+
+inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+struct DeviceAllocator::Block
+{
+    struct Chunk
+    {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        uint32_t previousPhysical;
+        uint32_t nextPhysical;
+        uint32_t previousFree;
+        uint32_t nextFree;
+        bool free;
+    };
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    char* mapped = nullptr;
+
+    std::vector<Chunk> chunks;
+    std::vector<uint32_t> spareChunks;
+
+    uint64_t firstLevelBitmap = 0;
+    uint32_t secondLevelBitmaps[firstLevelCount] = {};
+    uint32_t freeHeads[firstLevelCount][secondLevelCount];
+
+    uint32_t allocationCount = 0;
+    VkDeviceSize usedBytes = 0;
+
+    Block(VkDeviceMemory memory, VkDeviceSize size, char* mapped)
+        : memory(memory), size(size), mapped(mapped)
+    {
+        std::fill(&freeHeads[0][0], &freeHeads[0][0] + firstLevelCount * secondLevelCount, none);
+        insertFree(newChunk({ 0, size, none, none, none, none, true }));
+    }
+
+    uint32_t newChunk(const Chunk& chunk)
+    {
+        if (!spareChunks.empty())
+        {
+            const uint32_t index = spareChunks.back();
+            spareChunks.pop_back();
+            chunks[index] = chunk;
+            return index;
+        }
+        chunks.push_back(chunk);
+        return static_cast<uint32_t>(chunks.size() - 1);
+    }
+
+    void insertFree(uint32_t index)
+    {
+        auto& chunk = chunks[index];
+        uint32_t firstLevel, secondLevel;
+        mapping(chunk.size, firstLevel, secondLevel);
+
+        const uint32_t head = freeHeads[firstLevel][secondLevel];
+        chunk.free = true;
+        chunk.previousFree = none;
+        chunk.nextFree = head;
+        if (head != none)
+        {
+            chunks[head].previousFree = index;
+        }
+
+        freeHeads[firstLevel][secondLevel] = index;
+        secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+        firstLevelBitmap |= 1ull << firstLevel;
+    }
+
+    void removeFree(uint32_t index)
+    {
+        const auto& chunk = chunks[index];
+        uint32_t firstLevel, secondLevel;
+        mapping(chunk.size, firstLevel, secondLevel);
+
+        if (chunk.previousFree != none)
+        {
+            chunks[chunk.previousFree].nextFree = chunk.nextFree;
+        }
+        else
+        {
+            freeHeads[firstLevel][secondLevel] = chunk.nextFree;
+        }
+
+        if (chunk.nextFree != none)
+        {
+            chunks[chunk.nextFree].previousFree = chunk.previousFree;
+        }
+
+        if (freeHeads[firstLevel][secondLevel] == none)
+        {
+            secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (secondLevelBitmaps[firstLevel] == 0)
+            {
+                firstLevelBitmap &= ~(1ull << firstLevel);
+            }
+        }
+
+        chunks[index].free = false;
+    }
+
+    bool fits(uint32_t index, VkDeviceSize requestSize, VkDeviceSize alignment) const
+    {
+        const auto& chunk = chunks[index];
+        return alignUp(chunk.offset, alignment) + requestSize <= chunk.offset + chunk.size;
+    }
+
+    // first free chunk of a size class that is sure to hold the request, then the request's own class
+    uint32_t findFree(VkDeviceSize requestSize, VkDeviceSize alignment) const
+    {
+        const VkDeviceSize searchSize = requestSize + alignment - 1;
+
+        uint32_t firstLevel, secondLevel;
+        const uint32_t topBit = highestBit(searchSize);
+        const VkDeviceSize rounded = topBit < secondLevelBits ? searchSize
+            : searchSize + (VkDeviceSize(1) << (topBit - secondLevelBits)) - 1;
+        mapping(rounded, firstLevel, secondLevel);
+
+        while (firstLevel < firstLevelCount)
+        {
+            uint32_t secondLevelMap = secondLevel < secondLevelCount ? secondLevelBitmaps[firstLevel] & (~0u << secondLevel) : 0;
+            if (secondLevelMap == 0)
+            {
+                const uint64_t firstLevelMap = firstLevel + 1 < firstLevelCount ? firstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+                if (firstLevelMap == 0)
+                {
+                    break;
+                }
+                firstLevel = lowestBit(firstLevelMap);
+                secondLevelMap = secondLevelBitmaps[firstLevel];
+            }
+
+            secondLevel = lowestBit(secondLevelMap);
+
+            // classes below 16 bytes are not exact, walk the list in case
+            for (uint32_t index = freeHeads[firstLevel][secondLevel]; index != none; index = chunks[index].nextFree)
+            {
+                if (fits(index, requestSize, alignment))
+                {
+                    return index;
+                }
+            }
+
+            ++secondLevel;
+        }
+
+        // rounding skipped the class the request falls in, which may still hold a big enough range
+        mapping(requestSize, firstLevel, secondLevel);
+        for (uint32_t index = freeHeads[firstLevel][secondLevel]; index != none; index = chunks[index].nextFree)
+        {
+            if (fits(index, requestSize, alignment))
+            {
+                return index;
+            }
+        }
+
+        return none;
+    }
+
+    // returns the used chunk, or none if no free range holds the request
+    uint32_t allocate(VkDeviceSize requestSize, VkDeviceSize alignment)
+    {
+        const uint32_t index = findFree(requestSize, alignment);
+        if (index == none)
+        {
+            return none;
+        }
+
+        removeFree(index);
+
+        const VkDeviceSize aligned = alignUp(chunks[index].offset, alignment);
+        const VkDeviceSize padding = aligned - chunks[index].offset;
+
+        if (padding > 0)
+        {
+            // the previous physical chunk is in use, free neighbours are always merged
+            const uint32_t front = newChunk({ chunks[index].offset, padding, chunks[index].previousPhysical, index, none, none, true });
+            if (chunks[front].previousPhysical != none)
+            {
+                chunks[chunks[front].previousPhysical].nextPhysical = front;
+            }
+            chunks[index].previousPhysical = front;
+            chunks[index].offset = aligned;
+            chunks[index].size -= padding;
+            insertFree(front);
+        }
+
+        if (chunks[index].size > requestSize)
+        {
+            const uint32_t back = newChunk({ aligned + requestSize, chunks[index].size - requestSize, index, chunks[index].nextPhysical, none, none, true });
+            if (chunks[back].nextPhysical != none)
+            {
+                chunks[chunks[back].nextPhysical].previousPhysical = back;
+            }
+            chunks[index].nextPhysical = back;
+            chunks[index].size = requestSize;
+            insertFree(back);
+        }
+
+        ++allocationCount;
+        usedBytes += requestSize;
+        return index;
+    }
+
+    void free(uint32_t index)
+    {
+        --allocationCount;
+        usedBytes -= chunks[index].size;
+
+        // absorb the next free neighbour, then let a free previous one absorb this chunk
+        const uint32_t next = chunks[index].nextPhysical;
+        if (next != none && chunks[next].free)
+        {
+            removeFree(next);
+            chunks[index].size += chunks[next].size;
+            chunks[index].nextPhysical = chunks[next].nextPhysical;
+            if (chunks[next].nextPhysical != none)
+            {
+                chunks[chunks[next].nextPhysical].previousPhysical = index;
+            }
+            spareChunks.push_back(next);
+        }
+
+        const uint32_t previous = chunks[index].previousPhysical;
+        if (previous != none && chunks[previous].free)
+        {
+            removeFree(previous);
+            chunks[previous].size += chunks[index].size;
+            chunks[previous].nextPhysical = chunks[index].nextPhysical;
+            if (chunks[index].nextPhysical != none)
+            {
+                chunks[chunks[index].nextPhysical].previousPhysical = previous;
+            }
+            spareChunks.push_back(index);
+            index = previous;
+        }
+
+        insertFree(index);
+    }
+};
+
+DeviceAllocator::DeviceAllocator() = default;
+
+DeviceAllocator::~DeviceAllocator() = default;
+
+void DeviceAllocator::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize preferredBlockSize)
+{
+    device = logicalDevice;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    separateKinds = properties.limits.bufferImageGranularity > 1;
+
+    pools.resize(2 * memoryProperties.memoryTypeCount);
+
+    for (uint32_t i = 0; i < pools.size(); ++i)
+    {
+        const uint32_t memoryType = i / 2;
+        const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+        // small heaps, like the 256 MB host visible device local one, get smaller blocks
+        pools[i].memoryType = memoryType;
+        pools[i].blockSize = std::min(preferredBlockSize, std::max<VkDeviceSize>(heapSize / 8, 1));
+    }
+}
+
+void DeviceAllocator::destroy()
+{
+    for (auto& pool : pools)
+    {
+        for (auto& block : pool.blocks)
+        {
+            if (block)
+            {
+                vkFreeMemory(device, block->memory, nullptr);
+                --memoryCount;
+            }
+        }
+        pool.blocks.clear();
+    }
+
+    for (auto& allocation : dedicated)
+    {
+        if (allocation.memory != VK_NULL_HANDLE)
+        {
+            vkFreeMemory(device, allocation.memory, nullptr);
+            --memoryCount;
+        }
+    }
+    dedicated.clear();
+    spareDedicated.clear();
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type");
+}
+
+bool DeviceAllocator::supports(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+VkDeviceMemory DeviceAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, char** mapped)
+{
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    *mapped = nullptr;
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        void* data;
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+        {
+            vkFreeMemory(device, memory, nullptr);
+            return VK_NULL_HANDLE;
+        }
+        *mapped = static_cast<char*>(data);
+    }
+
+    ++memoryCount;
+    return memory;
+}
+
+DeviceAllocation DeviceAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind)
+{
+    const uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    const uint32_t poolIndex = 2 * memoryType + (separateKinds && kind == ResourceKind::Optimal ? 1 : 0);
+    auto& pool = pools[poolIndex];
+
+    DeviceAllocation allocation;
+    allocation.pool = poolIndex;
+    allocation.size = requirements.size;
+
+    const bool lazy = (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+    if (lazy || requirements.size > pool.blockSize / 2)
+    {
+        allocation.memory = allocateMemory(memoryType, requirements.size, &allocation.mapped);
+        if (allocation.memory == VK_NULL_HANDLE)
+        {
+            throw std::runtime_error("failed to allocate dedicated device memory");
+        }
+
+        allocation.block = none;
+        if (!spareDedicated.empty())
+        {
+            allocation.chunk = spareDedicated.back();
+            spareDedicated.pop_back();
+            dedicated[allocation.chunk] = allocation;
+        }
+        else
+        {
+            allocation.chunk = static_cast<uint32_t>(dedicated.size());
+            dedicated.push_back(allocation);
+        }
+        return allocation;
+    }
+
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+
+    for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+    {
+        auto& block = pool.blocks[i];
+        if (!block || block->size - block->usedBytes < requirements.size)
+        {
+            continue;
+        }
+
+        const uint32_t chunk = block->allocate(requirements.size, alignment);
+        if (chunk != none)
+        {
+            allocation.memory = block->memory;
+            allocation.offset = block->chunks[chunk].offset;
+            allocation.mapped = block->mapped ? block->mapped + allocation.offset : nullptr;
+            allocation.block = i;
+            allocation.chunk = chunk;
+            return allocation;
+        }
+    }
+
+    // a new block, halving its size while the heap refuses it
+    VkDeviceSize blockSize = pool.blockSize;
+    char* mapped = nullptr;
+    VkDeviceMemory memory = allocateMemory(memoryType, blockSize, &mapped);
+    while (memory == VK_NULL_HANDLE && blockSize / 2 >= requirements.size + alignment)
+    {
+        blockSize /= 2;
+        memory = allocateMemory(memoryType, blockSize, &mapped);
+    }
+
+    if (memory == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("failed to allocate device memory block");
+    }
+
+    auto empty = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+    if (empty == pool.blocks.end())
+    {
+        empty = pool.blocks.insert(empty, nullptr);
+    }
+
+    empty->reset(new Block(memory, blockSize, mapped));
+
+    auto& block = *empty;
+    const uint32_t chunk = block->allocate(requirements.size, alignment);
+
+    allocation.memory = block->memory;
+    allocation.offset = block->chunks[chunk].offset;
+    allocation.mapped = block->mapped ? block->mapped + allocation.offset : nullptr;
+    allocation.block = static_cast<uint32_t>(empty - pool.blocks.begin());
+    allocation.chunk = chunk;
+    return allocation;
+}
+
+void DeviceAllocator::free(DeviceAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    if (allocation.block == none)
+    {
+        vkFreeMemory(device, allocation.memory, nullptr);
+        --memoryCount;
+
+        dedicated[allocation.chunk] = DeviceAllocation();
+        spareDedicated.push_back(allocation.chunk);
+    }
+    else
+    {
+        auto& pool = pools[allocation.pool];
+        auto& block = pool.blocks[allocation.block];
+        block->free(allocation.chunk);
+
+        // keep one empty block per pool so staging churn does not hit the driver every time
+        if (block->allocationCount == 0)
+        {
+            const auto others = std::count_if(pool.blocks.begin(), pool.blocks.end(), [&](const std::unique_ptr<Block>& other)
+            {
+                return other && other != block;
+            });
+
+            if (others > 0)
+            {
+                vkFreeMemory(device, block->memory, nullptr);
+                --memoryCount;
+                block.reset();
+            }
+        }
+    }
+
+    allocation = DeviceAllocation();
+}
+
+std::vector<DeviceHeapStats> DeviceAllocator::heapStats() const
+{
+    std::vector<DeviceHeapStats> stats(memoryProperties.memoryHeapCount);
+
+    for (const auto& pool : pools)
+    {
+        auto& heap = stats[memoryProperties.memoryTypes[pool.memoryType].heapIndex];
+
+        for (const auto& block : pool.blocks)
+        {
+            if (!block)
+            {
+                continue;
+            }
+
+            ++heap.blockCount;
+            heap.allocationCount += block->allocationCount;
+            heap.blockBytes += block->size;
+            heap.usedBytes += block->usedBytes;
+
+            for (const auto& chunk : block->chunks)
+            {
+                // recycled chunks are always left marked in use
+                if (chunk.free)
+                {
+                    heap.freeBytes += chunk.size;
+                    heap.largestFreeRange = std::max(heap.largestFreeRange, chunk.size);
+                    ++heap.freeRangeCount;
+                }
+            }
+        }
+    }
+
+    for (const auto& allocation : dedicated)
+    {
+        if (allocation.memory != VK_NULL_HANDLE)
+        {
+            auto& heap = stats[memoryProperties.memoryTypes[pools[allocation.pool].memoryType].heapIndex];
+            ++heap.dedicatedCount;
+            heap.dedicatedBytes += allocation.size;
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,102 @@
+#ifndef DeviceAllocator_h__
+#define DeviceAllocator_h__
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct DeviceAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    char* mapped = nullptr; // already at offset, host visible memory stays mapped
+
+    uint32_t pool = 0;
+    uint32_t block = 0;
+    uint32_t chunk = 0;
+};
+
+// buffers and linear images against optimal images, which bufferImageGranularity keeps apart
+enum class ResourceKind
+{
+    Linear,
+    Optimal,
+};
+
+struct DeviceHeapStats
+{
+    uint32_t blockCount = 0;
+    uint32_t dedicatedCount = 0;
+    uint32_t allocationCount = 0;
+
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize dedicatedBytes = 0;
+    VkDeviceSize usedBytes = 0; // in blocks, dedicated allocations not included
+
+    VkDeviceSize freeBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+    uint32_t freeRangeCount = 0;
+
+    // 0 when the free space of the blocks is one range, close to 1 when it is scattered
+    float fragmentation() const { return freeBytes > 0 ? 1.f - float(largestFreeRange) / float(freeBytes) : 0.f; }
+};
+
+// Sub-allocates device memory out of large blocks, one list of blocks per memory type and resource kind.
+// Each block is a two level segregated fit (TLSF) heap: free ranges are binned by size class, found in
+// constant time through two bitmaps and merged with their neighbours when released. Linear and optimal
+// resources never share a block when bufferImageGranularity is above 1, so they can never alias a page.
+// Requests bigger than half a block get their own vkAllocateMemory, as does any lazily allocated memory
+// so its commitment stays per image. Host visible blocks are mapped once for their whole lifetime.
+class DeviceAllocator
+{
+public:
+    DeviceAllocator();
+    ~DeviceAllocator();
+
+    DeviceAllocator(const DeviceAllocator&) = delete;
+    DeviceAllocator& operator=(const DeviceAllocator&) = delete;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize);
+
+    // releases every block, all allocations must have been freed
+    void destroy();
+
+    DeviceAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind);
+    void free(DeviceAllocation& allocation);
+
+    // true when one of the memory types in typeFilter has every property
+    bool supports(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+    std::vector<DeviceHeapStats> heapStats() const;
+
+    // live VkDeviceMemory objects, blocks and dedicated allocations
+    uint32_t deviceMemoryCount() const { return memoryCount; }
+
+private:
+    struct Block;
+
+    struct Pool
+    {
+        uint32_t memoryType;
+        VkDeviceSize blockSize;
+        std::vector<std::unique_ptr<Block>> blocks; // null where a block was released
+    };
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    VkDeviceMemory allocateMemory(uint32_t memoryType, VkDeviceSize size, char** mapped);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    bool separateKinds = false;
+
+    std::vector<Pool> pools; // memory type * 2 + kind
+    std::vector<DeviceAllocation> dedicated;
+    std::vector<uint32_t> spareDedicated;
+
+    uint32_t memoryCount = 0;
+};
+
+#endif // DeviceAllocator_h__
@@ -0,0 +1,370 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+FrameScheduler::FrameScheduler() = default;
+
+FrameScheduler::~FrameScheduler() = default;
+
+void FrameScheduler::Submission::wait(VkSemaphore semaphore, VkPipelineStageFlags stage, uint64_t value)
+{
+    waitSemaphores[waitCount] = semaphore;
+    waitStages[waitCount] = stage;
+    waitValues[waitCount] = value;
+    ++waitCount;
+}
+
+void FrameScheduler::Submission::signal(VkSemaphore semaphore, uint64_t value)
+{
+    signalSemaphores[signalCount] = semaphore;
+    signalValues[signalCount] = value;
+    ++signalCount;
+}
+
+void FrameScheduler::init(VkDevice logicalDevice, VkQueue computeQueue, VkQueue graphicsQueue, uint32_t framesInFlight, bool useTimeline)
+{
+    device = logicalDevice;
+    queues[Compute] = computeQueue;
+    queues[Graphics] = graphicsQueue;
+
+    std::fill(std::begin(submitted), std::end(submitted), 0);
+    std::fill(std::begin(completed), std::end(completed), 0);
+    timelines.assign(framesInFlight, FrameTimeline());
+    start = std::chrono::steady_clock::now();
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+#ifdef VK_KHR_timeline_semaphore
+    timeline = useTimeline;
+
+    if (timeline)
+    {
+        waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR"));
+        getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR"));
+
+        if (!waitSemaphores || !getSemaphoreCounterValue)
+        {
+            throw std::runtime_error("failed to load the timeline semaphore functions");
+        }
+
+        VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo timelineInfo = semaphoreInfo;
+        timelineInfo.pNext = &typeInfo;
+
+        for (auto& semaphore : timelineSemaphores)
+        {
+            if (vkCreateSemaphore(device, &timelineInfo, nullptr, &semaphore) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create a timeline semaphore");
+            }
+        }
+
+        return;
+    }
+#else
+    (void)useTimeline;
+    timeline = false;
+#endif
+
+    fences.resize(framesInFlight);
+    fenceFrames.assign(framesInFlight, 0);
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (auto& fence : fences)
+    {
+        if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create sync objects for a frame");
+        }
+    }
+
+    // one queue orders everything by itself, the barriers in the command buffers do the rest
+    if (computeQueue != graphicsQueue)
+    {
+        computeDone.resize(framesInFlight);
+        graphicsDone.resize(framesInFlight);
+        graphicsDoneFrames.assign(framesInFlight, 0);
+
+        for (uint32_t i = 0; i < framesInFlight; ++i)
+        {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeDone[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &graphicsDone[i]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create sync objects for a frame");
+            }
+        }
+    }
+}
+
+void FrameScheduler::destroy()
+{
+    vkQueueWaitIdle(queues[Compute]);
+    vkQueueWaitIdle(queues[Graphics]);
+
+    for (auto& semaphore : timelineSemaphores)
+    {
+        if (semaphore != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(device, semaphore, nullptr);
+            semaphore = VK_NULL_HANDLE;
+        }
+    }
+
+    for (auto fence : fences)
+    {
+        vkDestroyFence(device, fence, nullptr);
+    }
+
+    for (auto semaphore : computeDone)
+    {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+
+    for (auto semaphore : graphicsDone)
+    {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+
+    fences.clear();
+    fenceFrames.clear();
+    computeDone.clear();
+    graphicsDone.clear();
+    graphicsDoneFrames.clear();
+}
+
+uint64_t FrameScheduler::beginFrame()
+{
+    const uint64_t frame = submitted[Graphics] + 1;
+    const uint64_t framesInFlight = timelines.size();
+
+    // the last frame that used this slot
+    if (frame > framesInFlight)
+    {
+        waitGraphics(frame - framesInFlight);
+    }
+
+    return frame;
+}
+
+void FrameScheduler::submitCompute(VkCommandBuffer commandBuffer, uint64_t graphicsWait)
+{
+    const uint64_t frame = submitted[Graphics] + 1;
+
+    Submission submission;
+
+    if (timeline)
+    {
+        if (graphicsWait > 0)
+        {
+            submission.wait(timelineSemaphores[Graphics], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, graphicsWait);
+        }
+        submission.signal(timelineSemaphores[Compute], frame);
+    }
+    else if (!computeDone.empty())
+    {
+        if (graphicsWait > 0)
+        {
+            // the semaphore of a slot is only signaled again once waited for, so a pending signal is consumed
+            // even when its frame already completed or is older than the one needed. A frame of the slot that
+            // found it pending did not signal, and is waited for on the CPU instead
+            const size_t waitSlot = slot(graphicsWait);
+            const uint64_t pendingFrame = graphicsDoneFrames[waitSlot];
+
+            if (pendingFrame != 0 && pendingFrame <= graphicsWait)
+            {
+                submission.wait(graphicsDone[waitSlot], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+                graphicsDoneFrames[waitSlot] = 0;
+            }
+
+            if (pendingFrame != graphicsWait)
+            {
+                waitGraphics(graphicsWait);
+            }
+        }
+        submission.signal(computeDone[slot(frame)]);
+    }
+
+    submit(Compute, commandBuffer, submission, VK_NULL_HANDLE);
+    submitted[Compute] = frame;
+}
+
+void FrameScheduler::submitGraphics(VkCommandBuffer commandBuffer, bool computed, VkSemaphore imageAvailable, VkSemaphore renderFinished)
+{
+    const uint64_t frame = submitted[Graphics] + 1;
+    const size_t frameSlot = slot(frame);
+
+    Submission submission;
+    submission.wait(imageAvailable, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    submission.signal(renderFinished);
+
+    VkFence fence = VK_NULL_HANDLE;
+
+    if (timeline)
+    {
+        if (computed)
+        {
+            submission.wait(timelineSemaphores[Compute], VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, frame);
+        }
+        submission.signal(timelineSemaphores[Graphics], frame);
+    }
+    else
+    {
+        if (!computeDone.empty())
+        {
+            if (computed)
+            {
+                submission.wait(computeDone[frameSlot], VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+            }
+
+            if (graphicsDoneFrames[frameSlot] == 0)
+            {
+                submission.signal(graphicsDone[frameSlot]);
+                graphicsDoneFrames[frameSlot] = frame;
+            }
+        }
+
+        fence = fences[frameSlot];
+        vkResetFences(device, 1, &fence);
+        fenceFrames[frameSlot] = frame;
+    }
+
+    submit(Graphics, commandBuffer, submission, fence);
+    submitted[Graphics] = frame;
+}
+
+void FrameScheduler::poll()
+{
+#ifdef VK_KHR_timeline_semaphore
+    if (timeline)
+    {
+        for (int queue = 0; queue < QueueCount; ++queue)
+        {
+            uint64_t value = 0;
+            getSemaphoreCounterValue(device, timelineSemaphores[queue], &value);
+            observe(static_cast<Queue>(queue), value);
+        }
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < fences.size(); ++i)
+    {
+        if (fenceFrames[i] > completed[Graphics] && vkGetFenceStatus(device, fences[i]) == VK_SUCCESS)
+        {
+            observe(Graphics, fenceFrames[i]);
+        }
+    }
+}
+
+double FrameScheduler::time() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrameScheduler::submit(Queue queue, VkCommandBuffer commandBuffer, const Submission& submission, VkFence fence)
+{
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = submission.waitCount;
+    submitInfo.pWaitSemaphores = submission.waitSemaphores;
+    submitInfo.pWaitDstStageMask = submission.waitStages;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = submission.signalCount;
+    submitInfo.pSignalSemaphores = submission.signalSemaphores;
+
+#ifdef VK_KHR_timeline_semaphore
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.waitSemaphoreValueCount = submission.waitCount;
+    timelineInfo.pWaitSemaphoreValues = submission.waitValues;
+    timelineInfo.signalSemaphoreValueCount = submission.signalCount;
+    timelineInfo.pSignalSemaphoreValues = submission.signalValues;
+
+    if (timeline)
+    {
+        submitInfo.pNext = &timelineInfo;
+    }
+#endif
+
+    if (vkQueueSubmit(queues[queue], 1, &submitInfo, fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error(queue == Compute ? "failed to compute draw command buffer" : "failed to submit draw command buffer");
+    }
+
+    const uint64_t frame = submitted[Graphics] + 1;
+    auto& frameTimeline = timelines[slot(frame)];
+    if (frameTimeline.frame != frame)
+    {
+        frameTimeline = FrameTimeline();
+        frameTimeline.frame = frame;
+    }
+    frameTimeline.submitted[queue] = time();
+}
+
+void FrameScheduler::waitGraphics(uint64_t value)
+{
+    if (completed[Graphics] >= value)
+    {
+        return;
+    }
+
+#ifdef VK_KHR_timeline_semaphore
+    if (timeline)
+    {
+        VkSemaphoreWaitInfoKHR waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timelineSemaphores[Graphics];
+        waitInfo.pValues = &value;
+
+        waitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+        observe(Graphics, value);
+        return;
+    }
+#endif
+
+    const size_t valueSlot = slot(value);
+    if (fenceFrames[valueSlot] < value)
+    {
+        throw std::runtime_error("waiting for a frame that was never submitted");
+    }
+
+    vkWaitForFences(device, 1, &fences[valueSlot], VK_TRUE, std::numeric_limits<uint64_t>::max());
+    observe(Graphics, fenceFrames[valueSlot]);
+}
+
+void FrameScheduler::observe(Queue queue, uint64_t value)
+{
+    if (value <= completed[queue])
+    {
+        return;
+    }
+
+    const double now = time();
+    for (auto& frameTimeline : timelines)
+    {
+        if (frameTimeline.frame > completed[queue] && frameTimeline.frame <= value && frameTimeline.completed[queue] == 0.0)
+        {
+            frameTimeline.completed[queue] = now;
+        }
+    }
+
+    completed[queue] = value;
+
+    // a fence only tells about graphics, the compute work of a frame completed before it
+    if (!timeline && queue == Graphics)
+    {
+        observe(Compute, std::min(value, submitted[Compute]));
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef FrameScheduler_h__
+#define FrameScheduler_h__
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Orders the compute and graphics work of every frame and paces the CPU against it. Frames are numbered
+// from 1. With VK_KHR_timeline_semaphore each queue signals its own timeline semaphore with the frame
+// number: graphics waits for the compute value of its frame, compute waits for the graphics value that
+// last read what it overwrites, and the CPU waits on exactly the graphics value that frees a frame slot.
+// Without the extension, which the 1.1.73 headers lack, binary semaphores chain the queues when they
+// differ, and a fence per frame slot stands in for the CPU waits.
+class FrameScheduler
+{
+public:
+    enum Queue
+    {
+        Compute,
+        Graphics,
+        QueueCount,
+    };
+
+    // seconds since init
+    struct FrameTimeline
+    {
+        uint64_t frame = 0;
+        double begun = 0.0;
+        double submitted[QueueCount] = {};
+        double completed[QueueCount] = {}; // when poll() or a wait first saw it, 0 until then
+    };
+
+    FrameScheduler();
+    ~FrameScheduler();
+
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    // timeline only when the extension and its feature are enabled on the device
+    void init(VkDevice device, VkQueue computeQueue, VkQueue graphicsQueue, uint32_t framesInFlight, bool timeline);
+
+    // waits for every submitted frame
+    void destroy();
+
+    // blocks until the slot of the next frame is free and returns its number, which moves on with submitGraphics
+    uint64_t beginFrame();
+
+    // waits for the graphics work of frame graphicsWait from the compute stage on, 0 for none
+    void submitCompute(VkCommandBuffer commandBuffer, uint64_t graphicsWait);
+
+    // waits for imageAvailable before color output and, when computed, for the compute work of the frame
+    // before vertex input
+    void submitGraphics(VkCommandBuffer commandBuffer, bool computed, VkSemaphore imageAvailable, VkSemaphore renderFinished);
+
+    // moves the completed values on without blocking
+    void poll();
+
+    uint64_t submittedValue(Queue queue) const { return submitted[queue]; }
+    uint64_t completedValue(Queue queue) const { return completed[queue]; }
+
+    size_t slot(uint64_t frame) const { return static_cast<size_t>(frame % timelines.size()); }
+
+    const FrameTimeline& frameTimeline(size_t slot) const { return timelines[slot]; }
+
+    double time() const;
+
+    bool usesTimeline() const { return timeline; }
+
+private:
+    struct Submission
+    {
+        uint32_t waitCount = 0;
+        VkSemaphore waitSemaphores[2];
+        VkPipelineStageFlags waitStages[2];
+        uint64_t waitValues[2]; // ignored for binary semaphores
+
+        uint32_t signalCount = 0;
+        VkSemaphore signalSemaphores[2];
+        uint64_t signalValues[2];
+
+        void wait(VkSemaphore semaphore, VkPipelineStageFlags stage, uint64_t value = 0);
+        void signal(VkSemaphore semaphore, uint64_t value = 0);
+    };
+
+    void submit(Queue queue, VkCommandBuffer commandBuffer, const Submission& submission, VkFence fence);
+
+    void waitGraphics(uint64_t value);
+
+    void observe(Queue queue, uint64_t value);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queues[QueueCount] = {};
+    bool timeline = false;
+
+    // one per queue, signaled with frame numbers
+    VkSemaphore timelineSemaphores[QueueCount] = {};
+
+#ifdef VK_KHR_timeline_semaphore
+    PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+#endif
+
+    // fallback, per frame slot
+    std::vector<VkFence> fences;
+    std::vector<uint64_t> fenceFrames;
+    std::vector<VkSemaphore> computeDone;
+    std::vector<VkSemaphore> graphicsDone;
+    std::vector<uint64_t> graphicsDoneFrames; // the frame whose signal was not waited for yet, 0 for none
+
+    uint64_t submitted[QueueCount] = {};
+    uint64_t completed[QueueCount] = {};
+
+    std::vector<FrameTimeline> timelines;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // FrameScheduler_h__
@@ -2,6 +2,34 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <cstring>
+
+namespace {
+
+const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+inline uint64_t rotateLeft(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t floatBits(float value)
+{
+    // -0 and +0 compare equal so they must hash the same
+    value += 0.f;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline uint64_t hashRound(uint64_t acc, uint64_t lane)
+{
+    return rotateLeft(acc + lane * prime2, 31) * prime1;
+}
+
+}
+
 glm::mat4 TrackBallCamera::computeViewMatrix()
 {
     auto trans = glm::translate(glm::translate(glm::mat4(1.f), target), glm::vec3(0.f, 0.f, -dist));
@@ -16,3 +44,20 @@ bool Vertex::operator==(const Vertex& other) const
         && color == other.color
         && texCoord == other.texCoord;
 }
+
+uint64_t hashVertex(const Vertex& vertex)
+{
+    uint64_t hash = prime1;
+    hash = hashRound(hash, floatBits(vertex.pos.x) | floatBits(vertex.pos.y) << 32);
+    hash = hashRound(hash, floatBits(vertex.pos.z) | floatBits(vertex.color.x) << 32);
+    hash = hashRound(hash, floatBits(vertex.color.y) | floatBits(vertex.color.z) << 32);
+    hash = hashRound(hash, floatBits(vertex.texCoord.x) | floatBits(vertex.texCoord.y) << 32);
+
+    // final avalanche
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime1;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include <cstdint>
+
 struct Matrices
 {
     glm::mat4 model;
@@ -37,15 +39,16 @@ struct Vertex
     bool operator==(const Vertex& other) const;
 };
 
+// 64-bit hash of the packed pos/color/texCoord bits, well spread even for grid aligned data
+uint64_t hashVertex(const Vertex& vertex);
+
 namespace std {
 template<>
 struct hash<Vertex>
 {
     size_t operator()(Vertex const & vertex) const
     {
-        return ((hash<glm::vec3>()(vertex.pos) ^
-            (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-                 (hash<glm::vec2>()(vertex.texCoord) << 1);
+        return static_cast<size_t>(hashVertex(vertex));
     }
 };
 }
@@ -63,6 +63,9 @@ void GlApplication::createTexture()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glGenerateMipmap(GL_TEXTURE_2D);
     checkError("createTexture");
+
+    // the driver has its own copy now
+    releaseTexture();
 }
 
 void compileShader(GLuint shader, const char* buffer, size_t bufferSize)
@@ -140,10 +143,10 @@ void GlApplication::createBuffers()
 
     glBindVertexArray(vao);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos[BufferUsage_Indice]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(int), indexData, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbos[BufferUsage_Position]);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
     glEnableVertexAttribArray(1);
@@ -206,7 +209,7 @@ void GlApplication::drawFrame()
 
     glBindVertexArray(vao);
 
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, (void*)0);
+    glDrawElements(GL_TRIANGLES, lodLevels[0].indexCount, GL_UNSIGNED_INT, (void*)0);
 
     glfwSwapBuffers(window);
 
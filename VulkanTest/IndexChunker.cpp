@@ -0,0 +1,67 @@
+#include "IndexChunker.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+namespace {
+
+const int maxChunkSpan = 1 << 16;
+
+}
+
+std::vector<IndexChunk> splitIndexChunks(const int* indices, size_t indexCount)
+{
+    std::vector<IndexChunk> chunks;
+
+    size_t chunkBegin = 0;
+    int low = 0;
+    int high = -1;
+
+    for (size_t t = 0; t + 3 <= indexCount; t += 3)
+    {
+        const int triangleLow = std::min({ indices[t], indices[t + 1], indices[t + 2] });
+        const int triangleHigh = std::max({ indices[t], indices[t + 1], indices[t + 2] });
+
+        if (triangleHigh - triangleLow >= maxChunkSpan)
+        {
+            return std::vector<IndexChunk>();
+        }
+
+        if (high >= low && std::max(high, triangleHigh) - std::min(low, triangleLow) < maxChunkSpan)
+        {
+            low = std::min(low, triangleLow);
+            high = std::max(high, triangleHigh);
+            continue;
+        }
+
+        if (high >= low)
+        {
+            chunks.push_back({ static_cast<uint32_t>(chunkBegin), static_cast<uint32_t>(t - chunkBegin), low });
+        }
+
+        chunkBegin = t;
+        low = triangleLow;
+        high = triangleHigh;
+    }
+
+    if (high >= low)
+    {
+        chunks.push_back({ static_cast<uint32_t>(chunkBegin), static_cast<uint32_t>(indexCount / 3 * 3 - chunkBegin), low });
+    }
+
+    return chunks;
+}
+
+void packIndexChunks(const int* indices, const std::vector<IndexChunk>& chunks, uint16_t* output)
+{
+    parallelFor(chunks.size(), [&](size_t c)
+    {
+        const auto& chunk = chunks[c];
+        const uint32_t end = chunk.firstIndex + chunk.indexCount;
+
+        for (uint32_t i = chunk.firstIndex; i < end; ++i)
+        {
+            output[i] = static_cast<uint16_t>(indices[i] - chunk.baseVertex);
+        }
+    });
+}
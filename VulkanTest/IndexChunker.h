@@ -0,0 +1,24 @@
+#ifndef IndexChunker_h__
+#define IndexChunker_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// a run of triangles drawable with 16-bit indices, vertex = baseVertex + index
+struct IndexChunk
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t baseVertex;
+};
+
+// Greedily cuts the triangle list, in order, into runs whose vertices span at most 65536 ids.
+// Works best on a vertex buffer sorted by first use, see optimizeVertexFetch.
+// Returns nothing when a single triangle already spans more than that.
+std::vector<IndexChunk> splitIndexChunks(const int* indices, size_t indexCount);
+
+// Writes indices[i] - baseVertex of every chunk as 16-bit, at the same position.
+void packIndexChunks(const int* indices, const std::vector<IndexChunk>& chunks, uint16_t* output);
+
+#endif // IndexChunker_h__
@@ -0,0 +1,304 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+MappedFile::MappedFile(const std::string& path)
+{
+    if (!open(path))
+    {
+        throw std::runtime_error("failed to map " + path);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    fileSize = static_cast<size_t>(size.QuadPart);
+    opened = true;
+
+    // empty files cannot be mapped on windows
+    if (fileSize == 0)
+    {
+        return true;
+    }
+
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+    }
+
+    if (fileHandle != nullptr)
+    {
+        CloseHandle(fileHandle);
+    }
+
+    data = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    fileSize = 0;
+    opened = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    fileSize = static_cast<size_t>(st.st_size);
+    opened = true;
+
+    if (fileSize > 0)
+    {
+        void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            ::close(fd);
+            fileSize = 0;
+            opened = false;
+            return false;
+        }
+
+        madvise(mapping, fileSize, MADV_SEQUENTIAL);
+        data = mapping;
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data != nullptr)
+    {
+        munmap(data, fileSize);
+    }
+
+    data = nullptr;
+    fileSize = 0;
+    opened = false;
+}
+
+#endif
+
+SpillBuffer::~SpillBuffer()
+{
+    release();
+}
+
+#ifdef _WIN32
+
+bool SpillBuffer::allocate(size_t size, const std::string& spillPath)
+{
+    release();
+
+    if (spillPath.empty() || size == 0)
+    {
+        memory = calloc(size > 0 ? size : 1, 1);
+        bufferSize = size;
+        return memory != nullptr;
+    }
+
+    // deleted by the system once the last handle is closed, even after a crash
+    HANDLE file = CreateFileA(spillPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    fileHandle = file;
+    mapped = true;
+
+    // the mapping grows the file to its size, the new bytes read as zero
+    const auto size64 = static_cast<unsigned long long>(size);
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64), nullptr);
+    if (mappingHandle == nullptr)
+    {
+        release();
+        return false;
+    }
+
+    memory = MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (memory == nullptr)
+    {
+        release();
+        return false;
+    }
+
+    bufferSize = size;
+    return true;
+}
+
+void SpillBuffer::release()
+{
+    if (!mapped)
+    {
+        free(memory);
+    }
+    else
+    {
+        if (memory != nullptr)
+        {
+            UnmapViewOfFile(memory);
+        }
+
+        if (mappingHandle != nullptr)
+        {
+            CloseHandle(mappingHandle);
+        }
+
+        if (fileHandle != nullptr)
+        {
+            CloseHandle(fileHandle);
+        }
+    }
+
+    memory = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    bufferSize = 0;
+    mapped = false;
+}
+
+#else
+
+bool SpillBuffer::allocate(size_t size, const std::string& spillPath)
+{
+    release();
+
+    if (spillPath.empty() || size == 0)
+    {
+        memory = calloc(size > 0 ? size : 1, 1);
+        bufferSize = size;
+        return memory != nullptr;
+    }
+
+    int fd = ::open(spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // the mapping keeps the unlinked file alive, nothing is left behind even after a crash
+    unlink(spillPath.c_str());
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    memory = mapping;
+    bufferSize = size;
+    mapped = true;
+    return true;
+}
+
+void SpillBuffer::release()
+{
+    if (mapped)
+    {
+        munmap(memory, bufferSize);
+    }
+    else
+    {
+        free(memory);
+    }
+
+    memory = nullptr;
+    bufferSize = 0;
+    mapped = false;
+}
+
+#endif
+
+bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
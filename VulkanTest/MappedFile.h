@@ -0,0 +1,74 @@
+#ifndef MappedFile_h__
+#define MappedFile_h__
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // returns false if the file cannot be opened or mapped
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return opened; }
+
+    const char* begin() const { return static_cast<const char*>(data); }
+    const char* end() const { return begin() + fileSize; }
+    size_t size() const { return fileSize; }
+
+private:
+    void* data = nullptr;
+    size_t fileSize = 0;
+    bool opened = false;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+// Zero filled read-write memory of a fixed size. With a spill path it is a mapping of a temporary file
+// there instead of heap memory, whose pages the OS writes out and drops under memory pressure rather
+// than keeping them resident. The file is deleted when the buffer is released.
+class SpillBuffer
+{
+public:
+    SpillBuffer() = default;
+    ~SpillBuffer();
+
+    SpillBuffer(const SpillBuffer&) = delete;
+    SpillBuffer& operator=(const SpillBuffer&) = delete;
+
+    // an empty spill path allocates on the heap. Returns false if the memory or the file cannot be had
+    bool allocate(size_t size, const std::string& spillPath);
+    void release();
+
+    char* data() const { return static_cast<char*>(memory); }
+    size_t size() const { return bufferSize; }
+    bool spilled() const { return mapped; }
+
+private:
+    void* memory = nullptr;
+    size_t bufferSize = 0;
+    bool mapped = false;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+// renames from to to, replacing an existing to in one step, so a reader sees either file whole and never
+// none. Returns false on failure
+bool replaceFile(const std::string& from, const std::string& to);
+
+#endif // MappedFile_h__
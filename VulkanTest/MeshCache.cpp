@@ -0,0 +1,355 @@
+#include "MeshCache.h"
+#include "MeshSimplifier.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const char cacheMagic[8] = { 'V', 'K', 'T', 'M', 'E', 'S', 'H', '\0' };
+const uint32_t cacheVersion = 3;
+const uint32_t maxSections = 16;
+const uint64_t sectionAlignment = 64;
+
+// hashing a multi-GB source on every start would defeat the cache, so only sample it
+const size_t hashSampleSize = 64 * 1024;
+
+struct SectionEntry
+{
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t hashBytes(const char* data, size_t size, uint64_t hash)
+{
+    // FNV-1a
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// sizes and LOD ranges, cheap enough to check on every open. The indices themselves are checked by write
+bool validLayout(uint64_t vertexBytes, uint64_t indexBytes, const LodLevel* lods, uint64_t lodBytes)
+{
+    if (vertexBytes % sizeof(Vertex) != 0 || indexBytes % (3 * sizeof(int)) != 0)
+    {
+        return false;
+    }
+
+    const uint64_t vertexCount = vertexBytes / sizeof(Vertex);
+    const uint64_t indexCount = indexBytes / sizeof(int);
+
+    if (vertexCount > std::numeric_limits<int>::max() || indexCount > std::numeric_limits<uint32_t>::max())
+    {
+        return false;
+    }
+
+    if (lods != nullptr)
+    {
+        if (lodBytes % sizeof(LodLevel) != 0)
+        {
+            return false;
+        }
+
+        for (uint64_t i = 0; i < lodBytes / sizeof(LodLevel); ++i)
+        {
+            const uint64_t end = uint64_t(lods[i].firstIndex) + lods[i].indexCount;
+            if (end > indexCount || lods[i].firstIndex % 3 != 0 || lods[i].indexCount % 3 != 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+}
+
+struct MeshCache::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+
+    uint64_t sourceSize;
+    uint64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t parameterHash;
+    uint32_t options;
+    uint32_t sectionCount;
+
+    // of the whole file, and FNV-1a of this header with checksum zeroed
+    uint64_t fileSize;
+    uint64_t checksum;
+
+    float boundsMin[4];
+    float boundsMax[4];
+
+    SectionEntry sections[maxSections];
+};
+
+std::string MeshCache::cachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+bool MeshCache::computeKey(const std::string& sourcePath, uint32_t options, MeshCacheKey& key)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(sourcePath.c_str(), &st) != 0)
+    {
+        return false;
+    }
+#else
+    struct stat st;
+    if (stat(sourcePath.c_str(), &st) != 0)
+    {
+        return false;
+    }
+#endif
+
+    MappedFile source;
+    if (!source.open(sourcePath))
+    {
+        return false;
+    }
+
+    const size_t size = source.size();
+    uint64_t hash = 14695981039346656037ull;
+
+    if (size <= 3 * hashSampleSize)
+    {
+        hash = hashBytes(source.begin(), size, hash);
+    }
+    else
+    {
+        hash = hashBytes(source.begin(), hashSampleSize, hash);
+        hash = hashBytes(source.begin() + size / 2 - hashSampleSize / 2, hashSampleSize, hash);
+        hash = hashBytes(source.end() - hashSampleSize, hashSampleSize, hash);
+    }
+
+    key.sourceSize = size;
+    key.sourceTime = static_cast<uint64_t>(st.st_mtime);
+    key.sourceHash = hash;
+    key.options = options;
+
+    return true;
+}
+
+void MeshCache::write(const std::string& path,
+                      const MeshCacheKey& key,
+                      const glm::vec3& boundsMin,
+                      const glm::vec3& boundsMax,
+                      const std::vector<MeshCacheSection>& sections)
+{
+    if (sections.size() > maxSections)
+    {
+        throw std::invalid_argument("too many mesh cache sections");
+    }
+
+    const MeshCacheSection* vertices = nullptr;
+    const MeshCacheSection* indices = nullptr;
+    const MeshCacheSection* lods = nullptr;
+    for (const auto& section : sections)
+    {
+        switch (section.id)
+        {
+        case MeshCacheSection_Vertices: vertices = &section; break;
+        case MeshCacheSection_Indices: indices = &section; break;
+        case MeshCacheSection_Lods: lods = &section; break;
+        }
+    }
+
+    // checked once here, so that open only has to trust the header
+    if (vertices == nullptr || indices == nullptr
+        || !validLayout(vertices->size, indices->size,
+                        lods ? static_cast<const LodLevel*>(lods->data) : nullptr, lods ? lods->size : 0))
+    {
+        throw std::invalid_argument("invalid mesh cache sections");
+    }
+
+    const auto indexData = static_cast<const int*>(indices->data);
+    const uint64_t vertexCount = vertices->size / sizeof(Vertex);
+    for (uint64_t i = 0; i < indices->size / sizeof(int); ++i)
+    {
+        if (indexData[i] < 0 || static_cast<uint64_t>(indexData[i]) >= vertexCount)
+        {
+            throw std::invalid_argument("mesh cache index outside the vertices");
+        }
+    }
+
+    Header header = {};
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.sourceSize = key.sourceSize;
+    header.sourceTime = key.sourceTime;
+    header.sourceHash = key.sourceHash;
+    header.parameterHash = key.parameterHash;
+    header.options = key.options;
+    header.sectionCount = static_cast<uint32_t>(sections.size());
+
+    for (int i = 0; i < 3; ++i)
+    {
+        header.boundsMin[i] = boundsMin[i];
+        header.boundsMax[i] = boundsMax[i];
+    }
+
+    uint64_t offset = alignUp(sizeof(Header), sectionAlignment);
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        header.sections[i].id = sections[i].id;
+        header.sections[i].offset = offset;
+        header.sections[i].size = sections[i].size;
+        offset = alignUp(offset + sections[i].size, sectionAlignment);
+    }
+
+    // the last section is padded like the others
+    header.fileSize = offset;
+    header.checksum = hashBytes(reinterpret_cast<const char*>(&header), sizeof(Header), 14695981039346656037ull);
+
+    // write aside then swap, so a crash never leaves a truncated cache behind
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open " + tempPath);
+        }
+
+        static const char padding[sectionAlignment] = {};
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        uint64_t written = sizeof(Header);
+
+        for (size_t i = 0; i < sections.size(); ++i)
+        {
+            file.write(padding, header.sections[i].offset - written);
+            file.write(static_cast<const char*>(sections[i].data), sections[i].size);
+            written = header.sections[i].offset + sections[i].size;
+        }
+
+        file.write(padding, header.fileSize - written);
+
+        if (!file.good())
+        {
+            throw std::runtime_error("failed to write " + tempPath);
+        }
+    }
+
+    if (!replaceFile(tempPath, path))
+    {
+        throw std::runtime_error("failed to rename " + tempPath);
+    }
+}
+
+bool MeshCache::open(const std::string& path, const MeshCacheKey& key)
+{
+    close();
+
+    if (!file.open(path) || file.size() < sizeof(Header))
+    {
+        file.close();
+        return false;
+    }
+
+    auto candidate = reinterpret_cast<const Header*>(file.begin());
+
+    Header unsummed = *candidate;
+    unsummed.checksum = 0;
+
+    bool valid = memcmp(candidate->magic, cacheMagic, sizeof(cacheMagic)) == 0
+        && candidate->version == cacheVersion
+        && candidate->vertexSize == sizeof(Vertex)
+        && candidate->sourceSize == key.sourceSize
+        && candidate->sourceTime == key.sourceTime
+        && candidate->sourceHash == key.sourceHash
+        && candidate->parameterHash == key.parameterHash
+        && candidate->options == key.options
+        && candidate->sectionCount <= maxSections
+        && candidate->fileSize == file.size()
+        && candidate->checksum == hashBytes(reinterpret_cast<const char*>(&unsummed), sizeof(Header), 14695981039346656037ull);
+
+    for (uint32_t i = 0; valid && i < candidate->sectionCount; ++i)
+    {
+        const auto& entry = candidate->sections[i];
+        valid = entry.offset <= file.size()
+            && entry.size <= file.size() - entry.offset
+            && entry.offset % sectionAlignment == 0;
+    }
+
+    header = valid ? candidate : nullptr;
+
+    if (!valid || !validateSections())
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCache::validateSections() const
+{
+    uint64_t vertexBytes = 0;
+    uint64_t indexBytes = 0;
+    uint64_t lodBytes = 0;
+    const auto vertices = section(MeshCacheSection_Vertices, &vertexBytes);
+    const auto indices = section(MeshCacheSection_Indices, &indexBytes);
+    const auto lods = static_cast<const LodLevel*>(section(MeshCacheSection_Lods, &lodBytes));
+
+    // the index array is used as mapped: write refused out of range indices and the checksum guarantees
+    // the header, sizes included, is the one it wrote
+    return vertices != nullptr && indices != nullptr && validLayout(vertexBytes, indexBytes, lods, lodBytes);
+}
+
+void MeshCache::close()
+{
+    header = nullptr;
+    file.close();
+}
+
+const void* MeshCache::section(uint32_t id, uint64_t* size) const
+{
+    for (uint32_t i = 0; i < header->sectionCount; ++i)
+    {
+        if (header->sections[i].id == id)
+        {
+            if (size != nullptr)
+            {
+                *size = header->sections[i].size;
+            }
+            return file.begin() + header->sections[i].offset;
+        }
+    }
+
+    return nullptr;
+}
+
+glm::vec3 MeshCache::boundsMin() const
+{
+    return { header->boundsMin[0], header->boundsMin[1], header->boundsMin[2] };
+}
+
+glm::vec3 MeshCache::boundsMax() const
+{
+    return { header->boundsMax[0], header->boundsMax[1], header->boundsMax[2] };
+}
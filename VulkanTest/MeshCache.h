@@ -0,0 +1,77 @@
+#ifndef MeshCache_h__
+#define MeshCache_h__
+
+#include "Geometry.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Identifies the source model a cache was built from, and the options it was processed with.
+struct MeshCacheKey
+{
+    uint64_t sourceSize = 0;
+    uint64_t sourceTime = 0;
+    uint64_t sourceHash = 0;
+    uint32_t options = 0;
+
+    // settings that are values rather than flags, like the LOD ratios, hashed by the caller
+    uint64_t parameterHash = 0;
+};
+
+enum MeshCacheSectionId : uint32_t
+{
+    MeshCacheSection_Vertices = 1,
+    MeshCacheSection_Indices,
+    MeshCacheSection_Lods,
+};
+
+struct MeshCacheSection
+{
+    uint32_t id;
+    const void* data;
+    uint64_t size;
+};
+
+// Versioned binary dump of a processed mesh: a header, a section table and 64-byte aligned sections.
+// Opening maps the file so section data can be handed straight to upload code.
+class MeshCache
+{
+public:
+    static std::string cachePath(const std::string& sourcePath);
+
+    // returns false if the source cannot be read
+    static bool computeKey(const std::string& sourcePath, uint32_t options, MeshCacheKey& key);
+
+    // throws std::invalid_argument on indices outside the vertices or LOD levels outside the indices,
+    // which open does not check again
+    static void write(const std::string& path,
+                      const MeshCacheKey& key,
+                      const glm::vec3& boundsMin,
+                      const glm::vec3& boundsMax,
+                      const std::vector<MeshCacheSection>& sections);
+
+    // returns false if the cache is missing, truncated, from another version or stale, or if its header
+    // fails the checksum. No per-vertex work: the sections written by write can be used unchecked
+    bool open(const std::string& path, const MeshCacheKey& key);
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+
+    // returns nullptr if the section is absent
+    const void* section(uint32_t id, uint64_t* size = nullptr) const;
+
+    glm::vec3 boundsMin() const;
+    glm::vec3 boundsMax() const;
+
+private:
+    struct Header;
+
+    bool validateSections() const;
+
+    MappedFile file;
+    const Header* header = nullptr;
+};
+
+#endif // MeshCache_h__
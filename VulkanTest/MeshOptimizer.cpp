@@ -0,0 +1,282 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+struct TriangleAdjacency
+{
+    std::vector<uint32_t> offsets; // vertexCount + 1
+    std::vector<uint32_t> triangles;
+};
+
+void buildAdjacency(const int* indices, size_t indexCount, size_t vertexCount, TriangleAdjacency& adjacency)
+{
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    adjacency.triangles.resize(indexCount);
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        ++adjacency.offsets[indices[i] + 1];
+    }
+
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    }
+
+    std::vector<uint32_t> cursors(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        adjacency.triangles[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+}
+
+struct Cluster
+{
+    size_t firstTriangle;
+    size_t triangleCount;
+    float sortKey;
+};
+
+}
+
+VertexCacheStats analyzeVertexCache(const int* indices, size_t indexCount, size_t vertexCount, size_t cacheSize)
+{
+    // timestamp of the last load per vertex, a vertex is in the FIFO while it is recent enough
+    std::vector<size_t> loadTime(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+
+    size_t transforms = 0;
+    size_t uniqueVertices = 0;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        const int v = indices[i];
+
+        if (!referenced[v])
+        {
+            referenced[v] = true;
+            ++uniqueVertices;
+        }
+
+        if (loadTime[v] == 0 || transforms + 1 - loadTime[v] > cacheSize)
+        {
+            ++transforms;
+            loadTime[v] = transforms;
+        }
+    }
+
+    VertexCacheStats stats = {};
+    stats.acmr = indexCount > 0 ? static_cast<float>(transforms) / (indexCount / 3) : 0.f;
+    stats.atvr = uniqueVertices > 0 ? static_cast<float>(transforms) / uniqueVertices : 0.f;
+    return stats;
+}
+
+void optimizeTriangleOrder(int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, size_t cacheSize)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    TriangleAdjacency adjacency;
+    buildAdjacency(indices, indexCount, vertexCount, adjacency);
+
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+
+    std::vector<uint32_t> order;
+    order.reserve(triangleCount);
+
+    std::vector<Cluster> clusters;
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = 0;
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        const auto v = static_cast<uint32_t>(fanning);
+        for (uint32_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a)
+        {
+            const uint32_t t = adjacency.triangles[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+
+            emitted[t] = true;
+            order.push_back(t);
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const auto corner = static_cast<uint32_t>(indices[3 * t + k]);
+                deadEnd.push_back(corner);
+                candidates.push_back(corner);
+                --liveTriangles[corner];
+
+                if (time - cacheTime[corner] > cacheSize)
+                {
+                    cacheTime[corner] = time++;
+                }
+            }
+        }
+
+        // next fanning vertex: the one still in cache and most recently loaded, unless fanning it would flush it
+        fanning = -1;
+        size_t bestPriority = 0;
+        for (auto candidate : candidates)
+        {
+            if (liveTriangles[candidate] == 0)
+            {
+                continue;
+            }
+
+            size_t priority = 0;
+            if (time - cacheTime[candidate] + 2 * liveTriangles[candidate] <= cacheSize)
+            {
+                priority = time - cacheTime[candidate];
+            }
+
+            if (fanning < 0 || priority > bestPriority)
+            {
+                fanning = candidate;
+                bestPriority = priority;
+            }
+        }
+
+        if (fanning >= 0)
+        {
+            continue;
+        }
+
+        // dead end: restart from a recently used vertex, or the next one in input order. This breaks locality,
+        // so it is where a new cluster starts
+        while (!deadEnd.empty() && fanning < 0)
+        {
+            const auto candidate = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[candidate] > 0)
+            {
+                fanning = candidate;
+            }
+        }
+
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+            {
+                fanning = static_cast<int64_t>(cursor);
+            }
+            ++cursor;
+        }
+
+        const size_t clusterBegin = clusters.empty() ? 0 : clusters.back().firstTriangle + clusters.back().triangleCount;
+        if (order.size() > clusterBegin)
+        {
+            clusters.push_back({ clusterBegin, order.size() - clusterBegin, 0.f });
+        }
+    }
+
+    // overdraw: draw clusters facing outwards from the mesh center first
+    glm::vec3 meshCenter(0.f);
+    float meshArea = 0.f;
+
+    std::vector<glm::vec3> clusterCenters(clusters.size());
+    std::vector<glm::vec3> clusterNormals(clusters.size());
+
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        glm::vec3 center(0.f);
+        glm::vec3 normal(0.f);
+        float area = 0.f;
+
+        for (size_t i = 0; i < clusters[c].triangleCount; ++i)
+        {
+            const uint32_t t = order[clusters[c].firstTriangle + i];
+            const glm::vec3& p0 = vertices[indices[3 * t + 0]].pos;
+            const glm::vec3& p1 = vertices[indices[3 * t + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[3 * t + 2]].pos;
+
+            // cross product length is twice the area, it weights both sums the same way
+            const glm::vec3 weightedNormal = glm::cross(p1 - p0, p2 - p0);
+            const float weight = glm::length(weightedNormal);
+
+            center += (p0 + p1 + p2) * (weight / 3.f);
+            normal += weightedNormal;
+            area += weight;
+        }
+
+        meshCenter += center;
+        meshArea += area;
+
+        clusterCenters[c] = area > 0.f ? center / area : center;
+        clusterNormals[c] = normal;
+    }
+
+    if (meshArea > 0.f)
+    {
+        meshCenter /= meshArea;
+    }
+
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        const float normalLength = glm::length(clusterNormals[c]);
+        clusters[c].sortKey = normalLength > 0.f
+            ? glm::dot(clusterCenters[c] - meshCenter, clusterNormals[c] / normalLength)
+            : 0.f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b)
+    {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<int> sorted;
+    sorted.reserve(indexCount);
+
+    for (const auto& cluster : clusters)
+    {
+        for (size_t i = 0; i < cluster.triangleCount; ++i)
+        {
+            const uint32_t t = order[cluster.firstTriangle + i];
+            sorted.insert(sorted.end(), indices + 3 * t, indices + 3 * t + 3);
+        }
+    }
+
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+size_t optimizeVertexFetch(std::vector<Vertex>& vertices, int* indices, size_t indexCount)
+{
+    std::vector<int> remap(vertices.size(), -1);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        int& index = indices[i];
+        if (remap[index] < 0)
+        {
+            remap[index] = static_cast<int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+    return vertices.size();
+}
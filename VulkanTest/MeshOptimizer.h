@@ -0,0 +1,26 @@
+#ifndef MeshOptimizer_h__
+#define MeshOptimizer_h__
+
+#include "Geometry.h"
+
+#include <cstddef>
+#include <vector>
+
+struct VertexCacheStats
+{
+    float acmr; // transformed vertices per triangle, 0.5 is the best a closed mesh can get
+    float atvr; // transformed vertices per referenced vertex, 1.0 is the best
+};
+
+// Simulates a FIFO post-transform cache of the given size over an indexed triangle list.
+VertexCacheStats analyzeVertexCache(const int* indices, size_t indexCount, size_t vertexCount, size_t cacheSize = 16);
+
+// Tipsify (Sander et al. 2007): reorders triangles for the post-transform cache, then sorts the
+// clusters it produced so the ones facing away from the mesh center, likely occluders, draw first.
+void optimizeTriangleOrder(int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, size_t cacheSize = 16);
+
+// Renumbers vertices in order of first use so vertex fetch walks the buffer sequentially.
+// Unreferenced vertices are dropped, returns the new vertex count.
+size_t optimizeVertexFetch(std::vector<Vertex>& vertices, int* indices, size_t indexCount);
+
+#endif // MeshOptimizer_h__
@@ -0,0 +1,403 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// open borders must survive the interior being flattened around them
+const double borderWeight = 10.0;
+
+// symmetric 4x4 matrix of sum(weight * plane * plane^T), plus the summed weight to turn errors into distances
+struct Quadric
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+void addPlane(Quadric& q, const glm::dvec3& normal, double distance, double weight)
+{
+    q.a00 += weight * normal.x * normal.x;
+    q.a01 += weight * normal.x * normal.y;
+    q.a02 += weight * normal.x * normal.z;
+    q.a11 += weight * normal.y * normal.y;
+    q.a12 += weight * normal.y * normal.z;
+    q.a22 += weight * normal.z * normal.z;
+    q.b0 += weight * normal.x * distance;
+    q.b1 += weight * normal.y * distance;
+    q.b2 += weight * normal.z * distance;
+    q.c += weight * distance * distance;
+    q.weight += weight;
+}
+
+void addQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a22 += other.a22;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// root mean square distance from p to the planes of both quadrics
+float collapseError(const Quadric& q0, const Quadric& q1, const glm::vec3& position)
+{
+    Quadric q = q0;
+    addQuadric(q, q1);
+
+    const double x = position.x;
+    const double y = position.y;
+    const double z = position.z;
+
+    const double error = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z
+                       + q.a11 * y * y + 2.0 * q.a12 * y * z + q.a22 * z * z
+                       + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+    return q.weight > 0.0 ? static_cast<float>(std::sqrt(std::max(0.0, error) / q.weight)) : 0.f;
+}
+
+// compressed adjacency: items of key k are items[offsets[k]..offsets[k + 1]]
+struct Adjacency
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> items;
+};
+
+template<typename KeyOf>
+void buildAdjacency(size_t keyCount, size_t itemCount, KeyOf keyOf, Adjacency& adjacency)
+{
+    adjacency.offsets.assign(keyCount + 1, 0);
+    adjacency.items.resize(itemCount);
+
+    for (size_t i = 0; i < itemCount; ++i)
+    {
+        ++adjacency.offsets[keyOf(i) + 1];
+    }
+
+    for (size_t k = 0; k < keyCount; ++k)
+    {
+        adjacency.offsets[k + 1] += adjacency.offsets[k];
+    }
+
+    std::vector<uint32_t> cursors(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < itemCount; ++i)
+    {
+        adjacency.items[cursors[keyOf(i)]++] = static_cast<uint32_t>(i);
+    }
+}
+
+struct Collapse
+{
+    float error;
+    uint32_t from; // position ids
+    uint32_t to;
+};
+
+}
+
+size_t simplifyMesh(const int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+                    size_t targetIndexCount, int* output, float* error)
+{
+    std::copy(indices, indices + indexCount, output);
+    size_t resultCount = indexCount / 3 * 3;
+
+    // vertices split by a texture seam share a position id, the first vertex with that position
+    std::vector<uint32_t> positionIds(vertexCount);
+    {
+        std::unordered_map<glm::vec3, uint32_t> firstVertices;
+        firstVertices.reserve(vertexCount);
+
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            positionIds[v] = firstVertices.emplace(vertices[v].pos, static_cast<uint32_t>(v)).first->second;
+        }
+    }
+
+    Adjacency positionVertices;
+    buildAdjacency(vertexCount, vertexCount, [&](size_t v) { return positionIds[v]; }, positionVertices);
+
+    auto positionOf = [&](uint32_t id) -> const glm::vec3& { return vertices[id].pos; };
+
+    std::vector<Quadric> quadrics(vertexCount, Quadric());
+    std::vector<bool> border(vertexCount, false);
+
+    // face quadrics weighted by area, then border planes orthogonal to the faces along open edges
+    Adjacency positionTriangles;
+    buildAdjacency(vertexCount, resultCount, [&](size_t i) { return positionIds[output[i]]; }, positionTriangles);
+
+    auto countShared = [&](uint32_t a, uint32_t b)
+    {
+        size_t shared = 0;
+        for (uint32_t i = positionTriangles.offsets[a]; i < positionTriangles.offsets[a + 1]; ++i)
+        {
+            const size_t t = positionTriangles.items[i] / 3 * 3;
+            for (size_t k = 0; k < 3; ++k)
+            {
+                if (positionIds[output[t + k]] == b)
+                {
+                    ++shared;
+                    break;
+                }
+            }
+        }
+        return shared;
+    };
+
+    for (size_t t = 0; t < resultCount; t += 3)
+    {
+        const uint32_t ids[3] = { positionIds[output[t]], positionIds[output[t + 1]], positionIds[output[t + 2]] };
+        const glm::dvec3 p[3] = { glm::dvec3(positionOf(ids[0])), glm::dvec3(positionOf(ids[1])), glm::dvec3(positionOf(ids[2])) };
+
+        glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        const double length = glm::length(normal);
+        if (length == 0.0)
+        {
+            continue;
+        }
+        normal /= length;
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            addPlane(quadrics[ids[k]], normal, -glm::dot(normal, p[0]), length * 0.5);
+        }
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            const uint32_t a = ids[k];
+            const uint32_t b = ids[(k + 1) % 3];
+
+            if (countShared(a, b) != 1)
+            {
+                continue;
+            }
+
+            const glm::dvec3 edge = p[(k + 1) % 3] - p[k];
+            const double edgeLength = glm::length(edge);
+            if (edgeLength == 0.0)
+            {
+                continue;
+            }
+
+            const glm::dvec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+            const double borderDistance = -glm::dot(borderNormal, p[k]);
+
+            addPlane(quadrics[a], borderNormal, borderDistance, borderWeight * edgeLength * edgeLength);
+            addPlane(quadrics[b], borderNormal, borderDistance, borderWeight * edgeLength * edgeLength);
+            border[a] = true;
+            border[b] = true;
+        }
+    }
+
+    float maxError = 0.f;
+
+    Adjacency vertexTriangles;
+    std::vector<Collapse> collapses;
+    std::vector<bool> locked(vertexCount);
+    std::vector<int> remap(vertexCount);
+    std::vector<std::pair<uint32_t, uint32_t>> moves;
+
+    while (resultCount > targetIndexCount)
+    {
+        buildAdjacency(vertexCount, resultCount, [&](size_t i) { return static_cast<uint32_t>(output[i]); }, vertexTriangles);
+        buildAdjacency(vertexCount, resultCount, [&](size_t i) { return positionIds[output[i]]; }, positionTriangles);
+
+        collapses.clear();
+        for (size_t t = 0; t < resultCount; t += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const uint32_t a = positionIds[output[t + k]];
+                const uint32_t b = positionIds[output[t + (k + 1) % 3]];
+
+                collapses.push_back({ collapseError(quadrics[a], quadrics[b], positionOf(b)), a, b });
+                collapses.push_back({ collapseError(quadrics[a], quadrics[b], positionOf(a)), b, a });
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y)
+        {
+            return x.error < y.error;
+        });
+
+        std::fill(locked.begin(), locked.end(), false);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = static_cast<int>(v);
+        }
+
+        const size_t trianglesToRemove = (resultCount - targetIndexCount + 2) / 3;
+        size_t removed = 0;
+        size_t collapsed = 0;
+
+        for (const auto& collapse : collapses)
+        {
+            if (removed >= trianglesToRemove)
+            {
+                break;
+            }
+
+            const uint32_t a = collapse.from;
+            const uint32_t b = collapse.to;
+
+            if (locked[a] || locked[b])
+            {
+                continue;
+            }
+
+            const size_t shared = countShared(a, b);
+
+            // non manifold edges stay, border vertices only slide along the border
+            if (shared == 0 || shared > 2 || (border[a] && shared != 1))
+            {
+                continue;
+            }
+
+            // every triangle that survives the collapse must keep facing the same way
+            bool flips = false;
+            const glm::vec3& target = positionOf(b);
+
+            for (uint32_t i = positionTriangles.offsets[a]; i < positionTriangles.offsets[a + 1] && !flips; ++i)
+            {
+                const size_t t = positionTriangles.items[i] / 3 * 3;
+
+                glm::vec3 before[3];
+                glm::vec3 after[3];
+                bool degenerate = false;
+
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    const uint32_t id = positionIds[output[t + k]];
+                    before[k] = positionOf(id);
+                    after[k] = id == a ? target : before[k];
+                    degenerate = degenerate || id == b;
+                }
+
+                if (degenerate)
+                {
+                    continue;
+                }
+
+                const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+                flips = glm::dot(normalBefore, normalAfter) <= 0.f;
+            }
+
+            if (flips)
+            {
+                continue;
+            }
+
+            // each vertex at a must find a vertex at b on one of its own triangles, so texture
+            // coordinates stay continuous and seams only collapse along themselves
+            moves.clear();
+            bool seamBroken = false;
+
+            for (uint32_t i = positionVertices.offsets[a]; i < positionVertices.offsets[a + 1] && !seamBroken; ++i)
+            {
+                const uint32_t from = positionVertices.items[i];
+                if (vertexTriangles.offsets[from] == vertexTriangles.offsets[from + 1])
+                {
+                    continue;
+                }
+
+                int to = -1;
+                for (uint32_t j = vertexTriangles.offsets[from]; j < vertexTriangles.offsets[from + 1] && to < 0; ++j)
+                {
+                    const size_t t = vertexTriangles.items[j] / 3 * 3;
+                    for (size_t k = 0; k < 3; ++k)
+                    {
+                        if (positionIds[output[t + k]] == b)
+                        {
+                            to = output[t + k];
+                            break;
+                        }
+                    }
+                }
+
+                if (to < 0)
+                {
+                    seamBroken = true;
+                }
+                else
+                {
+                    moves.push_back({ from, static_cast<uint32_t>(to) });
+                }
+            }
+
+            if (seamBroken || moves.empty())
+            {
+                continue;
+            }
+
+            for (const auto& move : moves)
+            {
+                remap[move.first] = static_cast<int>(move.second);
+            }
+
+            addQuadric(quadrics[b], quadrics[a]);
+
+            // the one-ring is locked too, flip checks only hold if the neighbours do not move in the same pass
+            for (uint32_t i = positionTriangles.offsets[a]; i < positionTriangles.offsets[a + 1]; ++i)
+            {
+                const size_t t = positionTriangles.items[i] / 3 * 3;
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    locked[positionIds[output[t + k]]] = true;
+                }
+            }
+
+            maxError = std::max(maxError, collapse.error);
+            removed += shared;
+            ++collapsed;
+        }
+
+        if (collapsed == 0)
+        {
+            break;
+        }
+
+        // remap and drop triangles that lost their area
+        size_t writeCount = 0;
+        for (size_t t = 0; t < resultCount; t += 3)
+        {
+            const int v0 = remap[output[t + 0]];
+            const int v1 = remap[output[t + 1]];
+            const int v2 = remap[output[t + 2]];
+
+            const uint32_t p0 = positionIds[v0];
+            const uint32_t p1 = positionIds[v1];
+            const uint32_t p2 = positionIds[v2];
+
+            if (p0 == p1 || p1 == p2 || p0 == p2)
+            {
+                continue;
+            }
+
+            output[writeCount + 0] = v0;
+            output[writeCount + 1] = v1;
+            output[writeCount + 2] = v2;
+            writeCount += 3;
+        }
+
+        resultCount = writeCount;
+    }
+
+    if (error != nullptr)
+    {
+        *error = maxError;
+    }
+
+    return resultCount;
+}
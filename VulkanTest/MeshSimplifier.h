@@ -0,0 +1,25 @@
+#ifndef MeshSimplifier_h__
+#define MeshSimplifier_h__
+
+#include "Geometry.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// one level of a LOD chain, stored after the previous ones in the same index list
+struct LodLevel
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // upper bound of the distance to the full mesh, in mesh units
+};
+
+// Quadric error metric simplification (Garland and Heckbert 1997) by half-edge collapses: a vertex only
+// ever moves onto one of its neighbours, so the output indexes the same vertex buffer as the input.
+// Texture seams are kept by collapsing every vertex sharing a position at once, open borders by only
+// collapsing along them. Writes at most indexCount indices to output and returns how many were written.
+// error receives the largest distance, in mesh units, between a collapsed vertex and the input surface.
+size_t simplifyMesh(const int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+                    size_t targetIndexCount, int* output, float* error = nullptr);
+
+#endif // MeshSimplifier_h__
@@ -0,0 +1,163 @@
+#include "MeshletBuilder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+void computeBounds(const int* indices, const Vertex* vertices, const uint32_t* meshletVertices, Meshlet& meshlet)
+{
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const glm::vec3& position = vertices[meshletVertices[i]].pos;
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+
+    const glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.f;
+
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        radius = std::max(radius, glm::length(vertices[meshletVertices[i]].pos - center));
+    }
+
+    meshlet.sphere = glm::vec4(center, radius);
+
+    // normal cone: mean of the unit triangle normals, opened to the one furthest away from it
+    const uint32_t indexEnd = meshlet.firstIndex + meshlet.indexCount;
+    glm::vec3 axis(0.f);
+
+    for (uint32_t i = meshlet.firstIndex; i < indexEnd; i += 3)
+    {
+        const glm::vec3& p0 = vertices[indices[i + 0]].pos;
+        const glm::vec3& p1 = vertices[indices[i + 1]].pos;
+        const glm::vec3& p2 = vertices[indices[i + 2]].pos;
+
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        if (length > 0.f)
+        {
+            axis += normal / length;
+        }
+    }
+
+    const float axisLength = glm::length(axis);
+    if (axisLength == 0.f)
+    {
+        // a cutoff of 1 never passes the backface test
+        meshlet.cone = glm::vec4(0.f, 0.f, 1.f, 1.f);
+        return;
+    }
+
+    axis /= axisLength;
+
+    float minDot = 1.f;
+    for (uint32_t i = meshlet.firstIndex; i < indexEnd; i += 3)
+    {
+        const glm::vec3& p0 = vertices[indices[i + 0]].pos;
+        const glm::vec3& p1 = vertices[indices[i + 1]].pos;
+        const glm::vec3& p2 = vertices[indices[i + 2]].pos;
+
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        if (length > 0.f)
+        {
+            minDot = std::min(minDot, glm::dot(axis, normal / length));
+        }
+    }
+
+    // cone wider than a half space, nothing to cull
+    const float cutoff = minDot <= 0.f ? 1.f : std::sqrt(1.f - minDot * minDot);
+    meshlet.cone = glm::vec4(axis, cutoff);
+}
+
+}
+
+void buildMeshlets(const int* indices, size_t indexCount, const Vertex* vertices, const std::vector<IndexChunk>& chunks, MeshletData& output)
+{
+    output.meshlets.clear();
+    output.vertices.clear();
+    output.triangles.resize(indexCount);
+
+    // local id of each global vertex in the meshlet being built, valid while its stamp is current
+    std::vector<uint32_t> stamps;
+    std::vector<uint8_t> localIds;
+
+    uint32_t stamp = 0;
+    Meshlet meshlet = {};
+
+    auto flush = [&]()
+    {
+        if (meshlet.indexCount > 0)
+        {
+            output.meshlets.push_back(meshlet);
+        }
+
+        ++stamp;
+        meshlet = {};
+        meshlet.vertexOffset = static_cast<uint32_t>(output.vertices.size());
+    };
+
+    for (const auto& chunk : chunks)
+    {
+        flush();
+        meshlet.firstIndex = chunk.firstIndex;
+
+        const uint32_t end = chunk.firstIndex + chunk.indexCount;
+        for (uint32_t i = chunk.firstIndex; i + 3 <= end; i += 3)
+        {
+            uint32_t newVertices = 0;
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                const auto v = static_cast<size_t>(indices[i + k]);
+                if (v >= stamps.size())
+                {
+                    stamps.resize(std::max(v + 1, stamps.size() * 2), 0);
+                    localIds.resize(stamps.size());
+                }
+
+                // repeated corners of a degenerate triangle must only count once
+                const bool repeated = (k > 0 && indices[i + k] == indices[i]) || (k > 1 && indices[i + k] == indices[i + 1]);
+                if (stamps[v] != stamp + 1 && !repeated)
+                {
+                    ++newVertices;
+                }
+            }
+
+            if (meshlet.vertexCount + newVertices > maxMeshletVertices || meshlet.indexCount / 3 + 1 > maxMeshletTriangles)
+            {
+                flush();
+                meshlet.firstIndex = i;
+            }
+
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                const auto v = static_cast<size_t>(indices[i + k]);
+                if (stamps[v] != stamp + 1)
+                {
+                    stamps[v] = stamp + 1;
+                    localIds[v] = static_cast<uint8_t>(meshlet.vertexCount++);
+                    output.vertices.push_back(static_cast<uint32_t>(v));
+                }
+
+                output.triangles[i + k] = localIds[v];
+            }
+
+            meshlet.indexCount += 3;
+        }
+    }
+
+    flush();
+
+    parallelFor(output.meshlets.size(), [&](size_t m)
+    {
+        auto& current = output.meshlets[m];
+        computeBounds(indices, vertices, &output.vertices[current.vertexOffset], current);
+    });
+}
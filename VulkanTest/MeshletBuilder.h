@@ -0,0 +1,47 @@
+#ifndef MeshletBuilder_h__
+#define MeshletBuilder_h__
+
+#include "Geometry.h"
+#include "IndexChunker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t maxMeshletVertices = 64;
+const size_t maxMeshletTriangles = 124;
+
+// 48 bytes, laid out for std430 so the array can be read as is by a culling shader
+struct Meshlet
+{
+    glm::vec4 sphere;      // xyz center, w radius
+    glm::vec4 cone;        // xyz axis the triangles face, w cutoff, see isMeshletBackfacing
+    uint32_t firstIndex;   // triangles stay where they are in the index buffer
+    uint32_t indexCount;
+    uint32_t vertexOffset; // into MeshletData::vertices
+    uint32_t vertexCount;
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices; // global vertex ids, vertexCount per meshlet
+    std::vector<uint8_t> triangles; // 3 local vertex ids per triangle, parallel to the index buffer
+};
+
+// Cuts the triangle list, in order, into meshlets of at most maxMeshletVertices vertices and
+// maxMeshletTriangles triangles. Meshlets never cross an index chunk so each one can be drawn with
+// its chunk's base vertex. Bounds are computed from Vertex::pos.
+void buildMeshlets(const int* indices, size_t indexCount, const Vertex* vertices, const std::vector<IndexChunk>& chunks, MeshletData& output);
+
+// Conservative: true only if every triangle of the meshlet faces away from the viewer.
+inline bool isMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& viewerPosition)
+{
+    const glm::vec3 center(meshlet.sphere);
+    const glm::vec3 axis(meshlet.cone);
+    const glm::vec3 toCenter = center - viewerPosition;
+
+    return glm::dot(toCenter, axis) >= meshlet.cone.w * glm::length(toCenter) + meshlet.sphere.w;
+}
+
+#endif // MeshletBuilder_h__
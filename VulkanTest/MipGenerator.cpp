@@ -0,0 +1,359 @@
+#include "MipGenerator.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// msvc compiles avx2 intrinsics anywhere, gcc and clang only in functions targeting it
+#ifdef _MSC_VER
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+const size_t blockSize = 1 << 16;
+
+// src pixel 2x - 3 + k feeds dst pixel x with weight k
+const int kaiserTaps = 8;
+const double kaiserAlpha = 4.0;
+const double kaiserRadius = 2.0; // in dst pixels
+
+bool hasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // the os has to save ymm registers too
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k)
+    {
+        const double factor = x / (2.0 * k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+void computeKaiserWeights(float* weights)
+{
+    const double pi = 3.14159265358979323846;
+
+    double sum = 0.0;
+    double raw[kaiserTaps];
+
+    for (int k = 0; k < kaiserTaps; ++k)
+    {
+        // distance between the src and dst pixel centers, in dst pixels
+        const double t = (k - (kaiserTaps - 1) * 0.5) * 0.5;
+        const double sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+        const double ratio = t / kaiserRadius;
+        const double window = besselI0(kaiserAlpha * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / besselI0(kaiserAlpha);
+
+        raw[k] = sinc * window;
+        sum += raw[k];
+    }
+
+    for (int k = 0; k < kaiserTaps; ++k)
+    {
+        weights[k] = static_cast<float>(raw[k] / sum);
+    }
+}
+
+inline void boxPixel(const uint8_t* row0, const uint8_t* row1, size_t x0, size_t x1, uint8_t* output)
+{
+    for (size_t c = 0; c < 4; ++c)
+    {
+        const unsigned sum = row0[4 * x0 + c] + row0[4 * x1 + c] + row1[4 * x0 + c] + row1[4 * x1 + c];
+        output[c] = static_cast<uint8_t>((sum + 2) >> 2);
+    }
+}
+
+// two dst pixels from 4x2 src pixels per iteration, returns how many dst pixels were written
+size_t boxRowSse2(const uint8_t* row0, const uint8_t* row1, uint8_t* output, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+
+    size_t x = 0;
+    for (; x + 2 <= count; x += 2)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+
+        // vertical sums of src pixels 0 1 and 2 3, then the horizontal pairs
+        const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + 4 * x), _mm_packus_epi16(sum, sum));
+    }
+    return x;
+}
+
+// same as above with four dst pixels per iteration
+AVX2_TARGET size_t boxRowAvx2(const uint8_t* row0, const uint8_t* row1, uint8_t* output, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+
+    size_t x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 8 * x));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 8 * x));
+
+        // unpacks stay within 128 bit lanes, so each lane sums its own four src pixels
+        const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 4 * x), _mm256_castsi256_si128(packed));
+    }
+    return x;
+}
+
+void boxLevel(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* output, uint32_t outputWidth, uint32_t outputHeight, bool avx2)
+{
+    const size_t rowsPerTask = std::max<size_t>(1, blockSize / outputWidth);
+    const size_t taskCount = (outputHeight + rowsPerTask - 1) / rowsPerTask;
+
+    parallelFor(taskCount, [&](size_t task)
+    {
+        const size_t end = std::min<size_t>(outputHeight, (task + 1) * rowsPerTask);
+        for (size_t y = task * rowsPerTask; y < end; ++y)
+        {
+            const uint8_t* row0 = source + 4 * size_t(width) * std::min<size_t>(2 * y, height - 1);
+            const uint8_t* row1 = source + 4 * size_t(width) * std::min<size_t>(2 * y + 1, height - 1);
+            uint8_t* row = output + 4 * size_t(outputWidth) * y;
+
+            if (width == 1)
+            {
+                boxPixel(row0, row1, 0, 0, row);
+                continue;
+            }
+
+            size_t x = avx2 ? boxRowAvx2(row0, row1, row, outputWidth) : boxRowSse2(row0, row1, row, outputWidth);
+            for (; x < outputWidth; ++x)
+            {
+                boxPixel(row0, row1, 2 * x, 2 * x + 1, row + 4 * x);
+            }
+        }
+    });
+}
+
+inline __m128 loadPixel(const uint8_t* pixel)
+{
+    int32_t bits;
+    memcpy(&bits, pixel, sizeof(bits));
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_cvtsi32_si128(bits);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+inline void storePixel(__m128 value, uint8_t* pixel)
+{
+    // rounds to nearest, the saturating packs clamp the negative lobes and overshoots
+    const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(value), _mm_setzero_si128());
+    const int32_t bits = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    memcpy(pixel, &bits, sizeof(bits));
+}
+
+// one src row filtered along x into dst width, one pixel per sse register
+void kaiserRow(const uint8_t* source, uint32_t width, uint32_t outputWidth, const float* weights, float* scratch, float* output)
+{
+    for (size_t x = 0; x < width; ++x)
+    {
+        _mm_storeu_ps(scratch + 4 * x, loadPixel(source + 4 * x));
+    }
+
+    const int last = static_cast<int>(width) - 1;
+
+    for (size_t x = 0; x < outputWidth; ++x)
+    {
+        const int first = 2 * static_cast<int>(x) - (kaiserTaps / 2 - 1);
+
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < kaiserTaps; ++k)
+        {
+            const int i = std::min(std::max(first + k, 0), last);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(scratch + 4 * i)));
+        }
+        _mm_storeu_ps(output + 4 * x, sum);
+    }
+}
+
+// weighted sum of kaiserTaps filtered rows, returns how many floats were written
+size_t kaiserColumnsSse2(const float* const* rows, const float* weights, size_t count, uint8_t* output)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < kaiserTaps; ++k)
+        {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        storePixel(sum, output + i);
+    }
+    return i;
+}
+
+AVX2_TARGET size_t kaiserColumnsAvx2(const float* const* rows, const float* weights, size_t count, uint8_t* output)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < kaiserTaps; ++k)
+        {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        }
+        storePixel(_mm256_castps256_ps128(sum), output + i);
+        storePixel(_mm256_extractf128_ps(sum, 1), output + i + 4);
+    }
+    return i;
+}
+
+void kaiserLevel(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* output, uint32_t outputWidth, uint32_t outputHeight,
+                 const float* weights, bool avx2)
+{
+    // each task filters along x the src rows its dst rows need, then along y out of those
+    const size_t rowsPerTask = std::max<size_t>(kaiserTaps, blockSize / outputWidth);
+    const size_t taskCount = (outputHeight + rowsPerTask - 1) / rowsPerTask;
+    const size_t rowFloats = 4 * size_t(outputWidth);
+    const int lastRow = static_cast<int>(height) - 1;
+
+    parallelFor(taskCount, [&](size_t task)
+    {
+        const size_t begin = task * rowsPerTask;
+        const size_t end = std::min<size_t>(outputHeight, begin + rowsPerTask);
+        const int firstRow = 2 * static_cast<int>(begin) - (kaiserTaps / 2 - 1);
+        const size_t filteredCount = 2 * (end - begin) + kaiserTaps - 2;
+
+        std::vector<float> scratch(4 * size_t(width));
+        std::vector<float> filtered(filteredCount * rowFloats);
+
+        for (size_t r = 0; r < filteredCount; ++r)
+        {
+            const int row = std::min(std::max(firstRow + static_cast<int>(r), 0), lastRow);
+            kaiserRow(source + 4 * size_t(width) * row, width, outputWidth, weights, scratch.data(), filtered.data() + r * rowFloats);
+        }
+
+        const float* rows[kaiserTaps];
+
+        for (size_t y = begin; y < end; ++y)
+        {
+            for (int k = 0; k < kaiserTaps; ++k)
+            {
+                rows[k] = filtered.data() + (2 * (y - begin) + k) * rowFloats;
+            }
+
+            uint8_t* row = output + rowFloats * y;
+            const size_t i = avx2 ? kaiserColumnsAvx2(rows, weights, rowFloats, row) : 0;
+
+            if (i < rowFloats)
+            {
+                const float* tail[kaiserTaps];
+                for (int k = 0; k < kaiserTaps; ++k)
+                {
+                    tail[k] = rows[k] + i;
+                }
+                kaiserColumnsSse2(tail, weights, rowFloats - i, row + i);
+            }
+        }
+    });
+}
+
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+    {
+        ++levels;
+    }
+    return levels;
+}
+
+void generateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, MipChain& chain)
+{
+    static const bool avx2 = hasAvx2();
+
+    float weights[kaiserTaps];
+    computeKaiserWeights(weights);
+
+    chain.levels.clear();
+
+    size_t size = 0;
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+
+    while (levelWidth > 1 || levelHeight > 1)
+    {
+        levelWidth = std::max(1u, levelWidth / 2);
+        levelHeight = std::max(1u, levelHeight / 2);
+
+        chain.levels.push_back({ levelWidth, levelHeight, size });
+        size += 4 * size_t(levelWidth) * levelHeight;
+    }
+
+    chain.data.resize(size);
+
+    const uint8_t* source = pixels;
+    uint32_t sourceWidth = width;
+    uint32_t sourceHeight = height;
+
+    for (const auto& level : chain.levels)
+    {
+        uint8_t* output = chain.data.data() + level.offset;
+
+        if (filter == MipFilter::Box)
+        {
+            boxLevel(source, sourceWidth, sourceHeight, output, level.width, level.height, avx2);
+        }
+        else
+        {
+            kaiserLevel(source, sourceWidth, sourceHeight, output, level.width, level.height, weights, avx2);
+        }
+
+        source = output;
+        sourceWidth = level.width;
+        sourceHeight = level.height;
+    }
+}
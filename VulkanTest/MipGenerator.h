@@ -0,0 +1,36 @@
+#ifndef MipGenerator_h__
+#define MipGenerator_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class MipFilter
+{
+    Box,    // 2x2 average, what a linear blit computes
+    Kaiser  // 8 tap Kaiser windowed sinc, sharper and without the box aliasing
+};
+
+struct MipLevel
+{
+    uint32_t width;
+    uint32_t height;
+    size_t offset; // in bytes into MipChain::data
+};
+
+// every level below the base image, RGBA8 and tightly packed one after the other
+struct MipChain
+{
+    std::vector<MipLevel> levels;
+    std::vector<uint8_t> data;
+};
+
+// levels of a full chain down to 1x1, the base image included
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// Builds levels 1 to mipLevelCount - 1 of an RGBA8 image, each one halving the previous with floor
+// rounding like vkCmdBlitImage chains do. Rows are split across all cores and filtered with AVX2 when
+// the CPU has it, SSE2 otherwise.
+void generateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, MipChain& chain);
+
+#endif // MipGenerator_h__
@@ -0,0 +1,572 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const size_t minChunkSize = 1 << 20;
+
+// corners, or v/vt records, handed out per streamObj callback
+const size_t streamBatchSize = 1 << 16;
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<float> positions;
+    std::vector<float> texcoords;
+    std::vector<ObjIndex> corners;
+
+    // corners written with a negative (relative) index, resolved against this chunk only
+    std::vector<uint32_t> relativeVertices;
+    std::vector<uint32_t> relativeTexcoords;
+
+    // records streamObj already handed over and dropped from the arrays above
+    size_t positionBase = 0;
+    size_t texcoordBase = 0;
+};
+
+struct PolygonCorner
+{
+    ObjIndex index;
+    bool relativeVertex;
+    bool relativeTexcoord;
+};
+
+const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+inline const char* skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
+    {
+        ++p;
+    }
+    return p;
+}
+
+// returns nullptr when no number can be read at p
+const char* parseFloat(const char* p, const char* end, float& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    // keep up to 19 significant digits, enough for a float
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+
+    while (p < end && isDigit(*p))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            ++exponent;
+        }
+        hasDigits = true;
+        ++p;
+    }
+
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+            hasDigits = true;
+            ++p;
+        }
+    }
+
+    if (!hasDigits)
+    {
+        return nullptr;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            negativeExponent = *q == '-';
+            ++q;
+        }
+
+        if (q < end && isDigit(*q))
+        {
+            int e = 0;
+            while (q < end && isDigit(*q))
+            {
+                e = std::min(e * 10 + (*q - '0'), 1000);
+                ++q;
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (mantissa != 0 && exponent != 0)
+    {
+        if (exponent > 0 && exponent <= 22)
+        {
+            result *= powersOf10[exponent];
+        }
+        else if (exponent < 0 && exponent >= -22)
+        {
+            result /= powersOf10[-exponent];
+        }
+        else
+        {
+            result *= std::pow(10.0, exponent);
+        }
+    }
+
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+const char* parseInt(const char* p, const char* end, int& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    if (p == end || !isDigit(*p))
+    {
+        return nullptr;
+    }
+
+    int result = 0;
+    while (p < end && isDigit(*p))
+    {
+        result = result * 10 + (*p - '0');
+        ++p;
+    }
+
+    value = negative ? -result : result;
+    return p;
+}
+
+// OBJ indices are one based, negative ones count back from the last record read
+int resolveIndex(int index, size_t localCount, bool& relative)
+{
+    if (index == 0)
+    {
+        throw std::runtime_error("invalid zero index in obj face");
+    }
+
+    relative = index < 0;
+    return relative ? static_cast<int>(localCount) + index : index - 1;
+}
+
+void parseFloats(const char* p, const char* end, float* values, int required, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        p = skipBlanks(p, end);
+        const char* next = parseFloat(p, end, values[i]);
+        if (next == nullptr)
+        {
+            if (i < required)
+            {
+                throw std::runtime_error("malformed obj vertex record: " + std::string(p, end));
+            }
+            values[i] = 0.f;
+            continue;
+        }
+        p = next;
+    }
+}
+
+void emitCorner(ObjChunk& chunk, const PolygonCorner& corner)
+{
+    const auto position = static_cast<uint32_t>(chunk.corners.size());
+
+    if (corner.relativeVertex)
+    {
+        chunk.relativeVertices.push_back(position);
+    }
+    if (corner.relativeTexcoord)
+    {
+        chunk.relativeTexcoords.push_back(position);
+    }
+
+    chunk.corners.push_back(corner.index);
+}
+
+void parseFace(const char* p, const char* end, ObjChunk& chunk, std::vector<PolygonCorner>& polygon)
+{
+    polygon.clear();
+
+    for (;;)
+    {
+        p = skipBlanks(p, end);
+        if (p == end || *p == '#')
+        {
+            break;
+        }
+
+        PolygonCorner corner = {};
+        corner.index.texcoord = -1;
+
+        int index;
+        p = parseInt(p, end, index);
+        if (p == nullptr)
+        {
+            throw std::runtime_error("malformed obj face record");
+        }
+        corner.index.vertex = resolveIndex(index, chunk.positionBase + chunk.positions.size() / 3, corner.relativeVertex);
+
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/')
+            {
+                p = parseInt(p, end, index);
+                if (p == nullptr)
+                {
+                    throw std::runtime_error("malformed obj face record");
+                }
+                corner.index.texcoord = resolveIndex(index, chunk.texcoordBase + chunk.texcoords.size() / 2, corner.relativeTexcoord);
+            }
+        }
+
+        // normals are not used, skip the rest of the corner
+        while (p < end && !isBlank(*p))
+        {
+            ++p;
+        }
+
+        polygon.push_back(corner);
+    }
+
+    // fan triangulation, same as tinyobj
+    for (size_t k = 2; k < polygon.size(); ++k)
+    {
+        emitCorner(chunk, polygon[0]);
+        emitCorner(chunk, polygon[k - 1]);
+        emitCorner(chunk, polygon[k]);
+    }
+}
+
+void parseLine(const char* p, const char* end, ObjChunk& chunk, std::vector<PolygonCorner>& polygon)
+{
+    p = skipBlanks(p, end);
+    if (end - p < 2)
+    {
+        return;
+    }
+
+    if (p[0] == 'v' && isBlank(p[1]))
+    {
+        float values[3];
+        parseFloats(p + 2, end, values, 3, 3);
+        chunk.positions.insert(chunk.positions.end(), values, values + 3);
+    }
+    else if (p[0] == 'v' && p[1] == 't' && (p + 2 == end || isBlank(p[2])))
+    {
+        float values[2];
+        parseFloats(p + 2, end, values, 1, 2);
+        chunk.texcoords.insert(chunk.texcoords.end(), values, values + 2);
+    }
+    else if (p[0] == 'f' && isBlank(p[1]))
+    {
+        parseFace(p + 2, end, chunk, polygon);
+    }
+}
+
+void validateCorners(const ObjChunk& chunk)
+{
+    const int vertexCount = static_cast<int>(chunk.positionBase + chunk.positions.size() / 3);
+    const int uvCount = static_cast<int>(chunk.texcoordBase + chunk.texcoords.size() / 2);
+
+    for (const auto& corner : chunk.corners)
+    {
+        if (corner.vertex < 0 || corner.vertex >= vertexCount
+            || corner.texcoord < -1 || corner.texcoord >= uvCount)
+        {
+            throw std::runtime_error("obj face index out of range");
+        }
+    }
+}
+
+void parseChunk(ObjChunk& chunk)
+{
+    std::vector<PolygonCorner> polygon;
+
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        auto lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+        if (lineEnd == nullptr)
+        {
+            lineEnd = chunk.end;
+        }
+
+        parseLine(p, lineEnd, chunk, polygon);
+        p = lineEnd + 1;
+    }
+}
+
+}
+
+void loadObj(const char* path, ObjMesh& mesh)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        throw std::runtime_error(std::string("failed to open ") + path);
+    }
+
+    // split on line boundaries, a few chunks per core to balance uneven sections
+    const size_t chunkSize = std::max(minChunkSize, file.size() / (workerCount() * 4) + 1);
+
+    std::vector<ObjChunk> chunks;
+    const char* p = file.begin();
+    while (p < file.end())
+    {
+        const char* chunkEnd = p + std::min(chunkSize, static_cast<size_t>(file.end() - p));
+        if (chunkEnd < file.end())
+        {
+            auto newLine = static_cast<const char*>(memchr(chunkEnd, '\n', file.end() - chunkEnd));
+            chunkEnd = newLine != nullptr ? newLine + 1 : file.end();
+        }
+
+        ObjChunk chunk;
+        chunk.begin = p;
+        chunk.end = chunkEnd;
+        chunks.push_back(std::move(chunk));
+
+        p = chunkEnd;
+    }
+
+    parallelFor(chunks.size(), [&chunks](size_t i)
+    {
+        parseChunk(chunks[i]);
+    });
+
+    // merge in file order
+    std::vector<size_t> positionBase(chunks.size());
+    std::vector<size_t> texcoordBase(chunks.size());
+    std::vector<size_t> cornerBase(chunks.size());
+
+    size_t positionCount = 0;
+    size_t texcoordCount = 0;
+    size_t cornerCount = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        positionBase[i] = positionCount;
+        texcoordBase[i] = texcoordCount;
+        cornerBase[i] = cornerCount;
+
+        positionCount += chunks[i].positions.size();
+        texcoordCount += chunks[i].texcoords.size();
+        cornerCount += chunks[i].corners.size();
+    }
+
+    mesh.positions.resize(positionCount);
+    mesh.texcoords.resize(texcoordCount);
+    mesh.corners.resize(cornerCount);
+
+    const int vertexCount = static_cast<int>(positionCount / 3);
+    const int uvCount = static_cast<int>(texcoordCount / 2);
+
+    parallelFor(chunks.size(), [&](size_t i)
+    {
+        auto& chunk = chunks[i];
+
+        std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + positionBase[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), mesh.texcoords.begin() + texcoordBase[i]);
+
+        for (auto relative : chunk.relativeVertices)
+        {
+            chunk.corners[relative].vertex += static_cast<int>(positionBase[i] / 3);
+        }
+
+        for (auto relative : chunk.relativeTexcoords)
+        {
+            chunk.corners[relative].texcoord += static_cast<int>(texcoordBase[i] / 2);
+        }
+
+        for (const auto& corner : chunk.corners)
+        {
+            if (corner.vertex < 0 || corner.vertex >= vertexCount
+                || corner.texcoord < -1 || corner.texcoord >= uvCount)
+            {
+                throw std::runtime_error("obj face index out of range");
+            }
+        }
+
+        std::copy(chunk.corners.begin(), chunk.corners.end(), mesh.corners.begin() + cornerBase[i]);
+
+        chunk = ObjChunk();
+    });
+}
+
+void streamObj(const char* path, const std::function<void(const ObjMesh& mesh)>& onCorners)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        throw std::runtime_error(std::string("failed to open ") + path);
+    }
+
+    // a single chunk spanning the file: relative indices already resolve against every record read so far
+    ObjChunk chunk;
+    chunk.begin = file.begin();
+    chunk.end = file.end();
+
+    ObjMesh mesh;
+    std::vector<PolygonCorner> polygon;
+
+    auto flush = [&]()
+    {
+        validateCorners(chunk);
+
+        // lend the arrays to the callback without copying them
+        mesh.positions.swap(chunk.positions);
+        mesh.texcoords.swap(chunk.texcoords);
+        mesh.corners.swap(chunk.corners);
+
+        onCorners(mesh);
+
+        mesh.positions.swap(chunk.positions);
+        mesh.texcoords.swap(chunk.texcoords);
+        mesh.corners.swap(chunk.corners);
+
+        chunk.positionBase += chunk.positions.size() / 3;
+        chunk.texcoordBase += chunk.texcoords.size() / 2;
+
+        chunk.positions.clear();
+        chunk.texcoords.clear();
+        chunk.corners.clear();
+        chunk.relativeVertices.clear();
+        chunk.relativeTexcoords.clear();
+    };
+
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        auto lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+        if (lineEnd == nullptr)
+        {
+            lineEnd = chunk.end;
+        }
+
+        parseLine(p, lineEnd, chunk, polygon);
+        p = lineEnd + 1;
+
+        // records are flushed too, a file with few faces must not keep its whole v/vt section here
+        if (chunk.corners.size() >= streamBatchSize
+            || chunk.positions.size() / 3 + chunk.texcoords.size() / 2 >= streamBatchSize)
+        {
+            flush();
+        }
+    }
+
+    if (!chunk.corners.empty() || !chunk.positions.empty() || !chunk.texcoords.empty())
+    {
+        flush();
+    }
+}
+
+ObjCounts countObj(const char* path)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        throw std::runtime_error(std::string("failed to open ") + path);
+    }
+
+    ObjCounts counts;
+
+    const char* p = file.begin();
+    const char* end = file.end();
+    while (p < end)
+    {
+        auto lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
+
+        // same record tests as parseLine
+        const char* q = skipBlanks(p, lineEnd);
+        if (lineEnd - q >= 2)
+        {
+            if (q[0] == 'v' && isBlank(q[1]))
+            {
+                ++counts.positions;
+            }
+            else if (q[0] == 'v' && q[1] == 't' && (q + 2 == lineEnd || isBlank(q[2])))
+            {
+                ++counts.texcoords;
+            }
+            else if (q[0] == 'f' && isBlank(q[1]))
+            {
+                // one corner per blank separated word up to a comment, as parseFace reads them
+                size_t polygonSize = 0;
+                q += 2;
+                for (;;)
+                {
+                    q = skipBlanks(q, lineEnd);
+                    if (q == lineEnd || *q == '#')
+                    {
+                        break;
+                    }
+
+                    ++polygonSize;
+                    while (q < lineEnd && !isBlank(*q))
+                    {
+                        ++q;
+                    }
+                }
+
+                counts.corners += polygonSize >= 3 ? 3 * (polygonSize - 2) : 0;
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+
+    return counts;
+}
@@ -0,0 +1,42 @@
+#ifndef ObjLoader_h__
+#define ObjLoader_h__
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+struct ObjIndex
+{
+    int vertex;
+    int texcoord; // -1 when the face corner has no texture coordinate
+};
+
+// Raw OBJ data in file order, faces already triangulated as fans.
+struct ObjMesh
+{
+    std::vector<float> positions; // xyz per "v" record
+    std::vector<float> texcoords; // uv per "vt" record
+    std::vector<ObjIndex> corners; // 3 per triangle, zero based
+};
+
+// Memory maps the file and parses v/vt/f records in line aligned chunks on all cores.
+void loadObj(const char* path, ObjMesh& mesh);
+
+// Record counts of an OBJ file, corners once faces are triangulated as fans.
+struct ObjCounts
+{
+    size_t positions = 0;
+    size_t texcoords = 0;
+    size_t corners = 0;
+};
+
+// Quick pass over the file that counts records without parsing numbers, to size buffers up front.
+ObjCounts countObj(const char* path);
+
+// Single pass over the file on the calling thread, for callers that cannot hold the mesh at once.
+// Every record is handed to onCorners once: the mesh only holds the v/vt records and the corners read
+// since the previous call, the callback keeps the records later corners need. Corner indices count from
+// the first record of the file and are validated against the records read so far.
+void streamObj(const char* path, const std::function<void(const ObjMesh& mesh)>& onCorners);
+
+#endif // ObjLoader_h__
@@ -0,0 +1,70 @@
+#ifndef Parallel_h__
+#define Parallel_h__
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+inline unsigned int workerCount()
+{
+    const auto count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+// Runs func(taskIndex) for every task in [0, taskCount) on all cores.
+// Tasks are handed out in contiguous runs so results written per task index stay deterministic.
+template<typename Func>
+void parallelFor(size_t taskCount, Func func)
+{
+    const size_t threadCount = std::min<size_t>(workerCount(), taskCount);
+
+    if (threadCount <= 1)
+    {
+        for (size_t i = 0; i < taskCount; ++i)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(threadCount);
+    threads.reserve(threadCount);
+
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        const size_t begin = taskCount * t / threadCount;
+        const size_t end = taskCount * (t + 1) / threadCount;
+
+        threads.emplace_back([&func, &errors, t, begin, end]()
+        {
+            try
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    func(i);
+                }
+            }
+            catch (...)
+            {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto& error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+#endif // Parallel_h__
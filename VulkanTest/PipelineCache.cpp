@@ -0,0 +1,208 @@
+#include "PipelineCache.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const char cacheMagic[8] = { 'V', 'K', 'T', 'P', 'I', 'P', 'E', '\0' };
+const uint32_t cacheVersion = 1;
+
+// what the data of vkGetPipelineCacheData starts with, VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+struct DriverHeader
+{
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+uint64_t hashBytes(const char* data, size_t size)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+struct PipelineCache::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+PipelineCache::PipelineCache() = default;
+
+PipelineCache::~PipelineCache() = default;
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const std::string& path)
+{
+    device = logicalDevice;
+    filePath = path;
+    loadedSize = 0;
+    reason.clear();
+
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    Header expected = {};
+    memcpy(expected.magic, cacheMagic, sizeof(cacheMagic));
+    expected.version = cacheVersion;
+    expected.vendorID = properties.vendorID;
+    expected.deviceID = properties.deviceID;
+    expected.driverVersion = properties.driverVersion;
+    memcpy(expected.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    MappedFile file;
+    const char* cacheData = nullptr;
+    size_t cacheSize = 0;
+
+    if (!file.open(path))
+    {
+        reason = "no cache file";
+    }
+    else if (validate(file.begin(), file.size(), expected, &cacheData, &cacheSize))
+    {
+        loadedSize = cacheSize;
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = loadedSize;
+    cacheInfo.pInitialData = loadedSize > 0 ? cacheData : nullptr;
+
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline cache");
+    }
+}
+
+bool PipelineCache::validate(const char* data, size_t size, const Header& expected, const char** cacheData, size_t* cacheSize)
+{
+    if (size < sizeof(Header) + sizeof(DriverHeader))
+    {
+        reason = "truncated cache file";
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+
+    if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version)
+    {
+        reason = "not a cache file of this version";
+        return false;
+    }
+
+    if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID)
+    {
+        reason = "written for another device";
+        return false;
+    }
+
+    if (header.driverVersion != expected.driverVersion)
+    {
+        reason = "written by another driver version";
+        return false;
+    }
+
+    if (memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        reason = "pipelineCacheUUID changed";
+        return false;
+    }
+
+    const char* payload = data + sizeof(Header);
+    if (header.dataSize != size - sizeof(Header) || header.dataHash != hashBytes(payload, size - sizeof(Header)))
+    {
+        reason = "corrupted cache file";
+        return false;
+    }
+
+    // the driver checks its own header too, but not every driver does it gracefully
+    DriverHeader driverHeader;
+    memcpy(&driverHeader, payload, sizeof(DriverHeader));
+
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        || driverHeader.headerSize < sizeof(DriverHeader)
+        || driverHeader.vendorID != expected.vendorID
+        || driverHeader.deviceID != expected.deviceID
+        || memcmp(driverHeader.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        reason = "driver data does not match the device";
+        return false;
+    }
+
+    *cacheData = payload;
+    *cacheSize = static_cast<size_t>(header.dataSize);
+    return true;
+}
+
+void PipelineCache::save()
+{
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to get pipeline cache data size");
+    }
+
+    std::vector<char> data(dataSize);
+    if (dataSize > 0 && vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to get pipeline cache data");
+    }
+    data.resize(dataSize);
+
+    Header header = {};
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = hashBytes(data.data(), data.size());
+
+    const std::string tempPath = filePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open " + tempPath);
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(data.data(), data.size());
+
+        if (!file.good())
+        {
+            throw std::runtime_error("failed to write " + tempPath);
+        }
+    }
+
+    if (!replaceFile(tempPath, filePath))
+    {
+        throw std::runtime_error("failed to rename " + tempPath);
+    }
+}
+
+void PipelineCache::destroy()
+{
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,58 @@
+#ifndef PipelineCache_h__
+#define PipelineCache_h__
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+
+// VkPipelineCache persisted across runs. The file is a small header of ours followed by the data of
+// vkGetPipelineCacheData. The data is only handed back to the driver when both headers match the device:
+// vendor, device, driver version and pipelineCacheUUID. Drivers are not required to survive foreign or
+// corrupted data, so a mismatch, or a bad checksum, starts from an empty cache instead.
+class PipelineCache
+{
+public:
+    PipelineCache();
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // loads path when it holds a valid cache for the device, empty otherwise
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+
+    // writes aside then swaps, so a crash never leaves a truncated cache behind
+    void save();
+
+    void destroy();
+
+    VkPipelineCache handle() const { return cache; }
+
+    // true when the data of a previous run was loaded
+    bool warm() const { return loadedSize > 0; }
+
+    size_t loadedBytes() const { return loadedSize; }
+
+    // why the file was not loaded, empty when warm
+    const std::string& coldReason() const { return reason; }
+
+    const std::string& path() const { return filePath; }
+
+private:
+    struct Header;
+
+    // returns false, with reason set, when the file is missing or does not match the device
+    bool validate(const char* data, size_t size, const Header& expected, const char** cacheData, size_t* cacheSize);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    std::string filePath;
+
+    VkPhysicalDeviceProperties properties = {};
+
+    size_t loadedSize = 0;
+    std::string reason;
+};
+
+#endif // PipelineCache_h__
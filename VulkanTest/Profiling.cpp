@@ -0,0 +1,59 @@
+#include "Profiling.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+    #include <unistd.h>
+
+    #include <cstdio>
+#endif
+
+size_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        // kilobytes on linux
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+    }
+    return 0;
+#endif
+}
+
+size_t residentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    // second field of statm, in pages
+    size_t pages = 0;
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if (file != nullptr)
+    {
+        if (std::fscanf(file, "%*s %zu", &pages) != 1)
+        {
+            pages = 0;
+        }
+        std::fclose(file);
+    }
+    return pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef Profiling_h__
+#define Profiling_h__
+
+#include <chrono>
+#include <cstddef>
+
+class Stopwatch
+{
+public:
+    Stopwatch() : start(std::chrono::high_resolution_clock::now()) {}
+
+    void reset()
+    {
+        start = std::chrono::high_resolution_clock::now();
+    }
+
+    double elapsedMs() const
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(now - start).count();
+    }
+
+private:
+    std::chrono::high_resolution_clock::time_point start;
+};
+
+// peak resident set size of the process, 0 if unknown
+size_t peakResidentBytes();
+
+// current resident set size of the process, 0 if unknown
+size_t residentBytes();
+
+#endif // Profiling_h__
@@ -0,0 +1,176 @@
+#include "SyntheticMesh.h"
+#include "ObjLoader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const uint32_t gridWidth = 4096;
+
+const uint32_t seamSpacing = 64;
+
+// flushed to the file whenever it is this full
+const size_t writeBufferSize = 4 << 20;
+
+class ObjWriter
+{
+public:
+    explicit ObjWriter(const std::string& path)
+        : file(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open " + path);
+        }
+
+        buffer.reserve(writeBufferSize + 256);
+    }
+
+    template<typename... Args>
+    void print(const char* format, Args... args)
+    {
+        char line[256];
+        const int length = snprintf(line, sizeof(line), format, args...);
+        buffer.insert(buffer.end(), line, line + length);
+
+        if (buffer.size() >= writeBufferSize)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        file.write(buffer.data(), buffer.size());
+        written += buffer.size();
+        buffer.clear();
+
+        if (!file.good())
+        {
+            throw std::runtime_error("failed to write synthetic OBJ");
+        }
+    }
+
+    uint64_t size() const { return written + buffer.size(); }
+
+private:
+    std::ofstream file;
+    std::vector<char> buffer;
+    uint64_t written = 0;
+};
+
+}
+
+uint64_t writeSyntheticObj(const std::string& path, uint64_t targetBytes)
+{
+    ObjWriter writer(path);
+    writer.print("# synthetic %u wide grid\n", gridWidth);
+
+    for (uint32_t row = 0; row == 0 || writer.size() < targetBytes; ++row)
+    {
+        for (uint32_t column = 0; column < gridWidth; ++column)
+        {
+            const float x = column * 0.01f;
+            const float z = row * 0.01f;
+            writer.print("v %.6f %.6f %.6f\n", x, 0.1f * std::sin(x * 7.f) * std::cos(z * 5.f), z);
+            writer.print("vt %.6f %.6f\n", column / float(gridWidth - 1), std::fmod(row / 1024.f, 1.f));
+        }
+
+        if (row == 0)
+        {
+            continue;
+        }
+
+        // one based, the previous row starts gridWidth records before this one
+        const unsigned long long current = static_cast<unsigned long long>(row) * gridWidth + 1;
+        const unsigned long long previous = current - gridWidth;
+
+        for (uint32_t column = 0; column + 1 < gridWidth; ++column)
+        {
+            const auto a = previous + column;
+            const auto b = a + 1;
+            const auto c = current + column;
+            const auto d = c + 1;
+            writer.print("f %llu/%llu %llu/%llu %llu/%llu\n", a, a, c, c, b, b);
+            writer.print("f %llu/%llu %llu/%llu %llu/%llu\n", b, b, c, c, d, d);
+        }
+    }
+
+    writer.flush();
+    return writer.size();
+}
+
+void makeSyntheticGrid(size_t cornerCount, ObjMesh& mesh)
+{
+    cornerCount -= cornerCount % 3;
+
+    const size_t cornersPerRow = 6 * size_t(gridWidth - 1);
+    const size_t rowCount = (cornerCount + cornersPerRow - 1) / cornersPerRow + 1;
+
+    // seam columns get a second texture coordinate, used by the quads on their right
+    const uint32_t texcoordsPerRow = gridWidth + (gridWidth - 1) / seamSpacing;
+
+    mesh.positions.clear();
+    mesh.texcoords.clear();
+    mesh.corners.clear();
+    mesh.positions.reserve(3 * rowCount * gridWidth);
+    mesh.texcoords.reserve(2 * rowCount * texcoordsPerRow);
+    mesh.corners.reserve(cornerCount);
+
+    for (size_t row = 0; row < rowCount; ++row)
+    {
+        for (uint32_t column = 0; column < gridWidth; ++column)
+        {
+            const float x = column * 0.01f;
+            const float z = row * 0.01f;
+            mesh.positions.push_back(x);
+            mesh.positions.push_back(0.1f * std::sin(x * 7.f) * std::cos(z * 5.f));
+            mesh.positions.push_back(z);
+
+            const float v = std::fmod(row / 1024.f, 1.f);
+            mesh.texcoords.push_back(column / float(gridWidth - 1));
+            mesh.texcoords.push_back(v);
+
+            if (column > 0 && column % seamSpacing == 0 && column + 1 < gridWidth)
+            {
+                mesh.texcoords.push_back(0.f);
+                mesh.texcoords.push_back(v);
+            }
+        }
+    }
+
+    // texture coordinate of a grid point as seen from the quad starting at column quad
+    auto texcoord = [texcoordsPerRow](size_t row, uint32_t column, uint32_t quad)
+    {
+        const uint32_t seamsBefore = (column - 1) / seamSpacing;
+        const bool seam = column > 0 && column % seamSpacing == 0 && column + 1 < gridWidth;
+        const uint32_t offset = column == 0 ? 0 : column + seamsBefore + (seam && quad == column ? 1 : 0);
+        return static_cast<int>(row * texcoordsPerRow + offset);
+    };
+
+    auto corner = [&](size_t row, uint32_t column, uint32_t quad)
+    {
+        if (mesh.corners.size() < cornerCount)
+        {
+            mesh.corners.push_back({ static_cast<int>(row * gridWidth + column), texcoord(row, column, quad) });
+        }
+    };
+
+    for (size_t row = 1; row < rowCount && mesh.corners.size() < cornerCount; ++row)
+    {
+        for (uint32_t column = 0; column + 1 < gridWidth; ++column)
+        {
+            corner(row - 1, column, column);
+            corner(row, column, column);
+            corner(row - 1, column + 1, column);
+
+            corner(row - 1, column + 1, column);
+            corner(row, column, column);
+            corner(row, column + 1, column);
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef SyntheticMesh_h__
+#define SyntheticMesh_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct ObjMesh;
+
+// Writes a wavy grid as an OBJ file of about targetBytes, with v, vt and f v/vt records.
+// Rows are written one after another, each followed by the faces joining it to the previous one,
+// so every face only refers to records already written.
+// Returns the number of bytes written.
+uint64_t writeSyntheticObj(const std::string& path, uint64_t targetBytes);
+
+// Same grid built in memory, cornerCount corners in row order. Every grid point is shared by up to six
+// triangles and a uv seam every 64 columns splits the points on it, like a typical unwrapped mesh.
+void makeSyntheticGrid(size_t cornerCount, ObjMesh& mesh);
+
+#endif // SyntheticMesh_h__
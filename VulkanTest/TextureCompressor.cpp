@@ -0,0 +1,477 @@
+#include "TextureCompressor.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int blockPixels = 16;
+
+// least squares passes over the indices of the previous fit, stopping early when one does not help
+const int refineIterations = 3;
+
+// bc7 interpolation weights of 4 bit indices, out of 64
+const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// bc1 palette order: endpoint 0, endpoint 1, 1/3 and 2/3 of the way
+const float bc1Weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+struct Block
+{
+    float pixels[blockPixels][4];
+};
+
+void loadBlock(const uint8_t* image, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Block& block)
+{
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        const uint32_t row = std::min(blockY * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            const uint32_t column = std::min(blockX * 4 + x, width - 1);
+            const uint8_t* pixel = image + 4 * (size_t(row) * width + column);
+            for (int c = 0; c < 4; ++c)
+            {
+                block.pixels[y * 4 + x][c] = pixel[c];
+            }
+        }
+    }
+}
+
+// endpoints at both ends of the block's projection on its principal axis
+void principalEndpoints(const Block& block, int channels, float* endpoint0, float* endpoint1)
+{
+    float mean[4] = {};
+    for (const auto& pixel : block.pixels)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            mean[c] += pixel[c] / blockPixels;
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (const auto& pixel : block.pixels)
+    {
+        for (int i = 0; i < channels; ++i)
+        {
+            for (int j = 0; j < channels; ++j)
+            {
+                covariance[i][j] += (pixel[i] - mean[i]) * (pixel[j] - mean[j]);
+            }
+        }
+    }
+
+    // power iteration from the channel of largest variance, converges in a few steps for 3 or 4 dimensions
+    int widest = 0;
+    for (int i = 1; i < channels; ++i)
+    {
+        if (covariance[i][i] > covariance[widest][widest])
+        {
+            widest = i;
+        }
+    }
+
+    float axis[4] = {};
+    for (int i = 0; i < channels; ++i)
+    {
+        axis[i] = covariance[widest][i];
+    }
+
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {};
+        float length = 0.f;
+        for (int i = 0; i < channels; ++i)
+        {
+            for (int j = 0; j < channels; ++j)
+            {
+                next[i] += covariance[i][j] * axis[j];
+            }
+            length = std::max(length, std::abs(next[i]));
+        }
+
+        if (length < 1e-6f)
+        {
+            break;
+        }
+
+        for (int i = 0; i < channels; ++i)
+        {
+            axis[i] = next[i] / length;
+        }
+    }
+
+    float axisLength2 = 0.f;
+    for (int c = 0; c < channels; ++c)
+    {
+        axisLength2 += axis[c] * axis[c];
+    }
+
+    // a flat block keeps both endpoints on the mean
+    float minT = 0.f;
+    float maxT = 0.f;
+    if (axisLength2 > 1e-6f)
+    {
+        for (const auto& pixel : block.pixels)
+        {
+            float t = 0.f;
+            for (int c = 0; c < channels; ++c)
+            {
+                t += (pixel[c] - mean[c]) * axis[c];
+            }
+            t /= axisLength2;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+
+    for (int c = 0; c < 4; ++c)
+    {
+        const float value = c < channels ? mean[c] : 255.f;
+        const float direction = c < channels ? axis[c] : 0.f;
+        endpoint0[c] = std::max(0.f, std::min(255.f, value + minT * direction));
+        endpoint1[c] = std::max(0.f, std::min(255.f, value + maxT * direction));
+    }
+}
+
+// least squares endpoints for fixed per pixel weights, returns false if they are degenerate
+bool refineEndpoints(const Block& block, const float* weights, int channels, float* endpoint0, float* endpoint1)
+{
+    float a = 0.f;
+    float b = 0.f;
+    float c = 0.f;
+    float x0[4] = {};
+    float x1[4] = {};
+
+    for (int i = 0; i < blockPixels; ++i)
+    {
+        const float w = weights[i];
+        a += (1.f - w) * (1.f - w);
+        b += (1.f - w) * w;
+        c += w * w;
+        for (int k = 0; k < channels; ++k)
+        {
+            x0[k] += (1.f - w) * block.pixels[i][k];
+            x1[k] += w * block.pixels[i][k];
+        }
+    }
+
+    const float determinant = a * c - b * b;
+    if (std::abs(determinant) < 1e-6f)
+    {
+        return false;
+    }
+
+    for (int k = 0; k < channels; ++k)
+    {
+        endpoint0[k] = std::max(0.f, std::min(255.f, (c * x0[k] - b * x1[k]) / determinant));
+        endpoint1[k] = std::max(0.f, std::min(255.f, (a * x1[k] - b * x0[k]) / determinant));
+    }
+    return true;
+}
+
+template<typename Palette>
+float assignIndices(const Block& block, const Palette& palette, int paletteSize, int channels, uint8_t* indices)
+{
+    float total = 0.f;
+    for (int i = 0; i < blockPixels; ++i)
+    {
+        float best = 1e30f;
+        for (int p = 0; p < paletteSize; ++p)
+        {
+            float error = 0.f;
+            for (int c = 0; c < channels; ++c)
+            {
+                const float d = block.pixels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best)
+            {
+                best = error;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+struct Bc1Candidate
+{
+    uint16_t color0;
+    uint16_t color1;
+    uint8_t indices[blockPixels];
+    float error;
+};
+
+inline uint16_t toRgb565(const float* color)
+{
+    const int r = static_cast<int>(std::lround(color[0] * 31.f / 255.f));
+    const int g = static_cast<int>(std::lround(color[1] * 63.f / 255.f));
+    const int b = static_cast<int>(std::lround(color[2] * 31.f / 255.f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void fromRgb565(uint16_t color, int* output)
+{
+    const int r = (color >> 11) & 31;
+    const int g = (color >> 5) & 63;
+    const int b = color & 31;
+    output[0] = (r << 3) | (r >> 2);
+    output[1] = (g << 2) | (g >> 4);
+    output[2] = (b << 3) | (b >> 2);
+}
+
+void evaluateBc1(const Block& block, const float* endpoint0, const float* endpoint1, Bc1Candidate& candidate)
+{
+    candidate.color0 = toRgb565(endpoint0);
+    candidate.color1 = toRgb565(endpoint1);
+
+    int c0[3];
+    int c1[3];
+    fromRgb565(candidate.color0, c0);
+    fromRgb565(candidate.color1, c1);
+
+    int palette[4][3];
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[0][c] = c0[c];
+        palette[1][c] = c1[c];
+        palette[2][c] = (2 * c0[c] + c1[c]) / 3;
+        palette[3][c] = (c0[c] + 2 * c1[c]) / 3;
+    }
+
+    candidate.error = assignIndices(block, palette, 4, 3, candidate.indices);
+}
+
+void encodeBc1(const Block& block, uint8_t* output)
+{
+    float endpoint0[4];
+    float endpoint1[4];
+    principalEndpoints(block, 3, endpoint0, endpoint1);
+
+    Bc1Candidate best;
+    evaluateBc1(block, endpoint0, endpoint1, best);
+
+    for (int iteration = 0; iteration < refineIterations; ++iteration)
+    {
+        float weights[blockPixels];
+        for (int i = 0; i < blockPixels; ++i)
+        {
+            weights[i] = bc1Weights[best.indices[i]];
+        }
+
+        Bc1Candidate refined;
+        if (!refineEndpoints(block, weights, 3, endpoint0, endpoint1))
+        {
+            break;
+        }
+
+        evaluateBc1(block, endpoint0, endpoint1, refined);
+        if (refined.error >= best.error)
+        {
+            break;
+        }
+        best = refined;
+    }
+
+    uint16_t color0 = best.color0;
+    uint16_t color1 = best.color1;
+    uint32_t indices = 0;
+
+    if (color0 == color1)
+    {
+        // color0 <= color1 selects the 3 color mode, which is fine with every index at 0
+    }
+    else
+    {
+        // 4 color mode needs color0 > color1, swapping the endpoints swaps indices 0 1 and 2 3
+        const uint32_t flip = color0 < color1 ? 1 : 0;
+        if (flip)
+        {
+            std::swap(color0, color1);
+        }
+
+        for (int i = 0; i < blockPixels; ++i)
+        {
+            indices |= static_cast<uint32_t>(best.indices[i] ^ flip) << (2 * i);
+        }
+    }
+
+    memcpy(output, &color0, 2);
+    memcpy(output + 2, &color1, 2);
+    memcpy(output + 4, &indices, 4);
+}
+
+struct Bc7Candidate
+{
+    uint8_t endpoints[2][4]; // 7 bit
+    uint8_t pbits[2];
+    uint8_t indices[blockPixels];
+    float error;
+};
+
+// 7 bit endpoint plus the shared p-bit closest to color
+void quantizeBc7Endpoint(const float* color, uint8_t* endpoint, uint8_t& pbit)
+{
+    float bestError = 1e30f;
+    for (uint8_t p = 0; p < 2; ++p)
+    {
+        uint8_t quantized[4];
+        float error = 0.f;
+        for (int c = 0; c < 4; ++c)
+        {
+            const int value = static_cast<int>(std::lround((color[c] - p) * 0.5f));
+            quantized[c] = static_cast<uint8_t>(std::max(0, std::min(127, value)));
+            const float d = color[c] - ((quantized[c] << 1) | p);
+            error += d * d;
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            pbit = p;
+            memcpy(endpoint, quantized, 4);
+        }
+    }
+}
+
+void evaluateBc7(const Block& block, const float* endpoint0, const float* endpoint1, Bc7Candidate& candidate)
+{
+    quantizeBc7Endpoint(endpoint0, candidate.endpoints[0], candidate.pbits[0]);
+    quantizeBc7Endpoint(endpoint1, candidate.endpoints[1], candidate.pbits[1]);
+
+    int palette[16][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        const int e0 = (candidate.endpoints[0][c] << 1) | candidate.pbits[0];
+        const int e1 = (candidate.endpoints[1][c] << 1) | candidate.pbits[1];
+        for (int i = 0; i < 16; ++i)
+        {
+            palette[i][c] = ((64 - bc7Weights[i]) * e0 + bc7Weights[i] * e1 + 32) >> 6;
+        }
+    }
+
+    candidate.error = assignIndices(block, palette, 16, 4, candidate.indices);
+}
+
+class BitWriter
+{
+public:
+    explicit BitWriter(uint8_t* output) : output(output) { memset(output, 0, 16); }
+
+    void write(uint32_t value, int bits)
+    {
+        for (int i = 0; i < bits; ++i, ++position)
+        {
+            output[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+        }
+    }
+
+private:
+    uint8_t* output;
+    int position = 0;
+};
+
+void encodeBc7(const Block& block, uint8_t* output)
+{
+    float endpoint0[4];
+    float endpoint1[4];
+    principalEndpoints(block, 4, endpoint0, endpoint1);
+
+    Bc7Candidate best;
+    evaluateBc7(block, endpoint0, endpoint1, best);
+
+    for (int iteration = 0; iteration < refineIterations; ++iteration)
+    {
+        float weights[blockPixels];
+        for (int i = 0; i < blockPixels; ++i)
+        {
+            weights[i] = bc7Weights[best.indices[i]] / 64.f;
+        }
+
+        Bc7Candidate refined;
+        if (!refineEndpoints(block, weights, 4, endpoint0, endpoint1))
+        {
+            break;
+        }
+
+        evaluateBc7(block, endpoint0, endpoint1, refined);
+        if (refined.error >= best.error)
+        {
+            break;
+        }
+        best = refined;
+    }
+
+    // the first index is stored without its top bit, swap the endpoints if it is set
+    if (best.indices[0] & 8)
+    {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        std::swap(best.pbits[0], best.pbits[1]);
+        for (auto& index : best.indices)
+        {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    BitWriter writer(output);
+    writer.write(1 << 6, 7); // mode 6
+
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.write(best.endpoints[0][c], 7);
+        writer.write(best.endpoints[1][c], 7);
+    }
+
+    writer.write(best.pbits[0], 1);
+    writer.write(best.pbits[1], 1);
+
+    writer.write(best.indices[0], 3);
+    for (int i = 1; i < blockPixels; ++i)
+    {
+        writer.write(best.indices[i], 4);
+    }
+}
+
+}
+
+size_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t compressedSize(BlockFormat format, uint32_t width, uint32_t height)
+{
+    return blockBytes(format) * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+void compressImage(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format, uint8_t* output)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const size_t bytes = blockBytes(format);
+
+    parallelFor(blocksY, [&](size_t blockY)
+    {
+        Block block;
+        uint8_t* row = output + bytes * blocksX * blockY;
+
+        for (uint32_t blockX = 0; blockX < blocksX; ++blockX)
+        {
+            loadBlock(pixels, width, height, blockX, static_cast<uint32_t>(blockY), block);
+
+            if (format == BlockFormat::BC1)
+            {
+                encodeBc1(block, row + bytes * blockX);
+            }
+            else
+            {
+                encodeBc7(block, row + bytes * blockX);
+            }
+        }
+    });
+}
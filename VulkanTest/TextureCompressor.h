@@ -0,0 +1,24 @@
+#ifndef TextureCompressor_h__
+#define TextureCompressor_h__
+
+#include <cstddef>
+#include <cstdint>
+
+enum class BlockFormat : uint32_t
+{
+    BC1 = 1, // 4 bpp RGB, for opaque textures
+    BC7 = 2, // 8 bpp RGBA, for quality
+};
+
+size_t blockBytes(BlockFormat format);
+
+// bytes of a width x height image in 4x4 blocks, partial blocks at the edges included
+size_t compressedSize(BlockFormat format, uint32_t width, uint32_t height);
+
+// Encodes an RGBA8 image into 4x4 blocks, rows of blocks split across all cores.
+// BC1 uses the principal axis of each block refined by least squares in 4 color mode,
+// BC7 uses mode 6 only (one subset, RGBA endpoints with p-bits, 16 weights) with the same fit.
+// Partial edge blocks repeat their last row and column.
+void compressImage(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format, uint8_t* output);
+
+#endif // TextureCompressor_h__
@@ -0,0 +1,293 @@
+#include "TextureContainer.h"
+#include "TextureCompressor.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+const uint32_t maxLevels = 16;
+
+// a multiple of every texel block size written here, as KTX2 asks level data to be
+const uint64_t levelAlignment = 16;
+
+const char sourceKeyName[] = "VKTsourceKey";
+
+struct SourceKeyValue
+{
+    uint64_t sourceSize;
+    uint64_t sourceTime;
+    uint64_t sourceHash;
+    uint32_t options;
+    uint32_t sourceChannels;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// bytes of a level in one of the formats the application writes, 0 for any other format
+uint64_t levelSize(uint32_t vkFormat, uint32_t width, uint32_t height)
+{
+    switch (vkFormat)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return 4ull * width * height;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        return compressedSize(BlockFormat::BC1, width, height);
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        return compressedSize(BlockFormat::BC7, width, height);
+    default:
+        return 0;
+    }
+}
+
+}
+
+struct TextureContainer::Header
+{
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct TextureContainer::LevelIndex
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+std::string TextureContainer::containerPath(const std::string& sourcePath)
+{
+    return sourcePath + ".ktx2";
+}
+
+void TextureContainer::write(const std::string& path,
+                             const MeshCacheKey& key,
+                             uint32_t vkFormat,
+                             uint32_t sourceChannels,
+                             const std::vector<TextureLevel>& levels)
+{
+    if (levels.empty() || levels.size() > maxLevels)
+    {
+        throw std::invalid_argument("unsupported texture container level count");
+    }
+
+    Header header = {};
+    memcpy(header.identifier, identifier, sizeof(identifier));
+    header.vkFormat = vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = levels[0].width;
+    header.pixelHeight = levels[0].height;
+    header.faceCount = 1;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+
+    // one key/value entry: its length, the nul terminated key, the value, padding to 4 bytes
+    SourceKeyValue value = {};
+    value.sourceSize = key.sourceSize;
+    value.sourceTime = key.sourceTime;
+    value.sourceHash = key.sourceHash;
+    value.options = key.options;
+    value.sourceChannels = sourceChannels;
+
+    const uint32_t entryLength = static_cast<uint32_t>(sizeof(sourceKeyName) + sizeof(value));
+    std::vector<char> keyValueData(alignUp(sizeof(entryLength) + entryLength, 4));
+    memcpy(keyValueData.data(), &entryLength, sizeof(entryLength));
+    memcpy(keyValueData.data() + sizeof(entryLength), sourceKeyName, sizeof(sourceKeyName));
+    memcpy(keyValueData.data() + sizeof(entryLength) + sizeof(sourceKeyName), &value, sizeof(value));
+
+    std::vector<LevelIndex> levelIndex(levels.size());
+
+    header.kvdByteOffset = static_cast<uint32_t>(sizeof(Header) + sizeof(LevelIndex) * levels.size());
+    header.kvdByteLength = static_cast<uint32_t>(keyValueData.size());
+
+    // smallest level first, as KTX2 lays them out
+    uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        offset = alignUp(offset, levelAlignment);
+        levelIndex[i].byteOffset = offset;
+        levelIndex[i].byteLength = levels[i].size;
+        levelIndex[i].uncompressedByteLength = levels[i].size;
+        offset += levels[i].size;
+    }
+
+    // write aside then swap, so a crash never leaves a truncated file behind
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open " + tempPath);
+        }
+
+        static const char padding[levelAlignment] = {};
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(levelIndex.data()), sizeof(LevelIndex) * levelIndex.size());
+        file.write(keyValueData.data(), keyValueData.size());
+        uint64_t written = header.kvdByteOffset + header.kvdByteLength;
+
+        for (size_t i = levels.size(); i-- > 0;)
+        {
+            file.write(padding, levelIndex[i].byteOffset - written);
+            file.write(static_cast<const char*>(levels[i].data), levels[i].size);
+            written = levelIndex[i].byteOffset + levels[i].size;
+        }
+
+        if (!file.good())
+        {
+            throw std::runtime_error("failed to write " + tempPath);
+        }
+    }
+
+    if (!replaceFile(tempPath, path))
+    {
+        throw std::runtime_error("failed to rename " + tempPath);
+    }
+}
+
+bool TextureContainer::open(const std::string& path, const MeshCacheKey& key)
+{
+    close();
+
+    if (!file.open(path) || file.size() < sizeof(Header))
+    {
+        file.close();
+        return false;
+    }
+
+    auto candidate = reinterpret_cast<const Header*>(file.begin());
+
+    bool valid = memcmp(candidate->identifier, identifier, sizeof(identifier)) == 0
+        && candidate->supercompressionScheme == 0
+        && candidate->pixelDepth == 0
+        && candidate->layerCount == 0
+        && candidate->faceCount == 1
+        && candidate->pixelWidth > 0
+        && candidate->pixelHeight > 0
+        && candidate->levelCount > 0
+        && candidate->levelCount <= maxLevels
+        && std::max(candidate->pixelWidth, candidate->pixelHeight) >> (candidate->levelCount - 1) > 0
+        && sizeof(Header) + sizeof(LevelIndex) * candidate->levelCount <= file.size()
+        && candidate->kvdByteOffset <= file.size()
+        && candidate->kvdByteLength <= file.size() - candidate->kvdByteOffset;
+
+    auto levelIndex = reinterpret_cast<const LevelIndex*>(file.begin() + sizeof(Header));
+
+    // the upload splits each level into rows from its size, so it has to be exact
+    for (uint32_t i = 0; valid && i < candidate->levelCount; ++i)
+    {
+        const auto& level = levelIndex[i];
+        const uint32_t levelWidth = std::max(1u, candidate->pixelWidth >> i);
+        const uint32_t levelHeight = std::max(1u, candidate->pixelHeight >> i);
+        const uint64_t expectedSize = levelSize(candidate->vkFormat, levelWidth, levelHeight);
+
+        valid = expectedSize > 0
+            && level.byteLength == expectedSize
+            && level.byteOffset <= file.size()
+            && level.byteLength <= file.size() - level.byteOffset;
+    }
+
+    // look for the source key among the key/value entries
+    bool fresh = false;
+    const char* entry = file.begin() + (valid ? candidate->kvdByteOffset : 0);
+    const char* entriesEnd = entry + (valid ? candidate->kvdByteLength : 0);
+
+    while (!fresh && entriesEnd - entry >= static_cast<ptrdiff_t>(sizeof(uint32_t)))
+    {
+        uint32_t entryLength;
+        memcpy(&entryLength, entry, sizeof(entryLength));
+        const char* entryData = entry + sizeof(entryLength);
+
+        if (entryLength > static_cast<size_t>(entriesEnd - entryData))
+        {
+            break;
+        }
+
+        if (entryLength == sizeof(sourceKeyName) + sizeof(SourceKeyValue)
+            && memcmp(entryData, sourceKeyName, sizeof(sourceKeyName)) == 0)
+        {
+            SourceKeyValue value;
+            memcpy(&value, entryData + sizeof(sourceKeyName), sizeof(value));
+
+            fresh = value.sourceSize == key.sourceSize
+                && value.sourceTime == key.sourceTime
+                && value.sourceHash == key.sourceHash
+                && value.options == key.options;
+            channels = value.sourceChannels;
+        }
+
+        entry = entryData + alignUp(entryLength, 4);
+    }
+
+    if (!valid || !fresh)
+    {
+        file.close();
+        return false;
+    }
+
+    header = candidate;
+    levels = levelIndex;
+    return true;
+}
+
+void TextureContainer::close()
+{
+    header = nullptr;
+    levels = nullptr;
+    channels = 0;
+    file.close();
+}
+
+uint32_t TextureContainer::format() const
+{
+    return header->vkFormat;
+}
+
+uint32_t TextureContainer::width() const
+{
+    return header->pixelWidth;
+}
+
+uint32_t TextureContainer::height() const
+{
+    return header->pixelHeight;
+}
+
+uint32_t TextureContainer::levelCount() const
+{
+    return header->levelCount;
+}
+
+TextureLevel TextureContainer::level(uint32_t index) const
+{
+    TextureLevel level;
+    level.width = std::max(1u, header->pixelWidth >> index);
+    level.height = std::max(1u, header->pixelHeight >> index);
+    level.data = file.begin() + levels[index].byteOffset;
+    level.size = static_cast<size_t>(levels[index].byteLength);
+    return level;
+}
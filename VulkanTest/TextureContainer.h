@@ -0,0 +1,62 @@
+#ifndef TextureContainer_h__
+#define TextureContainer_h__
+
+#include "MappedFile.h"
+#include "MeshCache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one mip level in its final GPU format
+struct TextureLevel
+{
+    uint32_t width;
+    uint32_t height;
+    const void* data;
+    size_t size;
+};
+
+// Mip chain stored ready to upload, laid out like KTX2: identifier, header with the VkFormat, level index,
+// key/value data, then the levels from smallest to largest. The source key and channel count live in the
+// key/value data so a stale file is detected like a stale MeshCache. No data format descriptor is written,
+// and only supercompression scheme 0 (none) is read: zstd and BasisLZ would need libraries this tree lacks.
+// Opening maps the file, levels point straight into the mapping.
+class TextureContainer
+{
+public:
+    static std::string containerPath(const std::string& sourcePath);
+
+    static void write(const std::string& path,
+                      const MeshCacheKey& key,
+                      uint32_t vkFormat,
+                      uint32_t sourceChannels,
+                      const std::vector<TextureLevel>& levels);
+
+    // returns false if the file is missing, corrupted, supercompressed or stale. Corrupted includes levels
+    // whose size does not match their format and dimensions, and formats the application never writes
+    bool open(const std::string& path, const MeshCacheKey& key);
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+
+    uint32_t format() const;
+    uint32_t width() const;
+    uint32_t height() const;
+    uint32_t sourceChannels() const { return channels; }
+
+    uint32_t levelCount() const;
+    TextureLevel level(uint32_t index) const;
+
+private:
+    struct Header;
+    struct LevelIndex;
+
+    MappedFile file;
+    const Header* header = nullptr;
+    const LevelIndex* levels = nullptr;
+    uint32_t channels = 0;
+};
+
+#endif // TextureContainer_h__
@@ -0,0 +1,396 @@
+#include "UploadContext.h"
+
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+VkCommandPool createPool(VkDevice device, uint32_t queueFamily)
+{
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create upload command pool");
+    }
+
+    return commandPool;
+}
+
+VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool commandPool)
+{
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate upload command buffer");
+    }
+
+    return commandBuffer;
+}
+
+void beginCommandBuffer(VkCommandBuffer commandBuffer)
+{
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+}
+
+}
+
+UploadContext::UploadContext() = default;
+
+UploadContext::~UploadContext() = default;
+
+void UploadContext::init(VkDevice logicalDevice,
+                         VkQueue uploadQueue,
+                         uint32_t uploadFamily,
+                         VkQueue usingQueue,
+                         uint32_t usingFamily,
+                         DeviceAllocator* deviceAllocator)
+{
+    device = logicalDevice;
+    queue = uploadQueue;
+    queueFamily = uploadFamily;
+    ownerQueue = usingQueue;
+    ownerFamily = usingFamily;
+    allocator = deviceAllocator;
+
+    commandPool = createPool(device, queueFamily);
+
+    if (transfersOwnership())
+    {
+        ownerCommandPool = createPool(device, ownerFamily);
+    }
+}
+
+void UploadContext::destroy()
+{
+    finish();
+
+    for (auto& batch : spare)
+    {
+        vkDestroyFence(device, batch->fence, nullptr);
+        if (batch->released != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(device, batch->released, nullptr);
+        }
+    }
+    spare.clear();
+
+    // frees the command buffers too
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    commandPool = VK_NULL_HANDLE;
+
+    if (ownerCommandPool != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(device, ownerCommandPool, nullptr);
+        ownerCommandPool = VK_NULL_HANDLE;
+    }
+}
+
+VkCommandBuffer UploadContext::commandBuffer()
+{
+    if (open)
+    {
+        return open->commandBuffer;
+    }
+
+    if (!spare.empty())
+    {
+        open = std::move(spare.back());
+        spare.pop_back();
+    }
+    else
+    {
+        open.reset(new Batch());
+        open->commandBuffer = allocateCommandBuffer(device, commandPool);
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(device, &fenceInfo, nullptr, &open->fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create an upload batch");
+        }
+    }
+
+    beginCommandBuffer(open->commandBuffer);
+
+    return open->commandBuffer;
+}
+
+VkCommandBuffer UploadContext::acquireCommandBuffer()
+{
+    commandBuffer();
+
+    if (open->acquires)
+    {
+        return open->acquireCommandBuffer;
+    }
+
+    if (open->acquireCommandBuffer == VK_NULL_HANDLE)
+    {
+        open->acquireCommandBuffer = allocateCommandBuffer(device, ownerCommandPool);
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &open->released) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create an upload semaphore");
+        }
+    }
+
+    beginCommandBuffer(open->acquireCommandBuffer);
+    open->acquires = true;
+
+    return open->acquireCommandBuffer;
+}
+
+void UploadContext::release(VkBuffer buffer, DeviceAllocation& memory)
+{
+    // the newest batch holds the last commands that may read the buffer
+    Batch* owner = open ? open.get() : !inFlight.empty() ? inFlight.back().get() : nullptr;
+
+    if (owner)
+    {
+        owner->staging.push_back({ buffer, memory });
+        memory = DeviceAllocation();
+    }
+    else
+    {
+        vkDestroyBuffer(device, buffer, nullptr);
+        allocator->free(memory);
+    }
+}
+
+void UploadContext::prepareImage(VkImage image, uint32_t mipLevels)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+
+    vkCmdPipelineBarrier(commandBuffer(),
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barrier);
+}
+
+void UploadContext::handOverBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage)
+{
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    if (!transfersOwnership())
+    {
+        vkCmdPipelineBarrier(commandBuffer(),
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+                             0,
+                             0, nullptr,
+                             1, &barrier,
+                             0, nullptr);
+        return;
+    }
+
+    barrier.srcQueueFamilyIndex = queueFamily;
+    barrier.dstQueueFamilyIndex = ownerFamily;
+
+    // the release only makes the writes available, the acquire makes them visible to dstStage
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer(),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         1, &barrier,
+                         0, nullptr);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(acquireCommandBuffer(),
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+                         0,
+                         0, nullptr,
+                         1, &barrier,
+                         0, nullptr);
+}
+
+void UploadContext::handOverImage(VkImage image, uint32_t mipLevels, VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+
+    if (!transfersOwnership())
+    {
+        vkCmdPipelineBarrier(commandBuffer(),
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+                             0,
+                             0, nullptr,
+                             0, nullptr,
+                             1, &barrier);
+        return;
+    }
+
+    // both halves carry the same layout change, it happens once between them
+    barrier.srcQueueFamilyIndex = queueFamily;
+    barrier.dstQueueFamilyIndex = ownerFamily;
+
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer(),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(acquireCommandBuffer(),
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barrier);
+}
+
+void UploadContext::submit()
+{
+    if (!open)
+    {
+        return;
+    }
+
+    vkEndCommandBuffer(open->commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &open->commandBuffer;
+
+    if (!open->acquires)
+    {
+        if (vkQueueSubmit(queue, 1, &submitInfo, open->fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload batch");
+        }
+        ++submits;
+    }
+    else
+    {
+        vkEndCommandBuffer(open->acquireCommandBuffer);
+
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &open->released;
+
+        // the fence goes on the acquire, which runs after the copies
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo acquireInfo = {};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &open->released;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &open->acquireCommandBuffer;
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS
+            || vkQueueSubmit(ownerQueue, 1, &acquireInfo, open->fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload batch");
+        }
+        submits += 2;
+    }
+
+    inFlight.push_back(std::move(open));
+}
+
+bool UploadContext::poll()
+{
+    // in submission order, a batch done ahead of an older one is picked up on a later poll
+    while (!inFlight.empty() && vkGetFenceStatus(device, inFlight.front()->fence) == VK_SUCCESS)
+    {
+        recycle(std::move(inFlight.front()));
+        inFlight.pop_front();
+    }
+
+    return !open && inFlight.empty();
+}
+
+void UploadContext::finish()
+{
+    submit();
+
+    if (!inFlight.empty())
+    {
+        std::vector<VkFence> fences;
+        for (const auto& batch : inFlight)
+        {
+            fences.push_back(batch->fence);
+        }
+
+        vkWaitForFences(device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+        ++waits;
+    }
+
+    while (!inFlight.empty())
+    {
+        recycle(std::move(inFlight.front()));
+        inFlight.pop_front();
+    }
+}
+
+void UploadContext::recycle(std::unique_ptr<Batch> batch)
+{
+    for (auto& buffer : batch->staging)
+    {
+        vkDestroyBuffer(device, buffer.first, nullptr);
+        allocator->free(buffer.second);
+    }
+    batch->staging.clear();
+
+    vkResetFences(device, 1, &batch->fence);
+    vkResetCommandBuffer(batch->commandBuffer, 0);
+
+    if (batch->acquires)
+    {
+        vkResetCommandBuffer(batch->acquireCommandBuffer, 0);
+        batch->acquires = false;
+    }
+
+    spare.push_back(std::move(batch));
+}
@@ -0,0 +1,105 @@
+#ifndef UploadContext_h__
+#define UploadContext_h__
+
+#include "DeviceAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Records uploads, staging copies, layout transitions and blits, into one command buffer per batch.
+// A batch is submitted once with a fence. The staging buffers released into it are freed when that fence
+// signals, which poll() checks without blocking so other init work can go on meanwhile.
+// When the uploads run on another queue family than the one using them, like a transfer only family,
+// every hand over is a release on the upload queue and an acquire on the owner queue. The acquires of a
+// batch go in a second command buffer submitted to the owner queue behind a semaphore.
+class UploadContext
+{
+public:
+    UploadContext();
+    ~UploadContext();
+
+    UploadContext(const UploadContext&) = delete;
+    UploadContext& operator=(const UploadContext&) = delete;
+
+    void init(VkDevice device,
+              VkQueue queue,
+              uint32_t queueFamily,
+              VkQueue ownerQueue,
+              uint32_t ownerFamily,
+              DeviceAllocator* allocator);
+
+    // waits for every batch
+    void destroy();
+
+    // command buffer of the open batch, begun on first use
+    VkCommandBuffer commandBuffer();
+
+    // destroyed once every command recorded so far has completed
+    void release(VkBuffer buffer, DeviceAllocation& memory);
+
+    // moves every level of a new image to TRANSFER_DST_OPTIMAL
+    void prepareImage(VkImage image, uint32_t mipLevels);
+
+    // makes the copies recorded so far visible to the owner queue from dstStage on
+    void handOverBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+
+    // same for an image in TRANSFER_DST_OPTIMAL, which ends up in newLayout
+    void handOverImage(VkImage image, uint32_t mipLevels, VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+
+    // submits the open batch, if anything was recorded
+    void submit();
+
+    // frees the staging of completed batches, returns true when nothing is left open or in flight
+    bool poll();
+
+    // submits, then blocks until every batch has completed
+    void finish();
+
+    uint32_t submitCount() const { return submits; }
+    uint32_t waitCount() const { return waits; }
+
+    size_t inFlightCount() const { return inFlight.size(); }
+
+    bool transfersOwnership() const { return queueFamily != ownerFamily; }
+
+private:
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+
+        // owner queue side, when ownership moves
+        VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore released = VK_NULL_HANDLE;
+        bool acquires = false;
+        std::vector<std::pair<VkBuffer, DeviceAllocation>> staging;
+    };
+
+    void recycle(std::unique_ptr<Batch> batch);
+
+    VkCommandBuffer acquireCommandBuffer();
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    VkQueue ownerQueue = VK_NULL_HANDLE;
+    uint32_t ownerFamily = 0;
+    VkCommandPool ownerCommandPool = VK_NULL_HANDLE;
+    DeviceAllocator* allocator = nullptr;
+
+    std::unique_ptr<Batch> open;
+    std::deque<std::unique_ptr<Batch>> inFlight; // in submission order
+    std::vector<std::unique_ptr<Batch>> spare;
+
+    uint32_t submits = 0;
+    uint32_t waits = 0;
+};
+
+#endif // UploadContext_h__
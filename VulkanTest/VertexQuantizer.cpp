@@ -0,0 +1,200 @@
+#include "VertexQuantizer.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+const size_t blockSize = 1 << 16;
+
+// keeps the division defined for flat meshes
+const float minExtent = 1e-6f;
+
+struct BlockBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 displacement;
+    bool texCoordsInUnitRange;
+};
+
+inline int16_t toSnorm16(float value)
+{
+    value = std::max(-1.f, std::min(1.f, value));
+    return static_cast<int16_t>(std::lround(value * 32767.f));
+}
+
+inline uint16_t toUnorm16(float value)
+{
+    value = std::max(0.f, std::min(1.f, value));
+    return static_cast<uint16_t>(std::lround(value * 65535.f));
+}
+
+inline void quantizePosition(const glm::vec3& position, const QuantizationDomain& domain, int16_t* output)
+{
+    const glm::vec3 normalized = (position - domain.center) / domain.extent;
+    output[0] = toSnorm16(normalized.x);
+    output[1] = toSnorm16(normalized.y);
+    output[2] = toSnorm16(normalized.z);
+    output[3] = 0;
+}
+
+}
+
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t rawExponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (rawExponent == 0xFFu)
+    {
+        // inf stays inf, nan stays nan
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+
+    const int exponent = static_cast<int>(rawExponent) - 127 + 15;
+
+    if (exponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return static_cast<uint16_t>(sign);
+        }
+
+        // denormal half
+        mantissa |= 0x800000u;
+        const int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u)
+        {
+            ++half;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u)
+    {
+        // a carry into the exponent is still the right rounding
+        ++half;
+    }
+    return static_cast<uint16_t>(half);
+}
+
+QuantizationLayout computeQuantizationLayout(const Vertex* vertices, size_t count, bool restPositions, bool deformation)
+{
+    const size_t blockCount = (count + blockSize - 1) / blockSize;
+    std::vector<BlockBounds> blocks(blockCount);
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        auto& bounds = blocks[block];
+        bounds.min = glm::vec3(std::numeric_limits<float>::max());
+        bounds.max = glm::vec3(-std::numeric_limits<float>::max());
+        bounds.displacement = glm::vec3(0.f);
+        bounds.texCoordsInUnitRange = true;
+
+        const size_t end = std::min(count, (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; ++i)
+        {
+            const auto& vertex = vertices[i];
+            const glm::vec3& position = restPositions ? vertex.color : vertex.pos;
+            const glm::vec2& uv = vertex.texCoord;
+
+            bounds.min = glm::min(bounds.min, position);
+            bounds.max = glm::max(bounds.max, position);
+
+            // compute.comp moves each axis by at most |uv.x|, |uv.y| and |uv.x - uv.y|
+            bounds.displacement = glm::max(bounds.displacement,
+                                           glm::vec3(std::abs(uv.x), std::abs(uv.y), std::abs(uv.x - uv.y)));
+
+            bounds.texCoordsInUnitRange = bounds.texCoordsInUnitRange
+                && uv.x >= 0.f && uv.x <= 1.f && uv.y >= 0.f && uv.y <= 1.f;
+        }
+    });
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+    glm::vec3 displacement(0.f);
+    bool texCoordsInUnitRange = true;
+
+    for (const auto& bounds : blocks)
+    {
+        min = glm::min(min, bounds.min);
+        max = glm::max(max, bounds.max);
+        displacement = glm::max(displacement, bounds.displacement);
+        texCoordsInUnitRange = texCoordsInUnitRange && bounds.texCoordsInUnitRange;
+    }
+
+    if (count == 0)
+    {
+        min = max = glm::vec3(0.f);
+    }
+
+    if (deformation)
+    {
+        min -= displacement;
+        max += displacement;
+    }
+
+    QuantizationLayout layout;
+    layout.domain.center = (min + max) * 0.5f;
+    layout.domain.extent = glm::max((max - min) * 0.5f, glm::vec3(minExtent));
+    layout.texCoordEncoding = texCoordsInUnitRange ? TexCoordEncoding::Unorm16 : TexCoordEncoding::Half;
+    return layout;
+}
+
+void quantizeVertices(const Vertex* vertices, size_t count, const QuantizationLayout& layout, bool restPositions, PackedVertex* output)
+{
+    const size_t blockCount = (count + blockSize - 1) / blockSize;
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        const size_t end = std::min(count, (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; ++i)
+        {
+            const auto& vertex = vertices[i];
+            auto& packed = output[i];
+
+            quantizePosition(restPositions ? vertex.color : vertex.pos, layout.domain, packed.pos);
+
+            if (layout.texCoordEncoding == TexCoordEncoding::Unorm16)
+            {
+                packed.texCoord[0] = toUnorm16(vertex.texCoord.x);
+                packed.texCoord[1] = toUnorm16(vertex.texCoord.y);
+            }
+            else
+            {
+                packed.texCoord[0] = floatToHalf(vertex.texCoord.x);
+                packed.texCoord[1] = floatToHalf(vertex.texCoord.y);
+            }
+        }
+    });
+}
+
+void quantizeRestPositions(const Vertex* vertices, size_t count, const QuantizationDomain& domain, PackedPosition* output)
+{
+    const size_t blockCount = (count + blockSize - 1) / blockSize;
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        const size_t end = std::min(count, (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; ++i)
+        {
+            quantizePosition(vertices[i].color, domain, output[i].pos);
+        }
+    });
+}
@@ -0,0 +1,53 @@
+#ifndef VertexQuantizer_h__
+#define VertexQuantizer_h__
+
+#include "Geometry.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// 12 bytes instead of the 48 of Vertex: snorm16 position relative to a QuantizationDomain,
+// texture coordinate as unorm16 or half floats. Matches shader_compact.vert and compute_compact.comp.
+struct PackedVertex
+{
+    int16_t pos[4]; // w unused, 3 component 16-bit vertex formats are rarely supported
+    uint16_t texCoord[2];
+};
+
+// rest position read by the compute deformation, kept apart so drawing never fetches it
+struct PackedPosition
+{
+    int16_t pos[4];
+};
+
+// positions are stored as (p - center) / extent
+struct QuantizationDomain
+{
+    glm::vec3 center;
+    glm::vec3 extent;
+};
+
+enum class TexCoordEncoding
+{
+    Unorm16, // all coordinates in [0, 1], 1/65535 precision
+    Half,    // anything else
+};
+
+struct QuantizationLayout
+{
+    QuantizationDomain domain;
+    TexCoordEncoding texCoordEncoding;
+};
+
+// restPositions selects whether positions come from Vertex::color (the rest position the compute
+// deformation starts from) or Vertex::pos. With deformation the domain is grown to hold the largest
+// displacement compute.comp can apply.
+QuantizationLayout computeQuantizationLayout(const Vertex* vertices, size_t count, bool restPositions, bool deformation);
+
+void quantizeVertices(const Vertex* vertices, size_t count, const QuantizationLayout& layout, bool restPositions, PackedVertex* output);
+
+void quantizeRestPositions(const Vertex* vertices, size_t count, const QuantizationDomain& domain, PackedPosition* output);
+
+uint16_t floatToHalf(float value);
+
+#endif // VertexQuantizer_h__
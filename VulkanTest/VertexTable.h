@@ -0,0 +1,128 @@
+#ifndef VertexTable_h__
+#define VertexTable_h__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Flat open-addressing (linear probing) table mapping vertex keys to indices.
+// Keys live outside the table: each slot only keeps 32 bits of the hash and the index,
+// the caller provides the equality test against the key stored at a given index.
+class VertexTable
+{
+public:
+    explicit VertexTable(size_t expectedCount)
+    {
+        owned.resize(capacityFor(expectedCount), Slot{ 0, emptySlot });
+        slots = owned.data();
+        capacity = owned.size();
+    }
+
+    // in storageSize(maxCount) bytes owned by the caller, like a mapped file. It does not grow, inserting
+    // more than maxCount keys throws
+    VertexTable(void* storage, size_t maxCount)
+        : slots(static_cast<Slot*>(storage))
+        , capacity(capacityFor(maxCount))
+    {
+        std::fill(slots, slots + capacity, Slot{ 0, emptySlot });
+    }
+
+    VertexTable(const VertexTable&) = delete;
+    VertexTable& operator=(const VertexTable&) = delete;
+
+    static size_t storageSize(size_t maxCount) { return capacityFor(maxCount) * sizeof(Slot); }
+
+    // Returns the index stored for a key equal to the one being looked up,
+    // or stores candidate and returns it. equal(index) compares the looked up key with the one at index.
+    template<typename Equal>
+    uint32_t findOrInsert(uint64_t hash, uint32_t candidate, Equal equal)
+    {
+        if ((count + 1) * 4 > capacity * 3)
+        {
+            grow();
+        }
+
+        const auto tag = static_cast<uint32_t>(hash >> 32);
+        const size_t mask = capacity - 1;
+
+        for (size_t i = tag & mask;; i = (i + 1) & mask)
+        {
+            auto& slot = slots[i];
+
+            if (slot.index == emptySlot)
+            {
+                slot.tag = tag;
+                slot.index = candidate;
+                ++count;
+                return candidate;
+            }
+
+            if (slot.tag == tag && equal(slot.index))
+            {
+                return slot.index;
+            }
+        }
+    }
+
+    size_t size() const { return count; }
+
+    size_t memoryUsage() const { return capacity * sizeof(Slot); }
+
+private:
+    static const uint32_t emptySlot = 0xFFFFFFFFu;
+
+    struct Slot
+    {
+        uint32_t tag;
+        uint32_t index;
+    };
+
+    static size_t capacityFor(size_t expectedCount)
+    {
+        size_t slotCount = 16;
+        while (slotCount * 3 < expectedCount * 4)
+        {
+            slotCount *= 2;
+        }
+        return slotCount;
+    }
+
+    void grow()
+    {
+        if (owned.empty())
+        {
+            throw std::runtime_error("vertex table storage is full");
+        }
+
+        std::vector<Slot> previous(owned.size() * 2, Slot{ 0, emptySlot });
+        previous.swap(owned);
+        slots = owned.data();
+        capacity = owned.size();
+
+        const size_t mask = capacity - 1;
+        for (const auto& slot : previous)
+        {
+            if (slot.index == emptySlot)
+            {
+                continue;
+            }
+
+            size_t i = slot.tag & mask;
+            while (slots[i].index != emptySlot)
+            {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+
+    // empty when the storage belongs to the caller
+    std::vector<Slot> owned;
+    Slot* slots = nullptr;
+    size_t capacity = 0;
+    size_t count = 0;
+};
+
+#endif // VertexTable_h__
@@ -0,0 +1,184 @@
+#include "VertexWelder.h"
+#include "Parallel.h"
+#include "VertexTable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+
+// fixed sizes, the output and the barycenter rounding must not depend on the core count
+const size_t blockSize = 1 << 16;
+const size_t shardCount = 256;
+
+inline size_t shardOf(uint64_t hash)
+{
+    // VertexTable probes with the high half, shard with the low bits
+    return static_cast<size_t>(hash & (shardCount - 1));
+}
+
+}
+
+Vertex makeVertex(const ObjMesh& mesh, const ObjIndex& index)
+{
+    Vertex vertex = {};
+    vertex.pos = {
+        mesh.positions[3 * index.vertex + 0],
+        mesh.positions[3 * index.vertex + 2], // model in z up
+        mesh.positions[3 * index.vertex + 1],
+    };
+    if (index.texcoord >= 0)
+    {
+        vertex.texCoord = {
+            mesh.texcoords[2 * index.texcoord + 0],
+            1.0f - mesh.texcoords[2 * index.texcoord + 1],
+        };
+    }
+    vertex.color = vertex.pos;
+    return vertex;
+}
+
+void weldVertices(const ObjMesh& mesh, std::vector<Vertex>& vertices, std::vector<int>& indices, glm::vec3& barycenter)
+{
+    const size_t cornerCount = mesh.corners.size();
+    if (cornerCount > static_cast<size_t>(INT32_MAX))
+    {
+        throw std::runtime_error("too many corners to weld");
+    }
+
+    const size_t blockCount = (cornerCount + blockSize - 1) / blockSize;
+
+    // hash every corner and count how many land in each shard, per block
+    std::vector<uint64_t> hashes(cornerCount);
+    std::vector<uint32_t> shardOffsets(blockCount * shardCount, 0);
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        auto counts = &shardOffsets[block * shardCount];
+        const size_t end = std::min(cornerCount, (block + 1) * blockSize);
+
+        for (size_t c = block * blockSize; c < end; ++c)
+        {
+            hashes[c] = hashVertex(makeVertex(mesh, mesh.corners[c]));
+            ++counts[shardOf(hashes[c])];
+        }
+    });
+
+    // exclusive prefix sum in shard major order: each shard gets a contiguous run of corners, in corner order
+    std::vector<uint32_t> shardBegins(shardCount + 1);
+    uint32_t offset = 0;
+    for (size_t shard = 0; shard < shardCount; ++shard)
+    {
+        shardBegins[shard] = offset;
+        for (size_t block = 0; block < blockCount; ++block)
+        {
+            const auto count = shardOffsets[block * shardCount + shard];
+            shardOffsets[block * shardCount + shard] = offset;
+            offset += count;
+        }
+    }
+    shardBegins[shardCount] = offset;
+
+    std::vector<uint32_t> shardCorners(cornerCount);
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        auto offsets = &shardOffsets[block * shardCount];
+        const size_t end = std::min(cornerCount, (block + 1) * blockSize);
+
+        for (size_t c = block * blockSize; c < end; ++c)
+        {
+            shardCorners[offsets[shardOf(hashes[c])]++] = static_cast<uint32_t>(c);
+        }
+    });
+
+    // dedup each shard on its own, every corner points at the first corner holding the same vertex
+    std::vector<uint32_t> firstCorners(cornerCount);
+
+    parallelFor(shardCount, [&](size_t shard)
+    {
+        const uint32_t begin = shardBegins[shard];
+        const uint32_t end = shardBegins[shard + 1];
+
+        VertexTable uniqueVertices((end - begin) / 3);
+
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const uint32_t corner = shardCorners[i];
+            const Vertex vertex = makeVertex(mesh, mesh.corners[corner]);
+
+            firstCorners[corner] = uniqueVertices.findOrInsert(hashes[corner], corner, [&](uint32_t other)
+            {
+                return makeVertex(mesh, mesh.corners[other]) == vertex;
+            });
+        }
+    });
+
+    hashes = std::vector<uint64_t>();
+    shardCorners = std::vector<uint32_t>();
+
+    // count first occurrences and sum their positions per block, then prefix sum the counts into ids
+    std::vector<uint32_t> blockVertices(blockCount, 0);
+    std::vector<glm::dvec3> blockSums(blockCount, glm::dvec3(0.0));
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        const size_t end = std::min(cornerCount, (block + 1) * blockSize);
+
+        for (size_t c = block * blockSize; c < end; ++c)
+        {
+            if (firstCorners[c] == c)
+            {
+                ++blockVertices[block];
+                blockSums[block] += glm::dvec3(makeVertex(mesh, mesh.corners[c]).pos);
+            }
+        }
+    });
+
+    uint32_t vertexCount = 0;
+    glm::dvec3 sum(0.0);
+    for (size_t block = 0; block < blockCount; ++block)
+    {
+        const auto count = blockVertices[block];
+        blockVertices[block] = vertexCount;
+        vertexCount += count;
+        sum += blockSums[block];
+    }
+
+    barycenter = vertexCount > 0 ? glm::vec3(sum / static_cast<double>(vertexCount)) : glm::vec3(0.f);
+
+    vertices.resize(vertexCount);
+    indices.resize(cornerCount);
+
+    parallelFor(blockCount, [&](size_t block)
+    {
+        uint32_t id = blockVertices[block];
+        const size_t end = std::min(cornerCount, (block + 1) * blockSize);
+
+        for (size_t c = block * blockSize; c < end; ++c)
+        {
+            if (firstCorners[c] == c)
+            {
+                auto& vertex = vertices[id];
+                vertex = makeVertex(mesh, mesh.corners[c]);
+                vertex.pos -= barycenter;
+                indices[c] = static_cast<int>(id++);
+            }
+        }
+    });
+
+    // first occurrences always come earlier, their ids are all written by now
+    parallelFor(blockCount, [&](size_t block)
+    {
+        const size_t end = std::min(cornerCount, (block + 1) * blockSize);
+
+        for (size_t c = block * blockSize; c < end; ++c)
+        {
+            if (firstCorners[c] != c)
+            {
+                indices[c] = indices[firstCorners[c]];
+            }
+        }
+    });
+}
@@ -0,0 +1,17 @@
+#ifndef VertexWelder_h__
+#define VertexWelder_h__
+
+#include "Geometry.h"
+#include "ObjLoader.h"
+
+#include <vector>
+
+// Builds the vertex for an OBJ face corner: z up model, flipped v, rest position in color.
+Vertex makeVertex(const ObjMesh& mesh, const ObjIndex& index);
+
+// Dedups the corners of mesh on all cores and writes vertices already recentered on their barycenter.
+// Vertices are numbered in order of first occurrence, so the output matches the serial weld
+// and does not depend on the thread count.
+void weldVertices(const ObjMesh& mesh, std::vector<Vertex>& vertices, std::vector<int>& indices, glm::vec3& barycenter);
+
+#endif // VertexWelder_h__
@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <stb_image.h>
+
 #include <iostream>
 #include <stdexcept>
 #include <functional>
@@ -16,8 +18,53 @@
 #include <array>
 #include <chrono>
 #include <unordered_map>
+#include <random>
+#include <limits>
 
 #include "VulkanApplication.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+#include "Parallel.h"
+#include "Profiling.h"
+#include "TextureCompressor.h"
+#include "VertexTable.h"
+#include "VertexWelder.h"
+
+namespace {
+
+struct StagingBlock
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    DeviceAllocation memory;
+    char* data = nullptr;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+};
+
+// a device buffer created at its final size, filled in order through the ring of staging blocks
+struct StreamTarget
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+};
+
+// drawn directly, or copied into the deformed buffers and read as rest data by compute
+const VkAccessFlags vertexBufferAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+const VkPipelineStageFlags vertexBufferStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+inline uint64_t mixKey(uint64_t key)
+{
+    // splitmix64 finalizer
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBull;
+    key ^= key >> 31;
+    return key;
+}
+
+}
 
 void VulkanApplication::initWindow()
 {
@@ -98,6 +145,20 @@ VKAPI_ATTR VkBool32 VKAPI_CALL VulkanApplication::debugCallback(
     return VK_FALSE;
 }
 
+void VulkanApplication::chooseVertexLayout()
+{
+    if (!useCompactVertices)
+    {
+        modelTransform = glm::mat4(1.f);
+        return;
+    }
+
+    // with deformation the buffer is filled from the rest positions, compute overwrites it before the first draw anyway
+    quantization = computeQuantizationLayout(vertexData, vertexCount, useComputeDeformation, useComputeDeformation);
+
+    modelTransform = glm::scale(glm::translate(glm::mat4(1.f), quantization.domain.center), quantization.domain.extent);
+}
+
 void VulkanApplication::createInstance()
 {
     if (enableValidationLayers)
@@ -160,6 +221,21 @@ void VulkanApplication::createInstance()
         std::cout << "ok" << std::endl;
     }
 
+#ifdef VK_KHR_timeline_semaphore
+    // optional, without it the device features cannot be queried and the scheduler uses fences
+    if (useTimelineSemaphores)
+    {
+        for (const auto& e : extensions)
+        {
+            if (strcmp(e.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+            {
+                requiredExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+                physicalDeviceProperties2 = true;
+            }
+        }
+    }
+#endif
+
     createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size());
     createInfo.ppEnabledExtensionNames = requiredExtensions.data();
 
@@ -226,6 +302,33 @@ VulkanApplication::QueueFamilyIndices VulkanApplication::findQueueFamilies(VkPhy
         i++;
     }
 
+    // a compute family without graphics runs the deformation beside the rendering instead of between it
+    for (uint32_t family = 0; family < queueFamilyCount; ++family)
+    {
+        const auto flags = queueFamilies[family].queueFlags;
+        if (queueFamilies[family].queueCount > 0
+            && (flags & VK_QUEUE_COMPUTE_BIT)
+            && !(flags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            indices.computeFamily = static_cast<int>(family);
+            break;
+        }
+    }
+
+    indices.transferFamily = indices.graphicsFamily;
+    for (uint32_t family = 0; family < queueFamilyCount; ++family)
+    {
+        const auto flags = queueFamilies[family].queueFlags;
+        if (queueFamilies[family].queueCount > 0
+            && (flags & VK_QUEUE_TRANSFER_BIT)
+            && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            indices.transferFamily = static_cast<int>(family);
+            indices.transferGranularity = queueFamilies[family].minImageTransferGranularity;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -345,7 +448,7 @@ void VulkanApplication::createLogicalDevice()
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.computeFamily };
+    std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.computeFamily, indices.transferFamily };
 
     float queuePriority = 1.0f;
     for (int queueFamily : uniqueQueueFamilies)
@@ -364,13 +467,61 @@ void VulkanApplication::createLogicalDevice()
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+    auto enabledExtensions = deviceExtensions;
+
+#ifdef VK_KHR_timeline_semaphore
+    // optional, the scheduler falls back to fences and binary semaphores
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+    if (useTimelineSemaphores && physicalDeviceProperties2)
+    {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions)
+        {
+            if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0)
+            {
+                timelineSemaphores = true;
+            }
+        }
+
+        // the extension may be exposed without the feature
+        auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+        if (timelineSemaphores && getFeatures2)
+        {
+            VkPhysicalDeviceFeatures2KHR features = {};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            features.pNext = &timelineFeatures;
+            getFeatures2(physicalDevice, &features);
+
+            timelineSemaphores = timelineFeatures.timelineSemaphore == VK_TRUE;
+        }
+        else
+        {
+            timelineSemaphores = false;
+        }
+    }
+
+    if (timelineSemaphores)
+    {
+        enabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+        createInfo.pNext = &timelineFeatures;
+    }
+#endif
+
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     if (enableValidationLayers)
     {
@@ -390,6 +541,191 @@ void VulkanApplication::createLogicalDevice()
     vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
     vkGetDeviceQueue(device, indices.computeFamily, 0, &computeQueue);
+    vkGetDeviceQueue(device, indices.transferFamily, 0, &transferQueue);
+}
+
+void VulkanApplication::createPipelineCache()
+{
+    if (usePipelineCache)
+    {
+        pipelineCache.init(physicalDevice, device, "pipeline.cache");
+    }
+}
+
+void VulkanApplication::savePipelineCache()
+{
+    try
+    {
+        pipelineCache.save();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "failed to write pipeline cache: " << e.what() << std::endl;
+    }
+}
+
+void VulkanApplication::createAllocator()
+{
+    allocator.init(physicalDevice, device, deviceMemoryBlockSize);
+
+    if (runAllocatorStressTest)
+    {
+        runAllocatorStressPasses();
+    }
+}
+
+void VulkanApplication::printAllocatorStats() const
+{
+    const auto stats = allocator.heapStats();
+
+    uint32_t allocationCount = 0;
+    for (const auto& heap : stats)
+    {
+        allocationCount += heap.allocationCount + heap.dedicatedCount;
+    }
+
+    std::cout << "=> device memory: " << allocationCount << " allocations in "
+              << allocator.deviceMemoryCount() << " VkDeviceMemory" << std::endl;
+
+    for (size_t i = 0; i < stats.size(); ++i)
+    {
+        const auto& heap = stats[i];
+        if (heap.blockCount == 0 && heap.dedicatedCount == 0)
+        {
+            continue;
+        }
+
+        std::cout << "\t - heap " << i << ": " << heap.blockCount << " blocks of "
+                  << heap.blockBytes / (1024.0 * 1024.0) << " MB, " << heap.usedBytes / (1024.0 * 1024.0) << " MB used in "
+                  << heap.allocationCount << " allocations, " << heap.freeRangeCount << " free ranges, "
+                  << heap.fragmentation() * 100.f << "% fragmented, "
+                  << heap.dedicatedCount << " dedicated of " << heap.dedicatedBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+}
+
+void VulkanApplication::runAllocatorStressPasses()
+{
+    const int operationCount = 50000;
+    const size_t maxLive = 4000;
+
+    struct Resource
+    {
+        VkBuffer buffer;
+        VkImage image;
+        DeviceAllocation memory;
+    };
+
+    std::vector<Resource> live;
+    live.reserve(maxLive);
+
+    std::mt19937 random(42);
+
+    double allocateTime = 0.0;
+    double freeTime = 0.0;
+    int allocateCount = 0;
+    int freeCount = 0;
+    size_t peakLive = 0;
+    uint32_t peakMemoryCount = 0;
+
+    auto release = [&](size_t index)
+    {
+        Stopwatch stopwatch;
+        auto& resource = live[index];
+        if (resource.buffer != VK_NULL_HANDLE)
+        {
+            vkDestroyBuffer(device, resource.buffer, nullptr);
+        }
+        else
+        {
+            vkDestroyImage(device, resource.image, nullptr);
+        }
+        allocator.free(resource.memory);
+        freeTime += stopwatch.elapsedMs();
+        ++freeCount;
+
+        live[index] = live.back();
+        live.pop_back();
+    };
+
+    // no two live resources of one VkDeviceMemory may share a byte
+    auto checkOverlaps = [&]()
+    {
+        std::vector<const DeviceAllocation*> sorted;
+        for (const auto& resource : live)
+        {
+            sorted.push_back(&resource.memory);
+        }
+
+        std::sort(sorted.begin(), sorted.end(), [](const DeviceAllocation* a, const DeviceAllocation* b)
+        {
+            return a->memory != b->memory ? a->memory < b->memory : a->offset < b->offset;
+        });
+
+        for (size_t i = 1; i < sorted.size(); ++i)
+        {
+            if (sorted[i]->memory == sorted[i - 1]->memory && sorted[i]->offset < sorted[i - 1]->offset + sorted[i - 1]->size)
+            {
+                throw std::runtime_error("device allocator handed out overlapping ranges");
+            }
+        }
+    };
+
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    static const VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    for (int operation = 0; operation < operationCount; ++operation)
+    {
+        // allocations win slightly until the cap, then frees win, so the heap keeps churning
+        const bool allocate = live.empty() || (live.size() < maxLive && random() % 100 < 55);
+
+        if (!allocate)
+        {
+            release(random() % live.size());
+            continue;
+        }
+
+        Resource resource = {};
+
+        Stopwatch stopwatch;
+        if (random() % 4 != 0)
+        {
+            // 256 B to 4 MB, log uniform
+            const VkDeviceSize size = VkDeviceSize(256) << (random() % 15);
+            createBuffer(size + random() % size, bufferUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resource.buffer, &resource.memory);
+        }
+        else
+        {
+            const uint32_t width = 16u << (random() % 7);
+            const uint32_t height = 16u << (random() % 7);
+            createImage(width, height, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, imageUsage,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resource.image, &resource.memory);
+        }
+        allocateTime += stopwatch.elapsedMs();
+        ++allocateCount;
+
+        live.push_back(resource);
+        peakLive = std::max(peakLive, live.size());
+        peakMemoryCount = std::max(peakMemoryCount, allocator.deviceMemoryCount());
+
+        if (operation % 5000 == 0)
+        {
+            checkOverlaps();
+        }
+    }
+
+    checkOverlaps();
+
+    std::cout << "=> allocator stress test, " << operationCount << " operations, " << peakLive << " live resources at peak" << std::endl;
+    std::cout << "\t - allocate: " << 1000.0 * allocateTime / allocateCount << " us, free: "
+              << 1000.0 * freeTime / freeCount << " us, create and destroy included" << std::endl;
+    std::cout << "\t - " << peakMemoryCount << " VkDeviceMemory at peak instead of " << peakLive << std::endl;
+
+    printAllocatorStats();
+
+    while (!live.empty())
+    {
+        release(live.size() - 1);
+    }
 }
 
 void VulkanApplication::createSurface()
@@ -531,12 +867,12 @@ void VulkanApplication::createRenderPass()
 {
     std::array<VkAttachmentDescription, 3> attachements = {};
 
-    // color
+    // color, only read as an input attachment by the second subpass
     attachements[0] = {};
     attachements[0].format = swapChainImageFormat;
     attachements[0].samples = VK_SAMPLE_COUNT_1_BIT;
     attachements[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachements[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachements[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachements[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachements[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachements[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -608,14 +944,16 @@ void VulkanApplication::createRenderPass()
 
     std::array<VkSubpassDependency, 3> dependencies = {};
 
-    // transition from rendering beginning to subpass 0
+    // transition from rendering beginning to subpass 0, the depth writes of the previous frame in flight
+    // are waited for since every frame shares the depth image
     dependencies[0] = {};
     dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
     dependencies[0].dstSubpass = 0;
-    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                                  | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
     // transition from subpass 0 to subpass 1
     dependencies[1] = {};
@@ -670,7 +1008,7 @@ void VulkanApplication::createGraphicsDescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -727,11 +1065,18 @@ void VulkanApplication::createComputeDescriptorSetLayout()
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 1;
     uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.pImmutableSamplers = nullptr;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { storageBufferLayoutBinding, uboLayoutBinding };
+    VkDescriptorSetLayoutBinding restPositionLayoutBinding = {};
+    restPositionLayoutBinding.binding = 2;
+    restPositionLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    restPositionLayoutBinding.descriptorCount = 1;
+    restPositionLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    restPositionLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = { storageBufferLayoutBinding, uboLayoutBinding, restPositionLayoutBinding };
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -746,7 +1091,7 @@ void VulkanApplication::createComputeDescriptorSetLayout()
 
 void VulkanApplication::createGraphicsPipeline()
 {
-    auto vertShaderCode = readFile("shaders/vk/shader.vert.spv");
+    auto vertShaderCode = readFile(useCompactVertices ? "shaders/vk/shader_compact.vert.spv" : "shaders/vk/shader.vert.spv");
     auto fragShaderCode = readFile("shaders/vk/shader.frag.spv");
 
     VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
@@ -767,7 +1112,19 @@ void VulkanApplication::createGraphicsPipeline()
     VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
     auto bindingDesc = getVertexBindingDescription();
-    auto attributeDesc = getVertexAttributeDescriptions();
+    std::vector<VkVertexInputAttributeDescription> attributeDesc;
+
+    if (useCompactVertices)
+    {
+        bindingDesc = getCompactVertexBindingDescription();
+        const auto compactDesc = getCompactVertexAttributeDescriptions(quantization.texCoordEncoding);
+        attributeDesc.assign(compactDesc.begin(), compactDesc.end());
+    }
+    else
+    {
+        const auto desc = getVertexAttributeDescriptions();
+        attributeDesc.assign(desc.begin(), desc.end());
+    }
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -796,9 +1153,16 @@ void VulkanApplication::createGraphicsPipeline()
     VkPipelineViewportStateCreateInfo viewportState = {};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
+    viewportState.pViewports = dynamicViewport ? nullptr : &viewport;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
+    viewportState.pScissors = dynamicViewport ? nullptr : &scissor;
+
+    const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
 
     VkPipelineRasterizationStateCreateInfo rasterizer = {};
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -864,12 +1228,13 @@ void VulkanApplication::createGraphicsPipeline()
     pipelineInfo.pDepthStencilState = &depthStencil;
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = dynamicViewport ? &dynamicState : nullptr;
     pipelineInfo.layout = graphicsPipelineLayout;
     pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
@@ -930,9 +1295,16 @@ void VulkanApplication::createLuminancePipeline()
     VkPipelineViewportStateCreateInfo viewportState = {};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
+    viewportState.pViewports = dynamicViewport ? nullptr : &viewport;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
+    viewportState.pScissors = dynamicViewport ? nullptr : &scissor;
+
+    const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
 
     VkPipelineRasterizationStateCreateInfo rasterizer = {};
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -998,12 +1370,13 @@ void VulkanApplication::createLuminancePipeline()
     pipelineInfo.pDepthStencilState = &depthStencil;
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = dynamicViewport ? &dynamicState : nullptr;
     pipelineInfo.layout = luminancePipelineLayout;
     pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 1;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &luminancePipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &pipelineInfo, nullptr, &luminancePipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create luminance pipeline!");
     }
@@ -1012,9 +1385,62 @@ void VulkanApplication::createLuminancePipeline()
     vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 
+void VulkanApplication::destroyGraphicsPipelines()
+{
+    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+
+    vkDestroyPipeline(device, luminancePipeline, nullptr);
+
+    vkDestroyPipelineLayout(device, graphicsPipelineLayout, nullptr);
+
+    vkDestroyPipelineLayout(device, luminancePipelineLayout, nullptr);
+}
+
+void VulkanApplication::setDynamicViewport(bool dynamic)
+{
+    if (dynamic == dynamicViewport)
+    {
+        return;
+    }
+
+    vkDeviceWaitIdle(device);
+
+    freeCommandBuffers();
+    destroyGraphicsPipelines();
+
+    dynamicViewport = dynamic;
+
+    createGraphicsPipeline();
+    createLuminancePipeline();
+    createCommandBuffers();
+}
+
+void VulkanApplication::setViewportAndScissor(VkCommandBuffer commandBuffer) const
+{
+    if (!dynamicViewport)
+    {
+        return;
+    }
+
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swapChainExtent.width;
+    viewport.height = (float)swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor = {};
+    scissor.offset = { 0, 0 };
+    scissor.extent = swapChainExtent;
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
 void VulkanApplication::createComputePipeline()
 {
-    auto shaderCode = readFile("shaders/vk/compute.comp.spv");
+    auto shaderCode = readFile(useCompactVertices ? "shaders/vk/compute_compact.comp.spv" : "shaders/vk/compute.comp.spv");
 
     VkShaderModule shaderModule = createShaderModule(shaderCode);
 
@@ -1040,7 +1466,7 @@ void VulkanApplication::createComputePipeline()
     createInfo.stage = shaderStageInfo;
     createInfo.layout = computePipelineLayout;
 
-    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &createInfo, nullptr, &computePipeline) != VK_SUCCESS)
+    if (vkCreateComputePipelines(device, pipelineCache.handle(), 1, &createInfo, nullptr, &computePipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create compute pipeline");
     }
@@ -1104,6 +1530,42 @@ void VulkanApplication::createCommandPools()
     }
 }
 
+void VulkanApplication::createUploadContext()
+{
+    auto queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+    const uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily;
+    upload.init(device, graphicsQueue, graphicsFamily, graphicsQueue, graphicsFamily, &allocator);
+
+    const bool dedicated = useTransferQueue && queueFamilyIndices.transferFamily != queueFamilyIndices.graphicsFamily;
+    transferUpload.init(device,
+                        dedicated ? transferQueue : graphicsQueue,
+                        dedicated ? queueFamilyIndices.transferFamily : graphicsFamily,
+                        graphicsQueue,
+                        graphicsFamily,
+                        &allocator);
+
+    // graphics and compute families copy any texel region
+    transferImageGranularity = dedicated ? queueFamilyIndices.transferGranularity : VkExtent3D{ 1, 1, 1 };
+
+    std::cout << "=> copies run on " << (dedicated ? "the transfer only queue family " : "the graphics queue family ")
+              << (dedicated ? queueFamilyIndices.transferFamily : queueFamilyIndices.graphicsFamily) << std::endl;
+
+    if (&imageUploadContext() != &transferUpload)
+    {
+        std::cout << "=> the transfer queue only copies whole mip levels, textures upload on the graphics queue" << std::endl;
+    }
+}
+
+UploadContext& VulkanApplication::imageUploadContext()
+{
+    const bool wholeLevelsOnly = transferImageGranularity.width == 0
+        && transferImageGranularity.height == 0
+        && transferImageGranularity.depth == 0;
+
+    return wholeLevelsOnly ? upload : transferUpload;
+}
+
 VkFormat VulkanApplication::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
 {
     for (auto format : candidates)
@@ -1145,15 +1607,14 @@ void VulkanApplication::createDepthResources()
                 1,
                 depthFormat,
                 VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                intermediateAttachmentUsage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT),
+                intermediateAttachmentMemory(),
                 &depthImage,
                 &depthImageMemory);
 
     depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
-    transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-
+    // no need to transition either, the render pass starts it from UNDEFINED
 }
 
 void VulkanApplication::createBeautyResources()
@@ -1165,8 +1626,8 @@ void VulkanApplication::createBeautyResources()
                 1,
                 format,
                 VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                intermediateAttachmentUsage(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT),
+                intermediateAttachmentMemory(),
                 &beautyImage,
                 &beautyImageMemory);
 
@@ -1176,6 +1637,100 @@ void VulkanApplication::createBeautyResources()
     // transitionImageLayout(depthImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
 }
 
+VkImageUsageFlags VulkanApplication::intermediateAttachmentUsage(VkImageUsageFlags usage) const
+{
+    return useTransientAttachments ? usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : usage;
+}
+
+VkMemoryPropertyFlags VulkanApplication::intermediateAttachmentMemory() const
+{
+    // createImage falls back to plain device local memory when the image cannot have lazy memory
+    return useTransientAttachments
+        ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+        : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+}
+
+void VulkanApplication::printTransientAttachmentSavings()
+{
+    struct Attachment
+    {
+        const char* name;
+        VkImage image;
+        const DeviceAllocation& memory;
+    };
+
+    const Attachment attachments[] = {
+        { "depth", depthImage, depthImageMemory },
+        { "beauty", beautyImage, beautyImageMemory },
+    };
+
+    std::cout << "\t - " << swapChainExtent.width << "x" << swapChainExtent.height << ":";
+
+    VkDeviceSize totalRequired = 0;
+    VkDeviceSize totalSaved = 0;
+    for (const auto& attachment : attachments)
+    {
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, attachment.image, &memRequirements);
+
+        // createImage picked lazy memory under the same condition, such allocations are dedicated so the
+        // commitment is the image's alone. Other memory is committed whole
+        VkDeviceSize committed = attachment.memory.size;
+        if (useTransientAttachments && allocator.supports(memRequirements.memoryTypeBits, intermediateAttachmentMemory()))
+        {
+            vkGetDeviceMemoryCommitment(device, attachment.memory.memory, &committed);
+        }
+
+        const VkDeviceSize saved = memRequirements.size > committed ? memRequirements.size - committed : 0;
+        totalRequired += memRequirements.size;
+        totalSaved += saved;
+
+        std::cout << " " << attachment.name << " " << memRequirements.size / (1024.0 * 1024.0) << " MB, "
+                  << committed / (1024.0 * 1024.0) << " MB committed;";
+    }
+
+    std::cout << " " << totalSaved / (1024.0 * 1024.0) << " of " << totalRequired / (1024.0 * 1024.0) << " MB saved" << std::endl;
+}
+
+void VulkanApplication::runTransientAttachmentSweep()
+{
+    // the driver commits lazy memory when the attachments are first used, so frames are drawn before measuring
+    const int framesPerSize = 10;
+    const VkExtent2D resolutions[] = { { 1920, 1080 }, { 3840, 2160 } };
+
+    int width = 0;
+    int height = 0;
+    glfwGetWindowSize(window, &width, &height);
+
+    std::cout << "=> transient attachments, " << (useTransientAttachments ? "lazily allocated when the device allows it" : "disabled")
+              << ", measured after " << framesPerSize << " frames" << std::endl;
+
+    for (const auto& extent : resolutions)
+    {
+        // the window system may clamp the size, the swapchain extent printed is the one measured
+        glfwSetWindowSize(window, static_cast<int>(extent.width), static_cast<int>(extent.height));
+        glfwPollEvents();
+        retrieveWindowSize();
+        recreateSwapChain();
+        framebufferResized = false;
+
+        for (int i = 0; i < framesPerSize && !glfwWindowShouldClose(window); ++i)
+        {
+            glfwPollEvents();
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
+        printTransientAttachmentSavings();
+    }
+
+    glfwSetWindowSize(window, width, height);
+    glfwPollEvents();
+    retrieveWindowSize();
+    recreateSwapChain();
+    framebufferResized = false;
+}
+
 void VulkanApplication::createImage(uint32_t width,
                  uint32_t height,
                  uint32_t mipLevels,
@@ -1184,7 +1739,7 @@ void VulkanApplication::createImage(uint32_t width,
                  VkImageUsageFlags usage,
                  VkMemoryPropertyFlags properties,
                  VkImage* image,
-                 VkDeviceMemory* imageMemory)
+                 DeviceAllocation* imageMemory)
 {
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1210,17 +1765,17 @@ void VulkanApplication::createImage(uint32_t width,
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, *image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, imageMemory) != VK_SUCCESS)
+    // lazy memory is a preference, not every device nor every image offers it
+    if ((properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+        && !allocator.supports(memRequirements.memoryTypeBits, properties))
     {
-        throw std::runtime_error("failed to allocate image memory");
+        properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
     }
 
-    vkBindImageMemory(device, *image, *imageMemory, 0);
+    const ResourceKind kind = tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+    *imageMemory = allocator.allocate(memRequirements, properties, kind);
+
+    vkBindImageMemory(device, *image, imageMemory->memory, imageMemory->offset);
 }
 
 void VulkanApplication::transitionImageLayout(VkImage image,
@@ -1229,7 +1784,7 @@ void VulkanApplication::transitionImageLayout(VkImage image,
                            VkImageLayout newLayout,
                            uint32_t mipLevels)
 {
-    auto cmdBuff = beginSingleTimeCommands();
+    auto cmdBuff = beginUploadCommands(upload);
 
     VkImageMemoryBarrier barrier = {};
     VkPipelineStageFlags sourceStage, destinationStage;
@@ -1292,9 +1847,6 @@ void VulkanApplication::transitionImageLayout(VkImage image,
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = 0;
-
     vkCmdPipelineBarrier(cmdBuff,
                          sourceStage, destinationStage,
                          0,
@@ -1302,33 +1854,119 @@ void VulkanApplication::transitionImageLayout(VkImage image,
                          0, nullptr,
                          1, &barrier);
 
-    endSingleTimeCommands(cmdBuff);
+    endUploadCommands(upload);
 }
 
-void VulkanApplication::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+uint32_t VulkanApplication::copyLevelsToImage(UploadContext& context, VkImage image, VkFormat format, const std::vector<TextureLevel>& levels)
 {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    // block compressed rows are copied 4 texel rows at a time
+    const bool compressed = format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC7_UNORM_BLOCK;
+    const uint32_t blockHeight = compressed ? 4 : 1;
+
+    // bands start on a multiple of the queue granularity, in rows of texels or blocks, and span a multiple
+    // of it unless they end the level. The graphics queue has a granularity of 1
+    const uint32_t granularity = &context == &transferUpload ? std::max(transferImageGranularity.height, 1u) : 1;
+
+    VkDeviceSize totalSize = 0;
+    for (const auto& level : levels)
+    {
+        totalSize += level.size;
+    }
+
+    const VkDeviceSize stagingSize = std::min(totalSize, textureStagingBudget);
+
+    VkBuffer stagingBuffer;
+    DeviceAllocation stagingBufferMemory;
 
-    VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
+    static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    createBuffer(stagingSize, stagingBufferUsage, stagingBufferProps, &stagingBuffer, &stagingBufferMemory);
+
+    char* data = stagingBufferMemory.mapped;
 
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
+    // levels are packed one after the other, split in bands of rows when the staging buffer is full.
+    // Rows are whole texels or blocks, which keeps each offset aligned as the copy requires
+    std::vector<VkBufferImageCopy> regions;
+    VkDeviceSize used = 0;
+    uint32_t batchCount = 0;
+
+    auto flush = [&](bool reuse)
+    {
+        VkCommandBuffer commandBuffer = beginUploadCommands(context);
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<uint32_t>(regions.size()), regions.data());
+        endUploadCommands(context);
+
+        // the staging buffer is filled again only once the GPU has read it
+        if (reuse)
+        {
+            context.finish();
+        }
 
-    region.imageOffset = { 0,0,0 };
-    region.imageExtent = {
-        width,
-        height,
-        1
+        regions.clear();
+        used = 0;
+        ++batchCount;
     };
 
-    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    for (uint32_t i = 0; i < levels.size(); ++i)
+    {
+        const auto& level = levels[i];
+        const uint32_t rowCount = (level.height + blockHeight - 1) / blockHeight;
+        const VkDeviceSize rowSize = level.size / rowCount;
+
+        uint32_t row = 0;
+        while (row < rowCount)
+        {
+            auto rows = static_cast<uint32_t>(std::min<VkDeviceSize>(rowCount - row, (stagingSize - used) / rowSize));
+            if (row + rows < rowCount)
+            {
+                rows -= rows % granularity;
+            }
+
+            if (rows == 0)
+            {
+                if (used == 0)
+                {
+                    throw std::runtime_error("texture staging budget is smaller than one band of rows");
+                }
+                flush(true);
+                continue;
+            }
+
+            memcpy(data + used, static_cast<const char*>(level.data) + row * rowSize, static_cast<size_t>(rows * rowSize));
+
+            VkBufferImageCopy region = {};
+            region.bufferOffset = used;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+
+            region.imageOffset = { 0, static_cast<int32_t>(row * blockHeight), 0 };
+            region.imageExtent = {
+                level.width,
+                std::min(rows * blockHeight, level.height - row * blockHeight),
+                1
+            };
+
+            regions.push_back(region);
+            used += rows * rowSize;
+            row += rows;
+        }
+    }
+
+    if (!regions.empty())
+    {
+        flush(false);
+    }
+
+    context.release(stagingBuffer, stagingBufferMemory);
 
-    endSingleTimeCommands(commandBuffer);
+    return batchCount;
 }
 
 void VulkanApplication::generateMipmaps(VkImage image, VkFormat format, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels)
@@ -1342,7 +1980,7 @@ void VulkanApplication::generateMipmaps(VkImage image, VkFormat format, uint32_t
         throw std::runtime_error("texture image format does not support linear blitting");
     }
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    VkCommandBuffer commandBuffer = beginUploadCommands(upload);
 
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1434,29 +2072,171 @@ void VulkanApplication::generateMipmaps(VkImage image, VkFormat format, uint32_t
                          0, nullptr,
                          1, &barrier);
 
-    endSingleTimeCommands(commandBuffer);
+    endUploadCommands(upload);
 }
 
-void VulkanApplication::createTextureImage()
+void VulkanApplication::uploadImageLevels(VkImage image, VkFormat format, const std::vector<TextureLevel>& levels)
 {
-    mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max((float)texWidth, (float)texHeight)))) + 1;
+    const auto levelCount = static_cast<uint32_t>(levels.size());
+    auto& context = imageUploadContext();
 
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    context.prepareImage(image, levelCount);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    copyLevelsToImage(context, image, format, levels);
 
-    static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    context.handOverImage(image, levelCount, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    endUploadCommands(context);
+}
+
+std::vector<TextureLevel> VulkanApplication::mipChainLevels(const MipChain& mips) const
+{
+    std::vector<TextureLevel> levels;
+    levels.push_back({ static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), texture, 4 * size_t(texWidth) * texHeight });
+
+    for (const auto& level : mips.levels)
+    {
+        levels.push_back({ level.width, level.height, mips.data.data() + level.offset, 4 * size_t(level.width) * level.height });
+    }
+
+    return levels;
+}
+
+void VulkanApplication::uploadTextureImage(VkImage image, const MipChain* mips)
+{
+    if (mips)
+    {
+        uploadImageLevels(image, VK_FORMAT_R8G8B8A8_UNORM, mipChainLevels(*mips));
+        return;
+    }
+
+    const std::vector<TextureLevel> baseLevel = {
+        { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), texture, 4 * size_t(texWidth) * texHeight },
+    };
+
+    transitionImageLayout(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+
+    // blits need the graphics queue, the whole chain stays there
+    copyLevelsToImage(upload, image, VK_FORMAT_R8G8B8A8_UNORM, baseLevel);
+
+    generateMipmaps(image, VK_FORMAT_R8G8B8A8_UNORM, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mipLevels);
+    //transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
+}
+
+VkFormat VulkanApplication::selectTextureFormat() const
+{
+    // stbi reports the channels of the file, rgba is forced at load so alpha is 255 without one
+    const bool opaque = texChannels < 4;
+
+    std::vector<VkFormat> candidates;
+    if (textureCompression == TextureCompression::BC7)
+    {
+        candidates.push_back(VK_FORMAT_BC7_UNORM_BLOCK);
+    }
+    if (textureCompression != TextureCompression::None && opaque)
+    {
+        candidates.push_back(VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+    }
+    if (textureCompression == TextureCompression::BC1)
+    {
+        candidates.push_back(VK_FORMAT_BC7_UNORM_BLOCK);
+    }
+    candidates.push_back(VK_FORMAT_R8G8B8A8_UNORM);
+
+    static const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+        | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+    for (auto format : candidates)
+    {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+        if ((formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures)
+        {
+            return format;
+        }
+    }
+
+    throw std::runtime_error("no texture format can be sampled with linear filtering");
+}
+
+std::vector<TextureLevel> VulkanApplication::compressTexture(std::vector<uint8_t>& blocks)
+{
+    Stopwatch stopwatch;
+
+    const BlockFormat format = textureFormat == VK_FORMAT_BC1_RGB_UNORM_BLOCK ? BlockFormat::BC1 : BlockFormat::BC7;
+
+    if (textureMips.levels.empty())
+    {
+        generateMipChain(static_cast<const uint8_t*>(texture), texWidth, texHeight, mipFilter, textureMips);
+    }
+
+    const auto sources = mipChainLevels(textureMips);
+
+    size_t size = 0;
+    for (const auto& source : sources)
+    {
+        size += compressedSize(format, source.width, source.height);
+    }
+
+    blocks.resize(size);
+
+    std::vector<TextureLevel> levels;
+    size_t offset = 0;
+
+    for (const auto& source : sources)
+    {
+        const size_t levelSize = compressedSize(format, source.width, source.height);
+        compressImage(static_cast<const uint8_t*>(source.data), source.width, source.height, format, blocks.data() + offset);
+
+        levels.push_back({ source.width, source.height, blocks.data() + offset, levelSize });
+        offset += levelSize;
+    }
 
-    createBuffer(imageSize, stagingBufferUsage, stagingBufferProps, &stagingBuffer, &stagingBufferMemory);
+    std::cout << "=> texture encoded to " << (format == BlockFormat::BC1 ? "BC1" : "BC7") << " ("
+              << workerCount() << " threads) in " << stopwatch.elapsedMs() << " ms" << std::endl;
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, texture, static_cast<size_t>(imageSize));
-    vkUnmapMemory(device, stagingBufferMemory);
+    return levels;
+}
+
+void VulkanApplication::writeTextureContainer(const std::vector<TextureLevel>& levels)
+{
+    MeshCacheKey containerKey;
+    if (!useTextureContainer || !MeshCache::computeKey(texturePath, static_cast<uint32_t>(mipFilter), containerKey))
+    {
+        return;
+    }
+
+    try
+    {
+        TextureContainer::write(TextureContainer::containerPath(texturePath), containerKey, textureFormat, texChannels, levels);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "failed to write texture container: " << e.what() << std::endl;
+    }
+}
+
+void VulkanApplication::createTextureImage()
+{
+    textureFormat = selectTextureFormat();
+
+    if (textureContainer.isOpen() && textureContainer.format() != static_cast<uint32_t>(textureFormat))
+    {
+        // written for a device with other formats, start from the source again
+        std::cout << "=> texture container holds another format than " << textureFormat << ", decoding" << std::endl;
+
+        textureContainer.close();
+        decodeTexture();
+    }
+
+    mipLevels = textureContainer.isOpen() ? textureContainer.levelCount() : mipLevelCount(texWidth, texHeight);
 
-    static const VkBufferUsageFlags textureImageUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+    const bool compressed = textureFormat != VK_FORMAT_R8G8B8A8_UNORM;
+    const bool blitted = !textureContainer.isOpen() && !compressed && !useCpuMipmaps;
+
+    // only the blit path reads from the image
+    const VkImageUsageFlags textureImageUsage = (blitted ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0)
         | VK_IMAGE_USAGE_TRANSFER_DST_BIT
         | VK_IMAGE_USAGE_SAMPLED_BIT;
     static const VkMemoryPropertyFlags textureImageProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -1464,24 +2244,226 @@ void VulkanApplication::createTextureImage()
     createImage(texWidth,
                 texHeight,
                 mipLevels,
-                VK_FORMAT_R8G8B8A8_UNORM,
+                textureFormat,
                 VK_IMAGE_TILING_OPTIMAL,
                 textureImageUsage,
                 textureImageProps,
                 &textureImage,
                 &textureImageMemory);
 
-    transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+    Stopwatch stopwatch;
 
-    copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+    std::vector<TextureLevel> levels;
+    std::vector<uint8_t> blocks;
 
+    if (textureContainer.isOpen())
+    {
+        for (uint32_t i = 0; i < mipLevels; ++i)
+        {
+            levels.push_back(textureContainer.level(i));
+        }
+    }
+    else if (compressed)
+    {
+        levels = compressTexture(blocks);
+    }
+    else if (useCpuMipmaps)
+    {
+        levels = mipChainLevels(textureMips);
+    }
 
-    generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_UNORM, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mipLevels);
-    //transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
-    //transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+    if (blitted)
+    {
+        uploadTextureImage(textureImage, nullptr);
+    }
+    else
+    {
+        uploadImageLevels(textureImage, textureFormat, levels);
+    }
+
+    const char* source = textureContainer.isOpen() ? "its mapped container"
+                       : compressed ? "its compressed mip chain"
+                       : useCpuMipmaps ? "its CPU mip chain" : "blitted mips";
+
+    std::cout << "=> texture staged from " << source << " in " << stopwatch.elapsedMs() << " ms" << std::endl;
+
+    if (!blitted && !textureContainer.isOpen())
+    {
+        writeTextureContainer(levels);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, textureImage, &memRequirements);
+
+    // what the same chain takes uncompressed, for comparison
+    VkDeviceSize rgbaSize = 0;
+    for (uint32_t width = texWidth, height = texHeight, level = 0; level < mipLevels; ++level)
+    {
+        rgbaSize += 4 * VkDeviceSize(width) * height;
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+
+    std::cout << "\t - " << memRequirements.size / (1024.0 * 1024.0) << " MB of device memory, "
+              << rgbaSize / (1024.0 * 1024.0) << " MB as RGBA8" << std::endl;
+
+    if (runMipBenchmark || runTextureBenchmark)
+    {
+        // both need the decoded source
+        if (!texture)
+        {
+            decodeTexture();
+        }
+
+        if (runMipBenchmark)
+        {
+            runMipBenchmarkPasses();
+        }
+
+        if (runTextureBenchmark)
+        {
+            runTextureBenchmarkPasses();
+        }
+    }
+
+    // the image is complete on the GPU, no copy of its pixels stays on the host
+    releaseTexture();
+
+    std::cout << "\t - host memory once released: " << residentBytes() / (1024.0 * 1024.0) << " MB resident, "
+              << peakResidentBytes() / (1024.0 * 1024.0) << " MB peak" << std::endl;
+}
+
+void VulkanApplication::runMipBenchmarkPasses()
+{
+    const int runCount = 5;
+
+    static const VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+        | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    std::cout << "=> mip chain benchmark, " << texWidth << "x" << texHeight << ", " << mipLevels << " levels, "
+              << runCount << " runs" << std::endl;
+
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        double generationTime = 0.0;
+        double totalTime = 0.0;
+
+        for (int run = 0; run < runCount; ++run)
+        {
+            VkImage image;
+            DeviceAllocation imageMemory;
+            createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+                        imageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image, &imageMemory);
+
+            Stopwatch stopwatch;
+
+            MipChain mips;
+            if (pass > 0)
+            {
+                generateMipChain(static_cast<const uint8_t*>(texture), texWidth, texHeight,
+                                 pass == 1 ? MipFilter::Box : MipFilter::Kaiser, mips);
+                generationTime += stopwatch.elapsedMs();
+            }
+
+            uploadTextureImage(image, pass > 0 ? &mips : nullptr);
+            upload.finish();
+            transferUpload.finish();
+            totalTime += stopwatch.elapsedMs();
+
+            vkDestroyImage(device, image, nullptr);
+            allocator.free(imageMemory);
+        }
+
+        static const char* passNames[] = { "GPU blit", "CPU box", "CPU kaiser" };
+
+        std::cout << "\t - " << passNames[pass] << ": " << totalTime / runCount << " ms";
+        if (pass > 0)
+        {
+            std::cout << " (" << generationTime / runCount << " ms generating)";
+        }
+        std::cout << std::endl;
+    }
+}
+
+void VulkanApplication::runTextureBenchmarkPasses()
+{
+    const int runCount = 5;
+
+    const auto containerPath = TextureContainer::containerPath(texturePath);
+
+    MeshCacheKey containerKey;
+    const bool hasContainer = MeshCache::computeKey(texturePath, static_cast<uint32_t>(mipFilter), containerKey)
+        && TextureContainer().open(containerPath, containerKey);
+
+    std::cout << "=> texture startup benchmark, " << texWidth << "x" << texHeight << ", " << runCount << " runs" << std::endl;
+
+    for (int pass = 0; pass < (hasContainer ? 2 : 1); ++pass)
+    {
+        double hostTime = 0.0;
+        double totalTime = 0.0;
+
+        for (int run = 0; run < runCount; ++run)
+        {
+            Stopwatch stopwatch;
+
+            VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+            std::vector<TextureLevel> levels;
+
+            stbi_uc* pixels = nullptr;
+            MipChain mips;
+            TextureContainer container;
+
+            if (pass == 0)
+            {
+                // what every start did before: decode the JPEG, build the chain, upload RGBA8
+                int width, height, channels;
+                pixels = stbi_load(texturePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+                if (!pixels)
+                {
+                    throw std::runtime_error("failed to load texture image");
+                }
+
+                generateMipChain(pixels, width, height, mipFilter, mips);
+
+                levels.push_back({ static_cast<uint32_t>(width), static_cast<uint32_t>(height), pixels, 4 * size_t(width) * height });
+                for (const auto& level : mips.levels)
+                {
+                    levels.push_back({ level.width, level.height, mips.data.data() + level.offset, 4 * size_t(level.width) * level.height });
+                }
+            }
+            else
+            {
+                MeshCacheKey key;
+                MeshCache::computeKey(texturePath, static_cast<uint32_t>(mipFilter), key);
+                container.open(containerPath, key);
+
+                format = static_cast<VkFormat>(container.format());
+                for (uint32_t i = 0; i < container.levelCount(); ++i)
+                {
+                    levels.push_back(container.level(i));
+                }
+            }
+
+            hostTime += stopwatch.elapsedMs();
+
+            VkImage image;
+            DeviceAllocation imageMemory;
+            createImage(levels[0].width, levels[0].height, static_cast<uint32_t>(levels.size()), format, VK_IMAGE_TILING_OPTIMAL,
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image, &imageMemory);
+
+            uploadImageLevels(image, format, levels);
+            imageUploadContext().finish();
+            totalTime += stopwatch.elapsedMs();
+
+            vkDestroyImage(device, image, nullptr);
+            allocator.free(imageMemory);
+            stbi_image_free(pixels);
+        }
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+        std::cout << "\t - " << (pass == 0 ? "JPEG decode" : "mapped container") << ": " << totalTime / runCount << " ms ("
+                  << hostTime / runCount << " ms before the upload)" << std::endl;
+    }
 }
 
 VkImageView VulkanApplication::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -1508,7 +2490,7 @@ VkImageView VulkanApplication::createImageView(VkImage image, VkFormat format, V
 
 void VulkanApplication::createTextureImageView()
 {
-    textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    textureImageView = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
 }
 
 void VulkanApplication::createTextureSampler()
@@ -1538,29 +2520,20 @@ void VulkanApplication::createTextureSampler()
     }
 }
 
-uint32_t VulkanApplication::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
-    {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("failed to find suitable memory type");
-}
-
-void VulkanApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory)
+void VulkanApplication::createBuffer(VkDeviceSize size,
+                                     VkBufferUsageFlags usage,
+                                     VkMemoryPropertyFlags properties,
+                                     VkBuffer* buffer,
+                                     DeviceAllocation* bufferMemory,
+                                     const std::vector<uint32_t>& sharingFamilies)
 {
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
     bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    bufferInfo.sharingMode = sharingFamilies.empty() ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharingFamilies.size());
+    bufferInfo.pQueueFamilyIndices = sharingFamilies.data();
 
     if (vkCreateBuffer(device, &bufferInfo, nullptr, buffer) != VK_SUCCESS)
     {
@@ -1570,57 +2543,28 @@ void VulkanApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, bufferMemory) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to allocate vertex buffer memory");
-    }
+    *bufferMemory = allocator.allocate(memRequirements, properties, ResourceKind::Linear);
 
-    vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+    vkBindBufferMemory(device, *buffer, bufferMemory->memory, bufferMemory->offset);
 }
 
-VkCommandBuffer VulkanApplication::beginSingleTimeCommands()
+VkCommandBuffer VulkanApplication::beginUploadCommands(UploadContext& context)
 {
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = graphicsCommandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    return commandBuffer;
+    return context.commandBuffer();
 }
 
-void VulkanApplication::endSingleTimeCommands(VkCommandBuffer commandBuffer)
+void VulkanApplication::endUploadCommands(UploadContext& context)
 {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
-
-    vkFreeCommandBuffers(device, graphicsCommandPool, 1, &commandBuffer);
+    // one submit and one wait per upload, as it was done before batching
+    if (!useBatchedUploads)
+    {
+        context.finish();
+    }
 }
 
-void VulkanApplication::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+void VulkanApplication::copyBuffer(UploadContext& context, VkBuffer src, VkBuffer dst, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage)
 {
-    auto commandBuffer = beginSingleTimeCommands();
+    auto commandBuffer = beginUploadCommands(context);
 
     VkBufferCopy copyRegion = {};
     copyRegion.srcOffset = 0;
@@ -1629,15 +2573,44 @@ void VulkanApplication::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size
 
     vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
 
-    endSingleTimeCommands(commandBuffer);
+    context.handOverBuffer(dst, dstAccess, dstStage);
+
+    endUploadCommands(context);
+}
+
+std::vector<uint32_t> VulkanApplication::computeSharingFamilies()
+{
+    const auto indices = findQueueFamilies(physicalDevice);
+    if (indices.computeFamily == indices.graphicsFamily)
+    {
+        return std::vector<uint32_t>();
+    }
+
+    return { static_cast<uint32_t>(indices.graphicsFamily), static_cast<uint32_t>(indices.computeFamily) };
+}
+
+UploadContext& VulkanApplication::uploadContextFor(const std::vector<uint32_t>& sharingFamilies)
+{
+    return sharingFamilies.empty() ? transferUpload : upload;
+}
+
+VkDeviceSize VulkanApplication::vertexStride() const
+{
+    return useCompactVertices ? sizeof(PackedVertex) : sizeof(Vertex);
 }
 
 void VulkanApplication::createVertexBuffer()
 {
-    const auto bufferSize = sizeof(vertices[0]) * vertices.size();
+    if (useCompactVertices)
+    {
+        createCompactVertexBuffers();
+        return;
+    }
+
+    const auto bufferSize = sizeof(Vertex) * vertexCount;
 
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    DeviceAllocation stagingBufferMemory;
 
     static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
     static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
@@ -1648,69 +2621,170 @@ void VulkanApplication::createVertexBuffer()
                  &stagingBuffer,
                  &stagingBufferMemory);
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    void* data = stagingBufferMemory.mapped;
+    memcpy(data, vertexData, bufferSize);
 
-    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT 
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                                                | VK_BUFFER_USAGE_TRANSFER_DST_BIT 
                                                 | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
                                                 | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
     static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-    createBuffer(bufferSize, bufferUsage, bufferProps, &vertexBuffer, &vertexBufferMemory);
+    // compute reads it as rest data
+    const auto sharingFamilies = computeSharingFamilies();
+    auto& context = uploadContextFor(sharingFamilies);
+
+    createBuffer(bufferSize, bufferUsage, bufferProps, &vertexBuffer, &vertexBufferMemory, sharingFamilies);
 
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+    copyBuffer(context, stagingBuffer, vertexBuffer, bufferSize, vertexBufferAccess, vertexBufferStages);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    context.release(stagingBuffer, stagingBufferMemory);
+
+    std::cout << "=> vertex buffer: " << sizeof(Vertex) << " B/vertex, " << bufferSize / (1024.0 * 1024.0) << " MB" << std::endl;
 }
 
-void VulkanApplication::createQuadBuffer()
+void VulkanApplication::createCompactVertexBuffers()
 {
-    static const std::array<glm::vec3, 3> quadVertices = {
-        glm::vec3(-1.0f, -1.0f, 0.0f),
-        glm::vec3(3.0f, -1.0f, 0.0f),
-        glm::vec3(-1.0f, 3.0f, 0.0f)
-    };
+    const bool withRestPositions = useComputeDeformation;
 
-    const auto bufferSize = sizeof(quadVertices[0]) * quadVertices.size();
+    const VkDeviceSize vertexBufferSize = sizeof(PackedVertex) * vertexCount;
+    const VkDeviceSize restBufferSize = withRestPositions ? sizeof(PackedPosition) * vertexCount : 0;
 
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    DeviceAllocation stagingBufferMemory;
 
     static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
     static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    createBuffer(bufferSize,
+    // one staging buffer for both, quantized straight into mapped memory
+    createBuffer(vertexBufferSize + restBufferSize,
                  stagingBufferUsage,
                  stagingBufferProps,
                  &stagingBuffer,
                  &stagingBufferMemory);
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, quadVertices.data(), bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    void* data = stagingBufferMemory.mapped;
 
-    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    quantizeVertices(vertexData, vertexCount, quantization, withRestPositions, static_cast<PackedVertex*>(data));
 
-    createBuffer(bufferSize, bufferUsage, bufferProps, &quadBuffer, &quadBufferMemory);
+    if (withRestPositions)
+    {
+        auto restData = reinterpret_cast<PackedPosition*>(static_cast<char*>(data) + vertexBufferSize);
+        quantizeRestPositions(vertexData, vertexCount, quantization.domain, restData);
+    }
 
-    copyBuffer(stagingBuffer, quadBuffer, bufferSize);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                                                | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                                | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                                                | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
-void VulkanApplication::createIndexBuffer()
+    static const VkBufferUsageFlags restBufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                                    | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    // only the rest positions are read by compute, both go through the same context to share the staging
+    const auto restSharingFamilies = withRestPositions ? computeSharingFamilies() : std::vector<uint32_t>();
+    auto& context = uploadContextFor(restSharingFamilies);
+
+    createBuffer(vertexBufferSize, bufferUsage, bufferProps, &vertexBuffer, &vertexBufferMemory);
+
+    auto commandBuffer = beginUploadCommands(context);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = vertexBufferSize;
+
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, 1, &copyRegion);
+
+    if (withRestPositions)
+    {
+        createBuffer(restBufferSize, restBufferUsage, bufferProps, &restPositionBuffer, &restPositionBufferMemory, restSharingFamilies);
+
+        copyRegion.srcOffset = vertexBufferSize;
+        copyRegion.size = restBufferSize;
+
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, restPositionBuffer, 1, &copyRegion);
+
+        context.handOverBuffer(restPositionBuffer, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    context.handOverBuffer(vertexBuffer, vertexBufferAccess, vertexBufferStages);
+
+    endUploadCommands(context);
+
+    context.release(stagingBuffer, stagingBufferMemory);
+
+    std::cout << "=> vertex buffer: compact, " << sizeof(PackedVertex) << " B/vertex"
+              << (withRestPositions ? " + " + std::to_string(sizeof(PackedPosition)) + " B rest position" : std::string())
+              << ", uv as " << (quantization.texCoordEncoding == TexCoordEncoding::Unorm16 ? "unorm16" : "half")
+              << ", " << (vertexBufferSize + restBufferSize) / (1024.0 * 1024.0) << " MB instead of "
+              << sizeof(Vertex) * vertexCount / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+void VulkanApplication::setCompactVertices(bool compact)
+{
+    if (compact == useCompactVertices)
+    {
+        return;
+    }
+
+    if (useStreamingLoader)
+    {
+        throw std::runtime_error("the streaming loader only writes the full vertex layout");
+    }
+
+    vkDeviceWaitIdle(device);
+
+    freeCommandBuffers();
+    destroyFrameResources();
+    destroyGraphicsPipelines();
+
+    vkDestroyPipeline(device, computePipeline, nullptr);
+    vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+
+    vkDestroyBuffer(device, vertexBuffer, nullptr);
+    allocator.free(vertexBufferMemory);
+
+    if (restPositionBuffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(device, restPositionBuffer, nullptr);
+        allocator.free(restPositionBufferMemory);
+        restPositionBuffer = VK_NULL_HANDLE;
+    }
+
+    useCompactVertices = compact;
+
+    chooseVertexLayout();
+    createGraphicsPipeline();
+    createLuminancePipeline();
+    createComputePipeline();
+    createVertexBuffer();
+
+    // the deformed copies read the new vertex buffer on the graphics queue
+    transferUpload.finish();
+
+    createFrameResources();
+    createCommandBuffers();
+
+    upload.finish();
+}
+
+void VulkanApplication::createQuadBuffer()
 {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    static const std::array<glm::vec3, 3> quadVertices = {
+        glm::vec3(-1.0f, -1.0f, 0.0f),
+        glm::vec3(3.0f, -1.0f, 0.0f),
+        glm::vec3(-1.0f, 3.0f, 0.0f)
+    };
+
+    const auto bufferSize = sizeof(quadVertices[0]) * quadVertices.size();
 
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    DeviceAllocation stagingBufferMemory;
 
     static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
     static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
@@ -1721,700 +2795,2020 @@ void VulkanApplication::createIndexBuffer()
                  &stagingBuffer,
                  &stagingBufferMemory);
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    void* data = stagingBufferMemory.mapped;
+    memcpy(data, quadVertices.data(), bufferSize);
 
-    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
     static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-    createBuffer(bufferSize, bufferUsage, bufferProps, &indexBuffer, &indexBufferMemory);
+    createBuffer(bufferSize, bufferUsage, bufferProps, &quadBuffer, &quadBufferMemory);
 
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    copyBuffer(transferUpload, stagingBuffer, quadBuffer, bufferSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    transferUpload.release(stagingBuffer, stagingBufferMemory);
 }
 
-
-void VulkanApplication::createUniformBuffers()
+void VulkanApplication::createIndexBuffer()
 {
-    const auto imageCount = swapChainImages.size();
+    indexType = VK_INDEX_TYPE_UINT32;
+    indexChunks.clear();
+    lodFirstChunks.clear();
 
+    if (useIndexChunks)
     {
-        // graphics ubos
-        VkDeviceSize bufferSize = sizeof(Matrices);
+        // every LOD level is split on its own so no chunk mixes levels
+        bool splittable = true;
 
-        graphicsUniformBuffers.resize(imageCount);
-        graphicsUniformBufferMemories.resize(imageCount);
+        for (const auto& level : lodLevels)
+        {
+            auto chunks = splitIndexChunks(indexData + level.firstIndex, level.indexCount);
+            splittable = splittable && !chunks.empty();
 
-        static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            lodFirstChunks.push_back(static_cast<uint32_t>(indexChunks.size()));
+            for (auto& chunk : chunks)
+            {
+                chunk.firstIndex += level.firstIndex;
+                indexChunks.push_back(chunk);
+            }
+        }
 
-        for (size_t i = 0; i < imageCount; ++i)
+        if (splittable && indexChunks.size() <= std::max<size_t>(lodLevels.size(), indexCount / minIndicesPerChunk))
+        {
+            indexType = VK_INDEX_TYPE_UINT16;
+        }
+        else
         {
-            createBuffer(bufferSize, bufferUsage, bufferProps, &graphicsUniformBuffers[i], &graphicsUniformBufferMemories[i]);
+            indexChunks.clear();
+            lodFirstChunks.clear();
         }
     }
-    
-    {
-        // compute ubos
-        VkDeviceSize bufferSize = sizeof(ComputeData);
-
-        computeUniformBuffers.resize(imageCount);
-        computeUniformBufferMemories.resize(imageCount);
 
-        static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-        for (size_t i = 0; i < imageCount; ++i)
+    if (indexChunks.empty())
+    {
+        for (const auto& level : lodLevels)
         {
-            createBuffer(bufferSize, bufferUsage, bufferProps, &computeUniformBuffers[i], &computeUniformBufferMemories[i]);
+            lodFirstChunks.push_back(static_cast<uint32_t>(indexChunks.size()));
+            indexChunks.push_back({ level.firstIndex, level.indexCount, 0 });
         }
     }
-}
-
 
-void VulkanApplication::createDescriptorPool()
-{
-    std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+    lodFirstChunks.push_back(static_cast<uint32_t>(indexChunks.size()));
 
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = 2 * swapChainImages.size(); // 2 for compute, 2 for graphics
+    maxLodDraws = 0;
+    for (size_t l = 0; l < lodLevels.size(); ++l)
+    {
+        maxLodDraws = std::max(maxLodDraws, lodFirstChunks[l + 1] - lodFirstChunks[l]);
+    }
 
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size()); // 2 for luminance
+    const VkDeviceSize indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(int);
+    VkDeviceSize bufferSize = indexSize * indexCount;
 
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-    poolSizes[2].descriptorCount = static_cast<uint32_t>(swapChainImages.size()); // 2 for luminance
+    VkBuffer stagingBuffer;
+    DeviceAllocation stagingBufferMemory;
 
-    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[3].descriptorCount = 1; // 1 for compute
+    static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    VkDescriptorPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = 3 * static_cast<uint32_t>(swapChainImages.size()); // 2 for compute, 2 for graphics, 2 for luminance 
+    createBuffer(bufferSize,
+                 stagingBufferUsage,
+                 stagingBufferProps,
+                 &stagingBuffer,
+                 &stagingBufferMemory);
 
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    void* data = stagingBufferMemory.mapped;
+    if (indexType == VK_INDEX_TYPE_UINT16)
     {
-        throw std::runtime_error("failed to create descriptor pool");
+        packIndexChunks(indexData, indexChunks, static_cast<uint16_t*>(data));
     }
-}
-
-void VulkanApplication::updateGraphicsDescriptorSets()
-{
-    for (size_t i = 0; i < swapChainImages.size(); ++i)
+    else
     {
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+        memcpy(data, indexData, (size_t)bufferSize);
+    }
 
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = graphicsUniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(Matrices);
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = graphicsDescriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-        descriptorWrites[0].pImageInfo = nullptr;
-        descriptorWrites[0].pTexelBufferView = nullptr;
+    createBuffer(bufferSize, bufferUsage, bufferProps, &indexBuffer, &indexBufferMemory);
 
-        VkDescriptorImageInfo imageInfo = {};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = textureImageView;
-        imageInfo.sampler = textureImageSampler;
+    copyBuffer(transferUpload, stagingBuffer, indexBuffer, bufferSize, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = graphicsDescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = nullptr;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-        descriptorWrites[1].pTexelBufferView = nullptr;
+    transferUpload.release(stagingBuffer, stagingBufferMemory);
 
-        vkUpdateDescriptorSets(device,
-                               static_cast<uint32_t>(descriptorWrites.size()),
-                               descriptorWrites.data(),
-                               0,
-                               nullptr);
-    }
+    std::cout << "=> index buffer: " << (indexType == VK_INDEX_TYPE_UINT16 ? "16-bit, " : "32-bit, ")
+              << lodFirstChunks[1] << " draw(s) for the full mesh, " << lodLevels.size() << " LOD level(s), "
+              << bufferSize / (1024.0 * 1024.0) << " MB"
+              << " (32-bit: 1 draw, " << sizeof(int) * indexCount / (1024.0 * 1024.0) << " MB)" << std::endl;
 }
 
-void VulkanApplication::createGraphicsDescriptorSets()
+void VulkanApplication::createMeshletBuffer()
 {
-    std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), graphicsDescriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-    allocInfo.pSetLayouts = layouts.data();
-
-    graphicsDescriptorSets.resize(swapChainImages.size());
-    if (vkAllocateDescriptorSets(device, &allocInfo, graphicsDescriptorSets.data()) != VK_SUCCESS)
+    if (!useMeshlets)
     {
-        throw std::runtime_error("failed to create graphics descriptor sets");
+        return;
     }
 
-    updateGraphicsDescriptorSets();
-}
+    Stopwatch stopwatch;
 
-void VulkanApplication::updateLuminanceDescriptorSets()
-{
-    for (size_t i = 0; i < swapChainImages.size(); ++i)
-    {
-        VkWriteDescriptorSet descriptorWrite = {};
+    MeshletData meshlets;
+    buildMeshlets(indexData, indexCount, vertexData, indexChunks, meshlets);
 
-        VkDescriptorImageInfo imageInfo = {};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = beautyImageView;
-        imageInfo.sampler = VK_NULL_HANDLE;
+    const double buildTime = stopwatch.elapsedMs();
 
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = luminanceDescriptorSets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = nullptr;
-        descriptorWrite.pImageInfo = &imageInfo;
-        descriptorWrite.pTexelBufferView = nullptr;
+    meshletCount = static_cast<uint32_t>(meshlets.meshlets.size());
 
-        vkUpdateDescriptorSets(device,
-                               1,
-                               &descriptorWrite,
-                               0,
-                               nullptr);
-    }
-}
+    // each part can be bound as its own storage buffer range
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(16, properties.limits.minStorageBufferOffsetAlignment);
 
-void VulkanApplication::createLuminanceDescriptorSets()
-{
-    std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), luminanceDescriptorSetLayout);
+    auto align = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
 
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-    allocInfo.pSetLayouts = layouts.data();
+    meshletVerticesOffset = align(sizeof(Meshlet) * meshlets.meshlets.size());
+    meshletTrianglesOffset = meshletVerticesOffset + align(sizeof(uint32_t) * meshlets.vertices.size());
+    const VkDeviceSize bufferSize = meshletTrianglesOffset + align(meshlets.triangles.size());
 
-    luminanceDescriptorSets.resize(swapChainImages.size());
-    if (vkAllocateDescriptorSets(device, &allocInfo, luminanceDescriptorSets.data()) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create luminance descriptor sets");
-    }
+    VkBuffer stagingBuffer;
+    DeviceAllocation stagingBufferMemory;
 
-    updateLuminanceDescriptorSets();
-}
+    static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-void VulkanApplication::updateComputeDescriptorSets()
-{
-    for (size_t i = 0; i < swapChainImages.size(); ++i)
-    {
-        const auto& dstSet = computeDescriptorSets[i];
+    createBuffer(bufferSize,
+                 stagingBufferUsage,
+                 stagingBufferProps,
+                 &stagingBuffer,
+                 &stagingBufferMemory);
 
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+    void* data = stagingBufferMemory.mapped;
+    auto bytes = static_cast<char*>(data);
+    memcpy(bytes, meshlets.meshlets.data(), sizeof(Meshlet) * meshlets.meshlets.size());
+    memcpy(bytes + meshletVerticesOffset, meshlets.vertices.data(), sizeof(uint32_t) * meshlets.vertices.size());
+    memcpy(bytes + meshletTrianglesOffset, meshlets.triangles.data(), meshlets.triangles.size());
 
-        VkDescriptorBufferInfo storageBufferInfo = {};
-        storageBufferInfo.buffer = vertexBuffer;
-        storageBufferInfo.offset = 0;
-        storageBufferInfo.range = vertices.size() * sizeof(vertices[0]);
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = dstSet;
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &storageBufferInfo;
-        descriptorWrites[0].pImageInfo = nullptr;
-        descriptorWrites[0].pTexelBufferView = nullptr;
+    const auto sharingFamilies = computeSharingFamilies();
+    auto& context = uploadContextFor(sharingFamilies);
 
-        VkDescriptorBufferInfo uniformBufferInfo = {};
-        uniformBufferInfo.buffer = computeUniformBuffers[i];
-        uniformBufferInfo.offset = 0;
-        uniformBufferInfo.range = sizeof(ComputeData);
+    createBuffer(bufferSize, bufferUsage, bufferProps, &meshletBuffer, &meshletBufferMemory, sharingFamilies);
 
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = dstSet;
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = &uniformBufferInfo;
-        descriptorWrites[1].pImageInfo = nullptr;
-        descriptorWrites[1].pTexelBufferView = nullptr;
+    copyBuffer(context, stagingBuffer, meshletBuffer, bufferSize, VK_ACCESS_SHADER_READ_BIT,
+               VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-        vkUpdateDescriptorSets(device,
-                               static_cast<uint32_t>(descriptorWrites.size()),
-                               descriptorWrites.data(),
-                               0,
-                               nullptr);
-    }
+    context.release(stagingBuffer, stagingBufferMemory);
+
+    std::cout << "=> meshlets: " << meshletCount << " in " << buildTime << " ms, "
+              << (meshletCount > 0 ? static_cast<double>(meshlets.vertices.size()) / meshletCount : 0.0) << " vertices and "
+              << (meshletCount > 0 ? indexCount / 3.0 / meshletCount : 0.0) << " triangles on average, "
+              << bufferSize / (1024.0 * 1024.0) << " MB" << std::endl;
 }
 
-void VulkanApplication::createComputeDescriptorSets()
+
+void VulkanApplication::createUniformBuffers()
 {
-    const auto imageCount = swapChainImages.size();
-    std::vector<VkDescriptorSetLayout> layouts(imageCount, computeDescriptorSetLayout);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
-    allocInfo.pSetLayouts = layouts.data();
+    // dynamic offsets must be multiples of the alignment, which is a power of two
+    const VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    auto alignUp = [alignment](VkDeviceSize size)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    };
 
-    computeDescriptorSets.resize(swapChainImages.size());
-    if (vkAllocateDescriptorSets(device, &allocInfo, computeDescriptorSets.data()) != VK_SUCCESS)
+    computeDataOffset = alignUp(sizeof(Matrices));
+    uniformSliceSize = computeDataOffset + alignUp(sizeof(ComputeData));
+
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    // the compute data is read by the compute queue
+    createBuffer(uniformSliceSize * framesInFlight, bufferUsage, bufferProps, &uniformRing, &uniformRingMemory, computeSharingFamilies());
+}
+void VulkanApplication::streamModel()
+{
+    if (useCompactVertices)
     {
-        throw std::runtime_error("failed to create compute descriptor sets");
+        throw std::runtime_error("the streaming loader only writes the full vertex layout");
     }
 
-    updateComputeDescriptorSets();
-}
+    Stopwatch stopwatch;
 
-void VulkanApplication::fillGraphicsCommandBuffers()
-{
-    for (size_t i = 0; i < graphicsCommandBuffers.size(); ++i)
+    // sizes every buffer once, instead of growing them as the file is read
+    const ObjCounts counts = countObj(modelPath.c_str());
+    if (counts.corners == 0)
     {
-        VkCommandBufferBeginInfo beginInfo = {};
+        throw std::runtime_error("streamed model has no triangles");
+    }
+
+    if (counts.corners > std::numeric_limits<uint32_t>::max())
+    {
+        throw std::runtime_error("streamed model has too many corners for 32-bit indices");
+    }
+
+    const double countTime = stopwatch.elapsedMs();
+
+    // half of the budget is staging, the other half the host arrays. Every vertex is one (v, vt) pair,
+    // there are at most as many as corners. Past their half, the arrays live in a mapped temporary file
+    const size_t keyBytes = counts.corners * sizeof(uint64_t);
+    const size_t tableBytes = VertexTable::storageSize(counts.corners);
+    const size_t positionBytes = counts.positions * 3 * sizeof(float);
+    const size_t texcoordBytes = counts.texcoords * 2 * sizeof(float);
+    const size_t arrayBytes = keyBytes + tableBytes + positionBytes + texcoordBytes;
+
+    SpillBuffer arrays;
+    if (!arrays.allocate(arrayBytes, arrayBytes > streamingBudget / 2 ? "stream.tmp" : ""))
+    {
+        throw std::runtime_error("failed to allocate the streaming loader arrays");
+    }
+
+    auto keys = reinterpret_cast<uint64_t*>(arrays.data());
+    VertexTable uniqueVertices(arrays.data() + keyBytes, counts.corners);
+    auto positions = reinterpret_cast<float*>(arrays.data() + keyBytes + tableBytes);
+    auto texcoords = reinterpret_cast<float*>(arrays.data() + keyBytes + tableBytes + positionBytes);
+
+    const VkDeviceSize blockSize = streamingBudget / (2 * stagingBlockCount);
+
+    static const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    static const VkMemoryPropertyFlags stagingBufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    std::vector<StagingBlock> blocks(stagingBlockCount);
+    size_t current = 0;
+    VkDeviceSize fill = 0;
+
+    for (auto& block : blocks)
+    {
+        createBuffer(blockSize, stagingBufferUsage, stagingBufferProps, &block.buffer, &block.memory);
+
+        block.data = block.memory.mapped;
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(device, &fenceInfo, nullptr, &block.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create staging fence");
+        }
+    }
+
+    // waits until the block's last upload is done
+    auto recycle = [&](StagingBlock& block)
+    {
+        if (block.commandBuffer == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        vkWaitForFences(device, 1, &block.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        vkResetFences(device, 1, &block.fence);
+
+        vkFreeCommandBuffers(device, graphicsCommandPool, 1, &block.commandBuffer);
+        block.commandBuffer = VK_NULL_HANDLE;
+    };
+
+    auto flush = [&](StreamTarget& target)
+    {
+        if (fill == 0)
+        {
+            return;
+        }
+
+        auto& block = blocks[current];
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = graphicsCommandPool;
+        allocInfo.commandBufferCount = 1;
+
+        vkAllocateCommandBuffers(device, &allocInfo, &block.commandBuffer);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(block.commandBuffer, &beginInfo);
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = target.size;
+        copyRegion.size = fill;
+
+        vkCmdCopyBuffer(block.commandBuffer, block.buffer, target.buffer, 1, &copyRegion);
+
+        vkEndCommandBuffer(block.commandBuffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &block.commandBuffer;
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, block.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit staging block");
+        }
+
+        target.size += fill;
+        fill = 0;
+        current = (current + 1) % blocks.size();
+
+        recycle(blocks[current]);
+    };
+
+    auto write = [&](StreamTarget& target, const void* data, size_t size)
+    {
+        if (fill + size > blockSize)
+        {
+            flush(target);
+        }
+
+        memcpy(blocks[current].data + fill, data, size);
+        fill += size;
+    };
+
+    // the index count is known, the index buffer is filled as the faces are read
+    const VkDeviceSize indexBufferSize = sizeof(uint32_t) * counts.corners;
+    createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, bufferProps, &indexBuffer, &indexBufferMemory);
+
+    StreamTarget indexTarget;
+    indexTarget.buffer = indexBuffer;
+
+    size_t positionCount = 0;
+    size_t texcoordCount = 0;
+    size_t cornerCount = 0;
+    uint32_t uniqueCount = 0;
+
+    streamObj(modelPath.c_str(), [&](const ObjMesh& mesh)
+    {
+        if (positionCount * 3 + mesh.positions.size() > counts.positions * 3
+            || texcoordCount * 2 + mesh.texcoords.size() > counts.texcoords * 2
+            || cornerCount + mesh.corners.size() > counts.corners)
+        {
+            throw std::runtime_error("obj file changed while it was streamed");
+        }
+
+        // records come once, the vertices are built from them after the pass
+        std::copy(mesh.positions.begin(), mesh.positions.end(), positions + positionCount * 3);
+        std::copy(mesh.texcoords.begin(), mesh.texcoords.end(), texcoords + texcoordCount * 2);
+        positionCount += mesh.positions.size() / 3;
+        texcoordCount += mesh.texcoords.size() / 2;
+
+        for (const auto& corner : mesh.corners)
+        {
+            const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(corner.vertex)) << 32)
+                               | static_cast<uint32_t>(corner.texcoord + 1);
+
+            const auto id = uniqueVertices.findOrInsert(mixKey(key), uniqueCount, [&](uint32_t i)
+            {
+                return keys[i] == key;
+            });
+
+            if (id == uniqueCount)
+            {
+                keys[uniqueCount++] = key;
+            }
+
+            write(indexTarget, &id, sizeof(id));
+        }
+
+        cornerCount += mesh.corners.size();
+    });
+
+    flush(indexTarget);
+
+    if (cornerCount != counts.corners)
+    {
+        throw std::runtime_error("obj file changed while it was streamed");
+    }
+
+    vertexCount = uniqueCount;
+    indexCount = static_cast<uint32_t>(cornerCount);
+
+    // every position is known now, the model is centered on their bounds
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < positionCount; ++i)
+    {
+        const glm::vec3 position(positions[3 * i], positions[3 * i + 2], positions[3 * i + 1]); // model in z up
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    const glm::vec3 center = (min + max) * 0.5f;
+
+    boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+
+    // the vertex count is known too, the vertices go straight into a buffer of their final size
+    const VkDeviceSize vertexBufferSize = sizeof(Vertex) * vertexCount;
+    createBuffer(vertexBufferSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 bufferProps, &vertexBuffer, &vertexBufferMemory, computeSharingFamilies());
+
+    StreamTarget vertexTarget;
+    vertexTarget.buffer = vertexBuffer;
+
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        const auto position = static_cast<size_t>(keys[i] >> 32);
+        const auto texcoord = static_cast<int64_t>(keys[i] & 0xFFFFFFFFu) - 1;
+
+        // same as makeVertex
+        Vertex vertex = {};
+        vertex.pos = {
+            positions[3 * position + 0],
+            positions[3 * position + 2], // model in z up
+            positions[3 * position + 1],
+        };
+        if (texcoord >= 0)
+        {
+            vertex.texCoord = {
+                texcoords[2 * texcoord + 0],
+                1.0f - texcoords[2 * texcoord + 1],
+            };
+        }
+        vertex.color = vertex.pos;
+        vertex.pos -= center;
+
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+
+        write(vertexTarget, &vertex, sizeof(vertex));
+    }
+
+    flush(vertexTarget);
+
+    const double streamTime = stopwatch.elapsedMs();
+
+    for (auto& block : blocks)
+    {
+        recycle(block);
+
+        vkDestroyBuffer(device, block.buffer, nullptr);
+        allocator.free(block.memory);
+        vkDestroyFence(device, block.fence, nullptr);
+    }
+
+    const bool spilled = arrays.spilled();
+    arrays.release();
+
+    // the copies ran on the graphics queue, whose later submits see them behind these barriers
+    beginUploadCommands(upload);
+    upload.handOverBuffer(vertexBuffer, vertexBufferAccess, vertexBufferStages);
+    upload.handOverBuffer(indexBuffer, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    endUploadCommands(upload);
+
+    // drawn as one 32-bit level
+    lodLevels.assign(1, { 0, indexCount, 0.f });
+    indexType = VK_INDEX_TYPE_UINT32;
+    indexChunks.assign(1, { 0, indexCount, 0 });
+    lodFirstChunks = { 0, 1 };
+    maxLodDraws = 1;
+
+    std::cout << "=> model " << modelPath << " streamed in " << streamTime << " ms, " << countTime << " ms counting" << std::endl;
+    std::cout << "\t - " << vertexCount << " vertices, " << indexCount << " indices, "
+              << (vertexBufferSize + indexBufferSize) / (1024.0 * 1024.0) << " MB on the GPU" << std::endl;
+    std::cout << "\t - host: " << streamingBudget / (2 * 1024.0 * 1024.0) << " MB staging, "
+              << arrayBytes / (1024.0 * 1024.0) << " MB of arrays " << (spilled ? "in a mapped temporary file" : "in memory")
+              << std::endl;
+    std::cout << "\t - peak memory: " << peakResidentBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+
+void VulkanApplication::createIndirectBuffers()
+{
+    VkDeviceSize bufferSize = sizeof(VkDrawIndexedIndirectCommand) * maxLodDraws;
+
+    indirectBuffers.resize(framesInFlight);
+    indirectBufferMemories.resize(framesInFlight);
+
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    static const VkMemoryPropertyFlags bufferProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    for (size_t i = 0; i < framesInFlight; ++i)
+    {
+        createBuffer(bufferSize, bufferUsage, bufferProps, &indirectBuffers[i], &indirectBufferMemories[i]);
+    }
+}
+
+
+// sized for maxFramesInFlight, setFramesInFlight only resets it
+void VulkanApplication::createDescriptorPool()
+{
+    std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 2 * maxFramesInFlight; // 2 for compute, 2 for graphics
+
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = maxFramesInFlight; // 2 for luminance
+
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    poolSizes[2].descriptorCount = maxFramesInFlight; // 2 for luminance
+
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[3].descriptorCount = 2 * maxFramesInFlight; // deformed vertices, rest data for compute
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 3 * maxFramesInFlight; // 2 for compute, 2 for graphics, 2 for luminance 
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+}
+
+void VulkanApplication::updateGraphicsDescriptorSets()
+{
+    for (size_t i = 0; i < framesInFlight; ++i)
+    {
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = uniformRing;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(Matrices);
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = graphicsDescriptorSets[i];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &bufferInfo;
+        descriptorWrites[0].pImageInfo = nullptr;
+        descriptorWrites[0].pTexelBufferView = nullptr;
+
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = textureImageView;
+        imageInfo.sampler = textureImageSampler;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = graphicsDescriptorSets[i];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = nullptr;
+        descriptorWrites[1].pImageInfo = &imageInfo;
+        descriptorWrites[1].pTexelBufferView = nullptr;
+
+        vkUpdateDescriptorSets(device,
+                               static_cast<uint32_t>(descriptorWrites.size()),
+                               descriptorWrites.data(),
+                               0,
+                               nullptr);
+    }
+}
+
+void VulkanApplication::createGraphicsDescriptorSets()
+{
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, graphicsDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = layouts.data();
+
+    graphicsDescriptorSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(device, &allocInfo, graphicsDescriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create graphics descriptor sets");
+    }
+
+    updateGraphicsDescriptorSets();
+}
+
+void VulkanApplication::updateLuminanceDescriptorSets()
+{
+    for (size_t i = 0; i < framesInFlight; ++i)
+    {
+        VkWriteDescriptorSet descriptorWrite = {};
+
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = beautyImageView;
+        imageInfo.sampler = VK_NULL_HANDLE;
+
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = luminanceDescriptorSets[i];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = nullptr;
+        descriptorWrite.pImageInfo = &imageInfo;
+        descriptorWrite.pTexelBufferView = nullptr;
+
+        vkUpdateDescriptorSets(device,
+                               1,
+                               &descriptorWrite,
+                               0,
+                               nullptr);
+    }
+}
+
+void VulkanApplication::createLuminanceDescriptorSets()
+{
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, luminanceDescriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = layouts.data();
+
+    luminanceDescriptorSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(device, &allocInfo, luminanceDescriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create luminance descriptor sets");
+    }
+
+    updateLuminanceDescriptorSets();
+}
+
+void VulkanApplication::updateComputeDescriptorSets()
+{
+    for (size_t i = 0; i < framesInFlight; ++i)
+    {
+        const auto& dstSet = computeDescriptorSets[i];
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+
+        VkDescriptorBufferInfo storageBufferInfo = {};
+        storageBufferInfo.buffer = drawnVertexBuffer(i);
+        storageBufferInfo.offset = 0;
+        storageBufferInfo.range = vertexCount * vertexStride();
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = dstSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &storageBufferInfo;
+        descriptorWrites[0].pImageInfo = nullptr;
+        descriptorWrites[0].pTexelBufferView = nullptr;
+
+        VkDescriptorBufferInfo uniformBufferInfo = {};
+        uniformBufferInfo.buffer = uniformRing;
+        uniformBufferInfo.offset = computeDataOffset;
+        uniformBufferInfo.range = sizeof(ComputeData);
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = dstSet;
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &uniformBufferInfo;
+        descriptorWrites[1].pImageInfo = nullptr;
+        descriptorWrites[1].pTexelBufferView = nullptr;
+
+        // the full vertices are their own rest data, positions in the color slot
+        VkDescriptorBufferInfo restBufferInfo = {};
+        restBufferInfo.buffer = useCompactVertices ? restPositionBuffer : vertexBuffer;
+        restBufferInfo.offset = 0;
+        restBufferInfo.range = vertexCount * (useCompactVertices ? sizeof(PackedPosition) : sizeof(Vertex));
+
+        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2].dstSet = dstSet;
+        descriptorWrites[2].dstBinding = 2;
+        descriptorWrites[2].dstArrayElement = 0;
+        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[2].descriptorCount = 1;
+        descriptorWrites[2].pBufferInfo = &restBufferInfo;
+        descriptorWrites[2].pImageInfo = nullptr;
+        descriptorWrites[2].pTexelBufferView = nullptr;
+
+        // the rest position binding stays empty when nothing is ever dispatched
+        const uint32_t writeCount = restBufferInfo.buffer != VK_NULL_HANDLE ? 3 : 2;
+
+        vkUpdateDescriptorSets(device,
+                               writeCount,
+                               descriptorWrites.data(),
+                               0,
+                               nullptr);
+    }
+}
+
+void VulkanApplication::createComputeDescriptorSets()
+{
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, computeDescriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = layouts.data();
+
+    computeDescriptorSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(device, &allocInfo, computeDescriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create compute descriptor sets");
+    }
+
+    updateComputeDescriptorSets();
+}
+
+void VulkanApplication::fillGraphicsCommandBuffers()
+{
+    const size_t imageCount = swapChainImages.size();
+
+    for (size_t i = 0; i < graphicsCommandBuffers.size(); ++i)
+    {
+        const size_t frame = i / imageCount;
+        const size_t image = i % imageCount;
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        beginInfo.pInheritanceInfo = nullptr; // Optional
+
+        if (vkBeginCommandBuffer(graphicsCommandBuffers[i], &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording graphics command buffer");
+        }
+
+        const uint32_t firstQuery = static_cast<uint32_t>(4 * frame + 2);
+        if (recordGpuTimestamps)
+        {
+            vkCmdResetQueryPool(graphicsCommandBuffers[i], timestampQueryPool, firstQuery, 2);
+            vkCmdWriteTimestamp(graphicsCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery);
+        }
+
+        VkRenderPassBeginInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = swapChainFramebuffers[image];
+        renderPassInfo.renderArea.offset = { 0,0 };
+        renderPassInfo.renderArea.extent = swapChainExtent;
+
+        std::array<VkClearValue, 3> clearValues = {};
+        clearValues[0].color = { 0.f, 0.f, 0.f, 1.f };
+        clearValues[1].depthStencil = { 1.f, 0 };
+        clearValues[2].color = { 0.f, 0.f, 0.f, 1.f };
+
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        // first render beauty and depth
+
+        if (useSecondaryCommandBuffers)
+        {
+            vkCmdBeginRenderPass(graphicsCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+            const auto& secondaries = beautyCommandBuffers[frame];
+            if (!secondaries.empty())
+            {
+                vkCmdExecuteCommands(graphicsCommandBuffers[i], static_cast<uint32_t>(secondaries.size()), secondaries.data());
+            }
+        }
+        else
+        {
+            vkCmdBeginRenderPass(graphicsCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+            recordBeautyDraws(graphicsCommandBuffers[i], frame, 0, maxLodDraws);
+        }
+
+
+        // then apply post fx
+
+        vkCmdNextSubpass(graphicsCommandBuffers[i], VK_SUBPASS_CONTENTS_INLINE);
+
+        {
+            vkCmdBindPipeline(graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, luminancePipeline);
+
+            setViewportAndScissor(graphicsCommandBuffers[i]);
+
+            VkDeviceSize offsets[] = { 0 };
+
+            vkCmdBindVertexBuffers(graphicsCommandBuffers[i], 0, 1, &quadBuffer, offsets);
+
+            vkCmdBindDescriptorSets(graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, luminancePipelineLayout, 0, 1, &luminanceDescriptorSets[frame], 0, nullptr);
+
+            vkCmdDraw(graphicsCommandBuffers[i], 3, 1, 0, 0);
+        }
+
+
+        vkCmdEndRenderPass(graphicsCommandBuffers[i]);
+
+        if (recordGpuTimestamps)
+        {
+            vkCmdWriteTimestamp(graphicsCommandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, firstQuery + 1);
+        }
+
+        if (vkEndCommandBuffer(graphicsCommandBuffers[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record graphics command buffer");
+        }
+    }
+}
+
+void VulkanApplication::recordBeautyDraws(VkCommandBuffer commandBuffer, size_t frame, size_t begin, size_t end)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+    // secondary command buffers do not inherit it
+    setViewportAndScissor(commandBuffer);
+
+    VkBuffer vertexBuffers[] = { drawnVertexBuffer(frame) };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+
+    const uint32_t uniformOffset = static_cast<uint32_t>(uniformSliceOffset(frame));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &graphicsDescriptorSets[frame], 1, &uniformOffset);
+
+    // one draw at a time, a drawCount above 1 would need the multiDrawIndirect feature
+    for (size_t d = begin; d < end; ++d)
+    {
+        const VkDeviceSize offset = (d % maxLodDraws) * sizeof(VkDrawIndexedIndirectCommand);
+        vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[frame], offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+uint32_t VulkanApplication::recordThreads() const
+{
+    return recordThreadCount > 0 ? recordThreadCount : workerCount();
+}
+
+void VulkanApplication::fillComputeCommandBuffers()
+{
+    const auto bufferSize = vertexStride() * vertexCount;
+
+    for (size_t i = 0; i < computeCommandBuffers.size(); ++i)
+    {
+        auto& commandBuffer = computeCommandBuffers[i];
+        const VkBuffer target = drawnVertexBuffer(i);
+        const uint32_t firstQuery = static_cast<uint32_t>(4 * i);
+
+        VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
         beginInfo.pInheritanceInfo = nullptr; // Optional
 
-        if (vkBeginCommandBuffer(graphicsCommandBuffers[i], &beginInfo) != VK_SUCCESS)
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording compute command buffer");
+        }
+
+        if (recordGpuTimestamps)
+        {
+            vkCmdResetQueryPool(commandBuffer, timestampQueryPool, firstQuery, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery);
+        }
+
+        // a buffer per frame slot was last drawn by the frame the CPU waited for before reusing the slot;
+        // a shared one is drawn by the previous frame, which the scheduler only orders across queues
+        if (!overlapCompute)
+        {
+            vkCmdPipelineBarrier(commandBuffer,
+                                 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 0,
+                                 0, nullptr,
+                                 0, nullptr,
+                                 0, nullptr);
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+
+        const uint32_t uniformOffset = static_cast<uint32_t>(uniformSliceOffset(i));
+        vkCmdBindDescriptorSets(commandBuffer, 
+                                VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                computePipelineLayout, 
+                                0, 1, 
+                                &computeDescriptorSets[i], 
+                                1, &uniformOffset);
+
+        vkCmdDispatch(commandBuffer, vertexCount / 64 + 1, 1, 1);
+
+        // the buffers are shared concurrently when compute has its own family, no ownership to move
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = target;
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = bufferSize;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                             0,
+                             0, nullptr,
+                             1, &bufferBarrier,
+                             0, nullptr);
+
+        if (recordGpuTimestamps)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, firstQuery + 1);
+        }
+
+        if (vkEndCommandBuffer(computeCommandBuffers[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record compute command buffer");
+        }
+    }
+}
+
+void VulkanApplication::createCommandBuffers()
+{
+    {
+        // graphics command buffers, every frame in flight renders to every swapchain image
+        graphicsCommandBuffers.resize(framesInFlight * swapChainFramebuffers.size());
+
+        if (useSecondaryCommandBuffers)
+        {
+            const auto queueFamilyIndices = findQueueFamilies(physicalDevice);
+            graphicsRecorder.init(device, queueFamilyIndices.graphicsFamily, recordThreads(), framesInFlight);
+
+            // any framebuffer of the render pass, the subpass does not depend on the swapchain image
+            VkCommandBufferInheritanceInfo inheritance = {};
+            inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance.renderPass = renderPass;
+            inheritance.subpass = 0;
+            inheritance.framebuffer = VK_NULL_HANDLE;
+
+            beautyCommandBuffers.resize(framesInFlight);
+            for (size_t frame = 0; frame < framesInFlight; ++frame)
+            {
+                beautyCommandBuffers[frame] = graphicsRecorder.record(frame, inheritance, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, maxLodDraws,
+                                                                      [this, frame](VkCommandBuffer commandBuffer, size_t begin, size_t end)
+                {
+                    recordBeautyDraws(commandBuffer, frame, begin, end);
+                });
+            }
+        }
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = graphicsCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = (uint32_t)graphicsCommandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, graphicsCommandBuffers.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate graphics command buffers");
+        }
+
+        fillGraphicsCommandBuffers();
+    }
+    
+    {
+        // compute command buffers
+        computeCommandBuffers.resize(framesInFlight);
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = computeCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = (uint32_t)computeCommandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate compute command buffers");
+        }
+
+        fillComputeCommandBuffers();
+    }
+}
+
+void VulkanApplication::createSyncObjects()
+{
+    // the swapchain only takes binary semaphores
+    imageAvailableSemaphores.resize(framesInFlight);
+    renderFinishedSemaphores.resize(framesInFlight);
+    frameStartTimes.assign(framesInFlight, 0.0);
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (size_t i = 0; i < framesInFlight; ++i)
+    {
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create sync objects for a frame");
+        }
+    }
+
+    scheduler.init(device, computeQueue, graphicsQueue, framesInFlight, timelineSemaphores);
+}
+
+void VulkanApplication::createFrameResources()
+{
+    createUniformBuffers();
+    createIndirectBuffers();
+    createDeformedVertexBuffers();
+    createTimestampQueries();
+    createGraphicsDescriptorSets();
+    createLuminanceDescriptorSets();
+    createComputeDescriptorSets();
+    createSyncObjects();
+
+    currentFrame = 0;
+}
+
+void VulkanApplication::destroyFrameResources()
+{
+    for (size_t i = 0; i < framesInFlight; ++i)
+    {
+        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+
+        vkDestroyBuffer(device, indirectBuffers[i], nullptr);
+        allocator.free(indirectBufferMemories[i]);
+    }
+
+    vkDestroyBuffer(device, uniformRing, nullptr);
+    allocator.free(uniformRingMemory);
+
+    for (size_t i = 0; i < deformedVertexBuffers.size(); ++i)
+    {
+        vkDestroyBuffer(device, deformedVertexBuffers[i], nullptr);
+        allocator.free(deformedVertexBufferMemories[i]);
+    }
+    deformedVertexBuffers.clear();
+    deformedVertexBufferMemories.clear();
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+        timestampQueryPool = VK_NULL_HANDLE;
+    }
+
+    scheduler.destroy();
+
+    // frees every set at once
+    vkResetDescriptorPool(device, descriptorPool, 0);
+}
+
+void VulkanApplication::freeCommandBuffers()
+{
+    vkFreeCommandBuffers(device, graphicsCommandPool, static_cast<uint32_t>(graphicsCommandBuffers.size()), graphicsCommandBuffers.data());
+
+    graphicsRecorder.destroy();
+    beautyCommandBuffers.clear();
+
+    vkFreeCommandBuffers(device, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+}
+
+void VulkanApplication::setFramesInFlight(uint32_t count)
+{
+    count = count < 1 ? 1 : count > maxFramesInFlight ? maxFramesInFlight : count;
+    if (count == framesInFlight)
+    {
+        return;
+    }
+
+    vkDeviceWaitIdle(device);
+
+    freeCommandBuffers();
+    destroyFrameResources();
+
+    framesInFlight = count;
+
+    createFrameResources();
+    createCommandBuffers();
+
+    // the deformed vertex copies
+    upload.finish();
+}
+
+void VulkanApplication::setComputeOverlap(bool overlap)
+{
+    if (overlap == overlapCompute)
+    {
+        return;
+    }
+
+    vkDeviceWaitIdle(device);
+
+    freeCommandBuffers();
+    destroyFrameResources();
+
+    overlapCompute = overlap;
+
+    createFrameResources();
+    createCommandBuffers();
+
+    upload.finish();
+}
+
+void VulkanApplication::createDeformedVertexBuffers()
+{
+    if (!useComputeDeformation)
+    {
+        return;
+    }
+
+    const auto sharingFamilies = computeSharingFamilies();
+
+    const VkDeviceSize bufferSize = vertexStride() * vertexCount;
+    const size_t count = overlapCompute ? framesInFlight : 1;
+
+    static const VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                                | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                                                | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    deformedVertexBuffers.resize(count);
+    deformedVertexBufferMemories.resize(count);
+
+    auto commandBuffer = beginUploadCommands(upload);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = bufferSize;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        createBuffer(bufferSize, bufferUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deformedVertexBuffers[i], &deformedVertexBufferMemories[i], sharingFamilies);
+
+        // compute only ever rewrites positions, everything else must already be there
+        vkCmdCopyBuffer(commandBuffer, vertexBuffer, deformedVertexBuffers[i], 1, &copyRegion);
+    }
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    endUploadCommands(upload);
+}
+
+VkBuffer VulkanApplication::drawnVertexBuffer(size_t frame) const
+{
+    if (deformedVertexBuffers.empty())
+    {
+        return vertexBuffer;
+    }
+
+    return deformedVertexBuffers[overlapCompute ? frame : 0];
+}
+
+void VulkanApplication::createTimestampQueries()
+{
+    recordGpuTimestamps = false;
+    timestampFrames.assign(framesInFlight, 0);
+
+    if (!runComputeOverlapBenchmark || !useComputeDeformation)
+    {
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    const auto indices = findQueueFamilies(physicalDevice);
+    if (queueFamilies[indices.graphicsFamily].timestampValidBits == 0
+        || queueFamilies[indices.computeFamily].timestampValidBits == 0)
+    {
+        return;
+    }
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 4 * framesInFlight;
+
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create timestamp query pool");
+    }
+
+    timestampPeriod = properties.limits.timestampPeriod;
+    recordGpuTimestamps = true;
+}
+
+void VulkanApplication::collectGpuTimestamps(size_t slot)
+{
+    if (!recordGpuTimestamps || timestampFrames[slot] == 0)
+    {
+        return;
+    }
+
+    std::array<uint64_t, 4> timestamps;
+    if (vkGetQueryPoolResults(device, timestampQueryPool, static_cast<uint32_t>(4 * slot), 4,
+                              sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+    {
+        for (auto& timestamp : timestamps)
+        {
+            timestamp = static_cast<uint64_t>(timestamp * timestampPeriod);
+        }
+        gpuFrameTimestamps.push_back(timestamps);
+    }
+
+    timestampFrames[slot] = 0;
+}
+
+void VulkanApplication::initResources()
+{
+    Stopwatch startupStopwatch;
+
+    chooseVertexLayout();
+    createInstance();
+    setupDebugCallback();
+    createSurface();
+    pickPhysicalDevice();
+    createLogicalDevice();
+    createPipelineCache();
+    createAllocator();
+    createSwapChain();
+    createImageViews();
+    createRenderPass();
+    createGraphicsDescriptorSetLayout();
+    createLuminanceDescriptorSetLayout();
+    createComputeDescriptorSetLayout();
+
+    Stopwatch pipelineStopwatch;
+    createGraphicsPipeline();
+    createLuminancePipeline();
+    createComputePipeline();
+    pipelineCreationMs = pipelineStopwatch.elapsedMs();
+
+    createCommandPools();
+    createUploadContext();
+    createDepthResources();
+    createBeautyResources();
+    createFramebuffers();
+    createTextureImage();
+    createTextureImageView();
+    createTextureSampler();
+    if (useStreamingLoader)
+    {
+        streamModel();
+    }
+    else
+    {
+        createVertexBuffer();
+        createIndexBuffer();
+        createMeshletBuffer();
+    }
+    createQuadBuffer();
+
+    // the uploads run while the rest is created
+    upload.submit();
+    transferUpload.submit();
+
+    createDescriptorPool();
+    createFrameResources();
+    createCommandBuffers();
+
+    // usually complete by now, then nothing blocks
+    for (auto context : { &upload, &transferUpload })
+    {
+        if (!context->poll())
         {
-            throw std::runtime_error("failed to begin recording graphics command buffer");
+            context->finish();
         }
+    }
 
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[i];
-        renderPassInfo.renderArea.offset = { 0,0 };
-        renderPassInfo.renderArea.extent = swapChainExtent;
+    std::cout << "=> frames scheduled with " << (scheduler.usesTimeline() ? "timeline semaphores" : "fences and binary semaphores")
+              << ", compute " << (computeQueue == graphicsQueue ? "on the graphics queue" : "on its own queue") << std::endl;
 
-        std::array<VkClearValue, 3> clearValues = {};
-        clearValues[0].color = { 0.f, 0.f, 0.f, 1.f };
-        clearValues[1].depthStencil = { 1.f, 0 };
-        clearValues[2].color = { 0.f, 0.f, 0.f, 1.f };
+    std::cout << "=> startup uploads: " << upload.submitCount() + transferUpload.submitCount() << " submits, "
+              << upload.waitCount() + transferUpload.waitCount() << " waits"
+              << (useBatchedUploads ? ", batched" : ", one per copy or transition") << std::endl;
 
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
+    std::cout << "=> vulkan startup in " << startupStopwatch.elapsedMs() << " ms, pipelines in " << pipelineCreationMs << " ms";
+    if (!usePipelineCache)
+    {
+        std::cout << " without pipeline cache" << std::endl;
+    }
+    else if (pipelineCache.warm())
+    {
+        std::cout << " with a warm pipeline cache, " << pipelineCache.loadedBytes() / 1024.0 << " KB from " << pipelineCache.path() << std::endl;
+    }
+    else
+    {
+        std::cout << " with a cold pipeline cache, " << pipelineCache.coldReason() << std::endl;
+    }
+}
 
-        vkCmdBeginRenderPass(graphicsCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+void VulkanApplication::cleanupSwapChain()
+{
+    vkDestroyImageView(device, depthImageView, nullptr);
+    vkDestroyImage(device, depthImage, nullptr);
+    allocator.free(depthImageMemory);
 
-        // first render beauty and depth
+    vkDestroyImageView(device, beautyImageView, nullptr);
+    vkDestroyImage(device, beautyImage, nullptr);
+    allocator.free(beautyImageMemory);
 
-        {
-            vkCmdBindPipeline(graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    for (auto& framebuffer : swapChainFramebuffers)
+    {
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
 
-            VkBuffer vertexBuffers[] = { vertexBuffer };
-            VkDeviceSize offsets[] = { 0 };
-            vkCmdBindVertexBuffers(graphicsCommandBuffers[i], 0, 1, vertexBuffers, offsets);
+    freeCommandBuffers();
 
-            vkCmdBindIndexBuffer(graphicsCommandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    for (const auto& imageView : swapChainImageViews)
+    {
+        vkDestroyImageView(device, imageView, nullptr);
+    }
 
-            vkCmdBindDescriptorSets(graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &graphicsDescriptorSets[i], 0, nullptr);
+    vkDestroySwapchainKHR(device, swapChain, nullptr);
+}
 
-            vkCmdDrawIndexed(graphicsCommandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-        }
+void VulkanApplication::recreateSwapChain()
+{
+    vkDeviceWaitIdle(device);
 
+    const VkFormat previousFormat = swapChainImageFormat;
 
-        // then apply post fx
+    cleanupSwapChain();
 
-        vkCmdNextSubpass(graphicsCommandBuffers[i], VK_SUBPASS_CONTENTS_INLINE);
+    createSwapChain();
+    createImageViews();
 
-        {
-            vkCmdBindPipeline(graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, luminancePipeline);
+    // the render pass only depends on the format, the pipelines on the extent when it is baked into them
+    if (swapChainImageFormat != previousFormat || !dynamicViewport)
+    {
+        destroyGraphicsPipelines();
+        vkDestroyRenderPass(device, renderPass, nullptr);
 
-            VkDeviceSize offsets[] = { 0 };
+        createRenderPass();
+        createGraphicsPipeline();
+        createLuminancePipeline();
+    }
 
-            vkCmdBindVertexBuffers(graphicsCommandBuffers[i], 0, 1, &quadBuffer, offsets);
+    createDepthResources();
+    createBeautyResources();
+    createFramebuffers();
+    updateLuminanceDescriptorSets();
+    createCommandBuffers();
+}
 
-            vkCmdBindDescriptorSets(graphicsCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, luminancePipelineLayout, 0, 1, &luminanceDescriptorSets[i], 0, nullptr);
+void VulkanApplication::updateUniformBuffers(size_t frame)
+{
+    char* slice = uniformRingMemory.mapped + uniformSliceOffset(frame);
 
-            vkCmdDraw(graphicsCommandBuffers[i], 3, 1, 0, 0);
-        }
+    {
+        // graphics uniform buffer
 
+        Matrices ubo = {};
+        ubo.model = modelTransform;
 
-        vkCmdEndRenderPass(graphicsCommandBuffers[i]);
+        ubo.view = camera.computeViewMatrix();
 
-        if (vkEndCommandBuffer(graphicsCommandBuffers[i]) != VK_SUCCESS)
+        ubo.proj = glm::perspective(glm::radians(camera.verticalFOV), swapChainExtent.width / (float)swapChainExtent.height, camera.near, camera.far);
+        ubo.proj[1][1] *= -1.f;
+
+        memcpy(slice, &ubo, sizeof(ubo));
+    }
+
+    {
+        // draws of the selected LOD level
+
+        currentLod = selectLod();
+
+        std::vector<VkDrawIndexedIndirectCommand> commands(maxLodDraws, VkDrawIndexedIndirectCommand());
+
+        for (uint32_t c = lodFirstChunks[currentLod]; c < lodFirstChunks[currentLod + 1]; ++c)
         {
-            throw std::runtime_error("failed to record graphics command buffer");
+            auto& command = commands[c - lodFirstChunks[currentLod]];
+            command.indexCount = indexChunks[c].indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = indexChunks[c].firstIndex;
+            command.vertexOffset = indexChunks[c].baseVertex;
+            command.firstInstance = 0;
         }
+
+        const auto size = sizeof(VkDrawIndexedIndirectCommand) * commands.size();
+
+        auto& memory = indirectBufferMemories[frame];
+        void* data = memory.mapped;
+        memcpy(data, commands.data(), size);
+    }
+
+    
+    {
+        // compute uniform buffer
+
+        static auto startTime = std::chrono::high_resolution_clock::now();
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+        ComputeData ubo = {};
+        ubo.time = time;
+        ubo.vertexCount = vertexCount;
+        ubo.halfTexCoords = quantization.texCoordEncoding == TexCoordEncoding::Half;
+        ubo.domainCenter = glm::vec4(quantization.domain.center, 0.f);
+        ubo.domainExtent = glm::vec4(quantization.domain.extent, 0.f);
+
+        memcpy(slice + computeDataOffset, &ubo, sizeof(ubo));
     }
+    
 }
 
-void VulkanApplication::fillComputeCommandBuffers()
+size_t VulkanApplication::selectLod() const
 {
-    const auto queueFamilyIndices = findQueueFamilies(physicalDevice);
-    const auto bufferSize = sizeof(vertices[0]) * vertices.size();
+    if (lodPolicy == LodPolicy::Finest)
+    {
+        return 0;
+    }
 
-    for (size_t i = 0; i < computeCommandBuffers.size(); ++i)
+    // the model is centered on the camera target, measure from the closest point of its bounding sphere
+    const float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+    const float distance = std::max(camera.dist - radius, camera.near);
+
+    const float pixelsPerUnit = swapChainExtent.height / (2.f * distance * std::tan(glm::radians(camera.verticalFOV) * 0.5f));
+
+    size_t level = 0;
+    while (level + 1 < lodLevels.size() && lodLevels[level + 1].error * pixelsPerUnit <= lodPixelError)
     {
-        auto& commandBuffer = computeCommandBuffers[i];
+        ++level;
+    }
 
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-        beginInfo.pInheritanceInfo = nullptr; // Optional
+    return level;
+}
 
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to begin recording compute command buffer");
-        }
+void VulkanApplication::drawFrame()
+{
+    Stopwatch waitStopwatch;
 
-        VkBufferMemoryBarrier bufferBarrier = {};
-        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-        bufferBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferBarrier.srcQueueFamilyIndex = queueFamilyIndices.graphicsFamily;
-        bufferBarrier.dstQueueFamilyIndex = queueFamilyIndices.computeFamily;
-        bufferBarrier.buffer = vertexBuffer;
-        bufferBarrier.offset = 0;
-        bufferBarrier.size = bufferSize;
+    scheduler.poll();
+    for (size_t slot = 0; slot < framesInFlight; ++slot)
+    {
+        recordFrameLatency(slot);
+    }
 
-        vkCmdPipelineBarrier(commandBuffer,
-                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                             0, 
-                             0, nullptr, 
-                             1, &bufferBarrier, 
-                             0, nullptr);
+    const uint64_t frame = scheduler.beginFrame();
+    currentFrame = scheduler.slot(frame);
+    recordFrameLatency(currentFrame);
+    collectGpuTimestamps(currentFrame);
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    uint32_t imageIndex;
+    VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
-        vkCmdBindDescriptorSets(commandBuffer, 
-                                VK_PIPELINE_BIND_POINT_COMPUTE, 
-                                computePipelineLayout, 
-                                0, 1, 
-                                &computeDescriptorSets[i], 
-                                0, nullptr);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        retrieveWindowSize();
+        recreateSwapChain();
+        framebufferResized = false;
+        return;
+    }
+    else if (result != VK_SUCCESS
+             && result != VK_SUBOPTIMAL_KHR)
+    {
+        throw std::runtime_error("failed to acquire swap chain image");
+    }
 
-        vkCmdDispatch(commandBuffer, vertices.size() / 64 + 1, 1, 1);
+    frameWaitTime += waitStopwatch.elapsedMs();
 
-        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
-        bufferBarrier.srcQueueFamilyIndex = queueFamilyIndices.computeFamily;
-        bufferBarrier.dstQueueFamilyIndex = queueFamilyIndices.graphicsFamily;
-        bufferBarrier.buffer = vertexBuffer;
-        bufferBarrier.offset = 0;
-        bufferBarrier.size = bufferSize;
+    Stopwatch uniformStopwatch;
+    frameStartTimes[currentFrame] = scheduler.time();
+    updateUniformBuffers(currentFrame);
+    uniformUpdateTime += uniformStopwatch.elapsedMs();
 
-        vkCmdPipelineBarrier(commandBuffer,
-                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-                             0,
-                             0, nullptr,
-                             1, &bufferBarrier,
-                             0, nullptr);
+    // compute vertices
 
-        if (vkEndCommandBuffer(computeCommandBuffers[i]) != VK_SUCCESS)
+    if (useComputeDeformation)
+    {
+        // a buffer per frame slot was last drawn by the frame just waited for, a shared one by the previous frame
+        const uint64_t lastDrawn = overlapCompute ? (frame > framesInFlight ? frame - framesInFlight : 0) : frame - 1;
+        scheduler.submitCompute(computeCommandBuffers[currentFrame], lastDrawn);
+    }
+
+    // render frame
+
+    scheduler.submitGraphics(graphicsCommandBuffer(currentFrame, imageIndex),
+                             useComputeDeformation,
+                             imageAvailableSemaphores[currentFrame],
+                             renderFinishedSemaphores[currentFrame]);
+
+    if (recordGpuTimestamps)
+    {
+        timestampFrames[currentFrame] = frame;
+    }
+
+    VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
+
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+
+    VkSwapchainKHR swapChains[] = { swapChain };
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = swapChains;
+    presentInfo.pImageIndices = &imageIndex;
+
+    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR
+        || result == VK_SUBOPTIMAL_KHR
+        || framebufferResized)
+    {
+        retrieveWindowSize();
+        recreateSwapChain();
+        framebufferResized = false;
+    }
+    else if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to present swap chain image");
+    }
+}
+
+void VulkanApplication::recordFrameLatency(size_t frame)
+{
+    const double completed = scheduler.frameTimeline(frame).completed[FrameScheduler::Graphics];
+
+    if (frameStartTimes[frame] > 0.0 && completed > 0.0)
+    {
+        frameLatencyTotal += completed - frameStartTimes[frame];
+        ++frameLatencyCount;
+        frameStartTimes[frame] = 0.0;
+    }
+}
+
+void VulkanApplication::runLodBenchmarkSweep()
+{
+    const int framesPerStep = 200;
+    const float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+    const float distances[] = { 1.5f, 2.f, 3.f, 5.f, 8.f, 16.f, 32.f, 64.f };
+
+    const float savedDist = camera.dist;
+    const LodPolicy savedPolicy = lodPolicy;
+
+    std::cout << "=> LOD benchmark, " << swapChainExtent.width << "x" << swapChainExtent.height << ", " << lodPixelError << " px error" << std::endl;
+
+    for (const auto policy : { LodPolicy::Finest, LodPolicy::ScreenSpaceError })
+    {
+        lodPolicy = policy;
+
+        for (const float distance : distances)
         {
-            throw std::runtime_error("failed to record compute command buffer");
+            camera.dist = distance * radius;
+
+            // let the level settle in every swapchain image before timing
+            for (size_t i = 0; i < swapChainImages.size(); ++i)
+            {
+                drawFrame();
+            }
+
+            double total = 0.0;
+            for (int frame = 0; frame < framesPerStep && !glfwWindowShouldClose(window); ++frame)
+            {
+                glfwPollEvents();
+
+                auto begin = glfwGetTime();
+                drawFrame();
+                total += glfwGetTime() - begin;
+            }
+
+            std::cout << "\t - " << (policy == LodPolicy::Finest ? "finest" : "screen space error")
+                      << ", distance " << distance << " radii: LOD " << currentLod << ", "
+                      << lodLevels[currentLod].indexCount / 3 << " triangles, "
+                      << total * 1000.0 / framesPerStep << " ms/frame" << std::endl;
         }
     }
+
+    camera.dist = savedDist;
+    lodPolicy = savedPolicy;
 }
 
-void VulkanApplication::createCommandBuffers()
+void VulkanApplication::runStreamingUploadPasses()
 {
-    const auto bufferSize = swapChainFramebuffers.size();
+    const int framesPerPass = 300;
+    const VkDeviceSize chunkSize = 8 * 1024 * 1024;
+    const VkDeviceSize targetSize = 32 * chunkSize;
+    const size_t maxChunksInFlight = 3;
 
-    {
-        // graphics command buffers
-        graphicsCommandBuffers.resize(bufferSize);
+    // never read by the frames, so it needs no hand over
+    VkBuffer target;
+    DeviceAllocation targetMemory;
+    createBuffer(targetSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &target, &targetMemory);
 
-        VkCommandBufferAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = graphicsCommandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t)graphicsCommandBuffers.size();
+    std::cout << "=> streaming benchmark, " << chunkSize / (1024 * 1024) << " MB chunks, up to "
+              << maxChunksInFlight << " in flight" << std::endl;
 
-        if (vkAllocateCommandBuffers(device, &allocInfo, graphicsCommandBuffers.data()) != VK_SUCCESS)
+    const char* names[] = { "no uploads", "graphics queue", "transfer queue" };
+    UploadContext* contexts[] = { nullptr, &upload, &transferUpload };
+
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        UploadContext* context = contexts[pass];
+        if (pass == 2 && !transferUpload.transfersOwnership())
         {
-            throw std::runtime_error("failed to allocate graphics command buffers");
+            std::cout << "\t - " << names[pass] << ": no transfer only queue family, skipped" << std::endl;
+            continue;
         }
 
-        fillGraphicsCommandBuffers();
-    }
-    
-    {
-        // compute command buffers
-        computeCommandBuffers.resize(bufferSize);
+        VkDeviceSize streamed = 0;
+        VkDeviceSize targetOffset = 0;
+        double total = 0.0;
+        double worst = 0.0;
+        int frameCount = 0;
+
+        for (; frameCount < framesPerPass && !glfwWindowShouldClose(window); ++frameCount)
+        {
+            glfwPollEvents();
+
+            auto begin = glfwGetTime();
+
+            if (context)
+            {
+                context->poll();
+
+                if (context->inFlightCount() < maxChunksInFlight)
+                {
+                    VkBuffer stagingBuffer;
+                    DeviceAllocation stagingBufferMemory;
+                    createBuffer(chunkSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 &stagingBuffer, &stagingBufferMemory);
+                    memset(stagingBufferMemory.mapped, frameCount & 0xff, static_cast<size_t>(chunkSize));
+
+                    VkBufferCopy copyRegion = {};
+                    copyRegion.dstOffset = targetOffset;
+                    copyRegion.size = chunkSize;
+                    vkCmdCopyBuffer(context->commandBuffer(), stagingBuffer, target, 1, &copyRegion);
+
+                    context->release(stagingBuffer, stagingBufferMemory);
+                    context->submit();
+
+                    targetOffset = (targetOffset + chunkSize) % targetSize;
+                    streamed += chunkSize;
+                }
+            }
+
+            drawFrame();
 
-        VkCommandBufferAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = computeCommandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t)computeCommandBuffers.size();
+            const double elapsed = glfwGetTime() - begin;
+            total += elapsed;
+            worst = std::max(worst, elapsed);
+        }
 
-        if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS)
+        if (context)
         {
-            throw std::runtime_error("failed to allocate compute command buffers");
+            context->finish();
         }
 
-        fillComputeCommandBuffers();
+        const int frames = std::max(frameCount, 1);
+        std::cout << "\t - " << names[pass] << ": " << total * 1000.0 / frames << " ms/frame, "
+                  << worst * 1000.0 << " ms worst, "
+                  << (total > 0.0 ? streamed / (1024.0 * 1024.0) / total : 0.0) << " MB/s streamed" << std::endl;
     }
+
+    vkDestroyBuffer(device, target, nullptr);
+    allocator.free(targetMemory);
 }
 
-void VulkanApplication::createSyncObjects()
+void VulkanApplication::runFramesInFlightSweep()
 {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-
-    VkSemaphoreCreateInfo semaphoreInfo = {};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    const int framesPerStep = 300;
+    const uint32_t savedFramesInFlight = framesInFlight;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    std::cout << "=> frames in flight benchmark, " << swapChainExtent.width << "x" << swapChainExtent.height
+              << ", " << swapChainImages.size() << " swapchain images" << std::endl;
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    for (uint32_t count = 1; count <= maxFramesInFlight; ++count)
     {
-        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+        setFramesInFlight(count);
+
+        // fill the pipeline before timing
+        for (uint32_t i = 0; i < count; ++i)
         {
-            throw std::runtime_error("failed to create sync objects for a frame");
+            drawFrame();
         }
+
+        frameLatencyTotal = 0.0;
+        frameLatencyCount = 0;
+
+        int frameCount = 0;
+        auto begin = glfwGetTime();
+        for (; frameCount < framesPerStep && !glfwWindowShouldClose(window); ++frameCount)
+        {
+            glfwPollEvents();
+            drawFrame();
+        }
+        const double total = glfwGetTime() - begin;
+
+        std::cout << "\t - " << count << " in flight: " << (total > 0.0 ? frameCount / total : 0.0) << " fps, "
+                  << (frameLatencyCount > 0 ? frameLatencyTotal * 1000.0 / frameLatencyCount : 0.0) << " ms latency" << std::endl;
     }
-}
 
-void VulkanApplication::initResources()
-{
-    createInstance();
-    setupDebugCallback();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createGraphicsDescriptorSetLayout();
-    createLuminanceDescriptorSetLayout();
-    createComputeDescriptorSetLayout();
-    createGraphicsPipeline();
-    createLuminancePipeline();
-    createComputePipeline();
-    createCommandPools();
-    createDepthResources();
-    createBeautyResources();
-    createFramebuffers();
-    createTextureImage();
-    createTextureImageView();
-    createTextureSampler();
-    createVertexBuffer();
-    createQuadBuffer();
-    createIndexBuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createGraphicsDescriptorSets();
-    createLuminanceDescriptorSets();
-    createComputeDescriptorSets();
-    createCommandBuffers();
-    createSyncObjects();
+    setFramesInFlight(savedFramesInFlight);
 }
 
-void VulkanApplication::cleanupSwapChain()
+void VulkanApplication::runComputeOverlapSweep()
 {
-    vkDestroyImageView(device, depthImageView, nullptr);
-    vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
+    if (!useComputeDeformation)
+    {
+        return;
+    }
 
-    vkDestroyImageView(device, beautyImageView, nullptr);
-    vkDestroyImage(device, beautyImage, nullptr);
-    vkFreeMemory(device, beautyImageMemory, nullptr);
+    const int framesPerStep = 300;
+    const bool savedOverlap = overlapCompute;
 
-    for (auto& framebuffer : swapChainFramebuffers)
+    std::cout << "=> compute overlap benchmark, " << framesInFlight << " frames in flight, "
+              << vertexCount << " vertices deformed per frame" << std::endl;
+
+    if (!recordGpuTimestamps)
     {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
+        std::cout << "\t - no timestamps on the graphics or compute queue, frame times only" << std::endl;
     }
 
-    vkFreeCommandBuffers(device, graphicsCommandPool, static_cast<uint32_t>(graphicsCommandBuffers.size()), graphicsCommandBuffers.data());
+    for (int overlap = 0; overlap < 2; ++overlap)
+    {
+        setComputeOverlap(overlap != 0);
 
-    vkFreeCommandBuffers(device, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+        // fill the pipeline before timing
+        for (uint32_t i = 0; i < framesInFlight; ++i)
+        {
+            drawFrame();
+        }
 
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        gpuFrameTimestamps.clear();
 
-    vkDestroyPipeline(device, luminancePipeline, nullptr);
+        int frameCount = 0;
+        auto begin = glfwGetTime();
+        for (; frameCount < framesPerStep && !glfwWindowShouldClose(window); ++frameCount)
+        {
+            glfwPollEvents();
+            drawFrame();
+        }
+        const double total = glfwGetTime() - begin;
 
-    vkDestroyPipeline(device, computePipeline, nullptr);
+        std::cout << "\t - " << (overlapCompute ? "overlapped" : "serialized") << ": "
+                  << (frameCount > 0 ? total * 1000.0 / frameCount : 0.0) << " ms/frame";
 
-    vkDestroyPipelineLayout(device, graphicsPipelineLayout, nullptr);
+        if (!gpuFrameTimestamps.empty())
+        {
+            // compute [0, 1] and graphics [2, 3] intervals, in ns
+            std::vector<std::pair<uint64_t, uint64_t>> intervals;
+            double computeTotal = 0.0;
+            double graphicsTotal = 0.0;
+            double overlapTotal = 0.0;
 
-    vkDestroyPipelineLayout(device, luminancePipelineLayout, nullptr);
+            for (const auto& timestamps : gpuFrameTimestamps)
+            {
+                intervals.emplace_back(timestamps[0], timestamps[1]);
+                intervals.emplace_back(timestamps[2], timestamps[3]);
+                computeTotal += static_cast<double>(timestamps[1] - timestamps[0]);
+                graphicsTotal += static_cast<double>(timestamps[3] - timestamps[2]);
+            }
 
-    vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+            std::sort(intervals.begin(), intervals.end());
 
-    vkDestroyRenderPass(device, renderPass, nullptr);
+            // union of the busy intervals, and how much of it had more than one queue at work
+            uint64_t busy = 0;
+            uint64_t end = intervals.front().first;
+            for (const auto& interval : intervals)
+            {
+                if (interval.first < end)
+                {
+                    overlapTotal += static_cast<double>(std::min(interval.second, end) - interval.first);
+                }
+
+                if (interval.second > end)
+                {
+                    busy += interval.second - std::max(interval.first, end);
+                    end = interval.second;
+                }
+            }
 
-    for (const auto& imageView : swapChainImageViews)
-    {
-        vkDestroyImageView(device, imageView, nullptr);
+            const uint64_t span = end - intervals.front().first;
+            const double frames = static_cast<double>(gpuFrameTimestamps.size());
+
+            std::cout << ", GPU busy " << (span > 0 ? 100.0 * busy / span : 0.0) << "%"
+                      << ", compute " << computeTotal / frames * 1e-6 << " ms"
+                      << ", graphics " << graphicsTotal / frames * 1e-6 << " ms"
+                      << ", overlapped " << overlapTotal / frames * 1e-6 << " ms per frame";
+        }
+
+        std::cout << std::endl;
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    setComputeOverlap(savedOverlap);
 }
 
-void VulkanApplication::recreateSwapChain()
+void VulkanApplication::runVertexLayoutSweep()
 {
-    vkDeviceWaitIdle(device);
+    if (useStreamingLoader)
+    {
+        std::cout << "=> vertex layout benchmark skipped, the streaming loader only writes the full layout" << std::endl;
+        return;
+    }
 
-    cleanupSwapChain();
+    const int framesPerStep = 300;
+    const bool savedCompact = useCompactVertices;
 
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
-    createLuminancePipeline();
-    createDepthResources();
-    createBeautyResources();
-    createFramebuffers();
-    updateLuminanceDescriptorSets();
-    createCommandBuffers();
-}
+    std::cout << "=> vertex layout benchmark, " << vertexCount << " vertices"
+              << (useComputeDeformation ? ", deformed every frame" : "") << std::endl;
 
-void VulkanApplication::updateUniformBuffers(size_t imageIndex)
-{
+    for (int compact = 0; compact < 2; ++compact)
     {
-        // graphics uniform buffer
+        setCompactVertices(compact != 0);
 
-        Matrices ubo = {};
-        ubo.model = glm::mat4(1.f);
+        // fill the pipeline before timing
+        for (uint32_t i = 0; i < framesInFlight; ++i)
+        {
+            drawFrame();
+        }
 
-        ubo.view = camera.computeViewMatrix();
+        int frameCount = 0;
+        auto begin = glfwGetTime();
+        for (; frameCount < framesPerStep && !glfwWindowShouldClose(window); ++frameCount)
+        {
+            glfwPollEvents();
+            drawFrame();
+        }
+        const double total = glfwGetTime() - begin;
 
-        ubo.proj = glm::perspective(glm::radians(camera.verticalFOV), swapChainExtent.width / (float)swapChainExtent.height, camera.near, camera.far);
-        ubo.proj[1][1] *= -1.f;
+        // every vertex fetched once by the vertex input stage, and the rest data read by the compute pass:
+        // the whole Vertex, or the packed position and the uv word of PackedVertex
+        const double vertexMB = vertexStride() * vertexCount / (1024.0 * 1024.0);
+        const size_t restStride = useCompactVertices ? sizeof(PackedPosition) + sizeof(uint32_t) : sizeof(Vertex);
+        const double restMB = useComputeDeformation ? restStride * vertexCount / (1024.0 * 1024.0) : 0.0;
 
-        auto& memory = graphicsUniformBufferMemories[imageIndex];
-        void* data;
-        vkMapMemory(device, memory, 0, sizeof(ubo), 0, &data);
-        memcpy(data, &ubo, sizeof(ubo));
-        vkUnmapMemory(device, memory);
+        std::cout << "\t - " << (useCompactVertices ? "compact" : "full") << ", " << vertexStride() << " B/vertex: "
+                  << vertexMB << " MB vertex input";
+        if (useComputeDeformation)
+        {
+            std::cout << " + " << restMB << " MB compute reads";
+        }
+        std::cout << " per frame, " << (frameCount > 0 ? total * 1000.0 / frameCount : 0.0) << " ms/frame" << std::endl;
     }
 
-    
-    {
-        // compute uniform buffer
+    setCompactVertices(savedCompact);
+}
 
-        static auto startTime = std::chrono::high_resolution_clock::now();
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+void VulkanApplication::runResizeStorm()
+{
+    const int resizeCount = 20;
+    const bool savedDynamicViewport = dynamicViewport;
 
-        ComputeData ubo;
-        ubo.time = time;
-        ubo.vertexCount = vertices.size();
+    int width = 0;
+    int height = 0;
+    glfwGetWindowSize(window, &width, &height);
+
+    std::cout << "=> resize storm benchmark, " << resizeCount << " resizes around " << width << "x" << height << std::endl;
+
+    for (int dynamic = 0; dynamic < 2; ++dynamic)
+    {
+        setDynamicViewport(dynamic != 0);
+
+        double total = 0.0;
+        double worst = 0.0;
+        for (int i = 0; i < resizeCount && !glfwWindowShouldClose(window); ++i)
+        {
+            // back and forth between two sizes
+            const int delta = (i % 2 == 0) ? -64 : 0;
+            glfwSetWindowSize(window, std::max(width + delta, 64), std::max(height + delta, 64));
+            glfwPollEvents();
+
+            // from the wait for the device to the command buffers being ready again
+            Stopwatch stopwatch;
+            retrieveWindowSize();
+            recreateSwapChain();
+            const double stall = stopwatch.elapsedMs();
+
+            framebufferResized = false;
+            total += stall;
+            worst = std::max(worst, stall);
+
+            drawFrame();
+        }
 
-        auto& memory = computeUniformBufferMemories[imageIndex];
-        void* data;
-        vkMapMemory(device, memory, 0, sizeof(ubo), 0, &data);
-        memcpy(data, &ubo, sizeof(ubo));
-        vkUnmapMemory(device, memory);
+        std::cout << "\t - " << (dynamicViewport ? "dynamic viewport" : "baked viewport") << ": "
+                  << total / resizeCount << " ms per resize, " << worst << " ms worst" << std::endl;
     }
-    
+
+    glfwSetWindowSize(window, width, height);
+    glfwPollEvents();
+    retrieveWindowSize();
+    recreateSwapChain();
+    framebufferResized = false;
+
+    setDynamicViewport(savedDynamicViewport);
 }
 
-void VulkanApplication::drawFrame()
+void VulkanApplication::runCommandRecordingSweep()
 {
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    const int passCount = 5;
+    const size_t drawCounts[] = { 1000, 10000, 100000 };
 
-    uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    const auto queueFamilyIndices = findQueueFamilies(physicalDevice);
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR)
-    {
-        retrieveWindowSize();
-        recreateSwapChain();
-        framebufferResized = false;
-        return;
-    }
-    else if (result != VK_SUCCESS
-             && result != VK_SUBOPTIMAL_KHR)
-    {
-        throw std::runtime_error("failed to acquire swap chain image");
-    }
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = renderPass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = VK_NULL_HANDLE;
 
-    updateUniformBuffers(imageIndex);
+    std::cout << "=> command recording benchmark, " << workerCount() << " cores, best of " << passCount << " passes" << std::endl;
 
-    // compute vertices
+    for (auto drawCount : drawCounts)
+    {
+        double singleThreaded = 0.0;
 
-    VkSubmitInfo computeSubmitInfo = {};
-    computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    computeSubmitInfo.commandBufferCount = 1;
-    computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[currentFrame];
+        for (uint32_t threadCount = 1; threadCount <= workerCount(); threadCount *= 2)
+        {
+            CommandRecorder recorder;
+            recorder.init(device, queueFamilyIndices.graphicsFamily, threadCount, 1);
 
-    if (vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to compute draw command buffer");
-    }
+            double best = std::numeric_limits<double>::max();
+            for (int pass = 0; pass < passCount; ++pass)
+            {
+                recorder.reset(0);
 
-    // render frame
+                // recorded only, never submitted
+                Stopwatch stopwatch;
+                recorder.record(0, inheritance, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, drawCount,
+                                [this](VkCommandBuffer commandBuffer, size_t begin, size_t end)
+                {
+                    recordBeautyDraws(commandBuffer, 0, begin, end);
+                });
 
-    VkSubmitInfo graphicsSubmitInfo = {};
-    graphicsSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                best = std::min(best, stopwatch.elapsedMs());
+            }
 
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+            recorder.destroy();
 
-    graphicsSubmitInfo.waitSemaphoreCount = 1;
-    graphicsSubmitInfo.pWaitSemaphores = waitSemaphores;
-    graphicsSubmitInfo.pWaitDstStageMask = waitStages;
+            if (threadCount == 1)
+            {
+                singleThreaded = best;
+            }
 
-    graphicsSubmitInfo.commandBufferCount = 1;
-    graphicsSubmitInfo.pCommandBuffers = &graphicsCommandBuffers[imageIndex];
+            std::cout << "\t - " << drawCount << " draws, " << threadCount << (threadCount == 1 ? " thread: " : " threads: ")
+                      << best << " ms, x" << (best > 0.0 ? singleThreaded / best : 0.0) << std::endl;
+        }
+    }
+}
 
-    VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-    graphicsSubmitInfo.signalSemaphoreCount = 1;
-    graphicsSubmitInfo.pSignalSemaphores = signalSemaphores;
+void VulkanApplication::mainLoop()
+{
+    if (runLodBenchmark)
+    {
+        runLodBenchmarkSweep();
+    }
 
-    if (vkQueueSubmit(graphicsQueue, 1, &graphicsSubmitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+    if (runStreamingUploadBenchmark)
     {
-        throw std::runtime_error("failed to submit draw command buffer");
+        runStreamingUploadPasses();
     }
 
-    VkPresentInfoKHR presentInfo = {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    if (runFramesInFlightBenchmark)
+    {
+        runFramesInFlightSweep();
+    }
 
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    if (runComputeOverlapBenchmark)
+    {
+        runComputeOverlapSweep();
+    }
 
-    VkSwapchainKHR swapChains[] = { swapChain };
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
+    if (runCommandRecordingBenchmark)
+    {
+        runCommandRecordingSweep();
+    }
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    if (runResizeStormBenchmark)
+    {
+        runResizeStorm();
+    }
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR
-        || result == VK_SUBOPTIMAL_KHR
-        || framebufferResized)
+    if (runVertexLayoutBenchmark)
     {
-        retrieveWindowSize();
-        recreateSwapChain();
-        framebufferResized = false;
+        runVertexLayoutSweep();
     }
-    else if (result != VK_SUCCESS)
+
+    if (runTransientAttachmentBenchmark)
     {
-        throw std::runtime_error("failed to present swap chain image");
+        runTransientAttachmentSweep();
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-}
+    std::cout << "=> entering the main loop with " << residentBytes() / (1024.0 * 1024.0) << " MB resident, "
+              << peakResidentBytes() / (1024.0 * 1024.0) << " MB peak" << std::endl;
+
+    printAllocatorStats();
 
-void VulkanApplication::mainLoop()
-{
     double total = 0.0;
     int frameCount = 0;
     while (!glfwWindowShouldClose(window))
@@ -2434,6 +4828,8 @@ void VulkanApplication::mainLoop()
 
     std::cout << "avg frame time (ms): " << avgFrame * 1000.0 << std::endl;
     std::cout << "avg framerate (fps): " << 1.0 / avgFrame << std::endl;
+    std::cout << "avg frame cpu time (ms): " << (total * 1000.0 - frameWaitTime) / frameCount
+              << ", uniform writes " << uniformUpdateTime / frameCount << std::endl;
 }
 
 void VulkanApplication::cleanup()
@@ -2442,40 +4838,60 @@ void VulkanApplication::cleanup()
 
     cleanupSwapChain();
 
+    destroyGraphicsPipelines();
+
+    vkDestroyPipeline(device, computePipeline, nullptr);
+
+    vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+
+    vkDestroyRenderPass(device, renderPass, nullptr);
+
     vkDestroySampler(device, textureImageSampler, nullptr);
     vkDestroyImageView(device, textureImageView, nullptr);
     vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+    allocator.free(textureImageMemory);
+
+    destroyFrameResources();
 
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
     vkDestroyDescriptorSetLayout(device, graphicsDescriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(device, luminanceDescriptorSetLayout, nullptr);
 
-    for (size_t i = 0; i < swapChainImages.size(); ++i)
+    vkDestroyBuffer(device, indexBuffer, nullptr);
+    allocator.free(indexBufferMemory);
+
+    if (meshletBuffer != VK_NULL_HANDLE)
     {
-        vkDestroyBuffer(device, graphicsUniformBuffers[i], nullptr);
-        vkFreeMemory(device, graphicsUniformBufferMemories[i], nullptr);
+        vkDestroyBuffer(device, meshletBuffer, nullptr);
+        allocator.free(meshletBufferMemory);
     }
 
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
-
     vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
-
-    vkDestroyBuffer(device, quadBuffer, nullptr);
-    vkFreeMemory(device, quadBufferMemory, nullptr);
+    allocator.free(vertexBufferMemory);
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    if (restPositionBuffer != VK_NULL_HANDLE)
     {
-        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
+        vkDestroyBuffer(device, restPositionBuffer, nullptr);
+        allocator.free(restPositionBufferMemory);
     }
 
+    vkDestroyBuffer(device, quadBuffer, nullptr);
+    allocator.free(quadBufferMemory);
+
     vkDestroyCommandPool(device, graphicsCommandPool, nullptr);
 
+    upload.destroy();
+    transferUpload.destroy();
+
+    allocator.destroy();
+
+    if (usePipelineCache)
+    {
+        savePipelineCache();
+        pipelineCache.destroy();
+    }
+
     vkDestroyDevice(device, nullptr);
 
     vkDestroySurfaceKHR(instance, surface, nullptr);
@@ -2528,6 +4944,36 @@ std::array<VkVertexInputAttributeDescription, 3> getVertexAttributeDescriptions(
     return desc;
 }
 
+VkVertexInputBindingDescription getCompactVertexBindingDescription()
+{
+    VkVertexInputBindingDescription desc = {};
+
+    desc.binding = 0;
+    desc.stride = sizeof(PackedVertex);
+    desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return desc;
+}
+
+std::array<VkVertexInputAttributeDescription, 2> getCompactVertexAttributeDescriptions(TexCoordEncoding texCoordEncoding)
+{
+    std::array<VkVertexInputAttributeDescription, 2> desc = {};
+
+    auto& posDesc = desc[0];
+    posDesc.binding = 0;
+    posDesc.location = 0;
+    posDesc.format = VK_FORMAT_R16G16B16A16_SNORM;
+    posDesc.offset = offsetof(PackedVertex, pos);
+
+    auto& texDesc = desc[1];
+    texDesc.binding = 0;
+    texDesc.location = 1;
+    texDesc.format = texCoordEncoding == TexCoordEncoding::Unorm16 ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16_SFLOAT;
+    texDesc.offset = offsetof(PackedVertex, texCoord);
+
+    return desc;
+}
+
 VkVertexInputBindingDescription getQuadBindingDescription()
 {
     VkVertexInputBindingDescription desc = {};
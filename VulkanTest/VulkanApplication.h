@@ -5,6 +5,15 @@
 #include <GLFW/glfw3.h>
 
 #include "Application.h"
+#include "CommandRecorder.h"
+#include "DeviceAllocator.h"
+#include "FrameScheduler.h"
+#include "IndexChunker.h"
+#include "MeshletBuilder.h"
+#include "PipelineCache.h"
+#include "UploadContext.h"
+#include "VertexQuantizer.h"
+
 #include <array>
 
 struct GLFWwindow;
@@ -17,8 +26,161 @@ protected:
     void mainLoop() override;
     void cleanup() override;
 
+    bool streamsModel() const override { return useStreamingLoader; }
+    bool uploadsMipChain() const override { return useCpuMipmaps; }
+    bool usesTextureContainer() const override { return useTextureContainer; }
+
 protected:
-    const int MAX_FRAMES_IN_FLIGHT = 1;
+    static const uint32_t maxFramesInFlight = 4;
+
+    // frames the CPU records ahead of the GPU, 1 to maxFramesInFlight, see setFramesInFlight
+    uint32_t framesInFlight = 2;
+
+    // runs a few hundred frames with each frames in flight setting and reports framerate and latency
+    const bool runFramesInFlightBenchmark = false;
+
+    // with compute deformation, one deformed vertex buffer per frame in flight so the compute of the next
+    // frame runs while the current one renders; one shared buffer, compute waiting for the previous
+    // frame, otherwise. See setComputeOverlap
+    bool overlapCompute = true;
+
+    // renders a few hundred frames with and without compute overlap and reports frame times and how
+    // busy the GPU was, from timestamps around every compute and graphics command buffer
+    const bool runComputeOverlapBenchmark = false;
+
+    // record the beauty subpass into secondary command buffers, its draws split across recordThreadCount
+    // worker threads with a command pool each per frame in flight; inline in the primary one otherwise
+    const bool useSecondaryCommandBuffers = true;
+
+    // worker threads recording secondary command buffers, 0 for one per core
+    const uint32_t recordThreadCount = 4;
+
+    // records thousands of draws of the model into secondary command buffers with 1, 2, 4... threads
+    // and reports the record times
+    const bool runCommandRecordingBenchmark = false;
+
+    // graphics pipelines take the viewport and scissor as dynamic state, so a resize keeps them and the
+    // render pass, which is only rebuilt when the swapchain format changes. Baked into the pipelines, every
+    // resize rebuilds all of it, otherwise. See setDynamicViewport
+    bool dynamicViewport = true;
+
+    // resizes the window back and forth a few times with and without dynamic viewport and reports how long
+    // each resize stalls rendering
+    const bool runResizeStormBenchmark = false;
+
+    // create every pipeline through a VkPipelineCache loaded from pipeline.cache at startup and written
+    // back on shutdown, so warm launches skip most of the shader compilation in the driver
+    const bool usePipelineCache = true;
+
+    // schedule frames with VK_KHR_timeline_semaphore when the headers, the instance and the device have it,
+    // fences and binary semaphores otherwise
+    const bool useTimelineSemaphores = true;
+
+    // whether the instance enabled VK_KHR_get_physical_device_properties2, which the 1.0 instance needs
+    // to query the timeline semaphore feature
+    bool physicalDeviceProperties2 = false;
+
+    // whether the device was created with timeline semaphores
+    bool timelineSemaphores = false;
+
+    // 12 byte PackedVertex instead of the 48 byte Vertex, with rest positions in their own buffer.
+    // Drawn with shader_compact.vert and deformed with compute_compact.comp. See setCompactVertices
+    bool useCompactVertices = false;
+
+    // draws a few hundred frames with each vertex layout and reports the vertex data each reads and ms/frame
+    const bool runVertexLayoutBenchmark = false;
+
+    // animate vertices with the compute shader every frame
+    const bool useComputeDeformation = true;
+
+    // 16-bit indices drawn in chunks with a base vertex each, 32-bit in one draw otherwise
+    const bool useIndexChunks = true;
+
+    // below this many indices per draw on average, splitting costs more in draws than it saves
+    const size_t minIndicesPerChunk = 3 * 4096;
+
+    // LOD level per frame from its projected error, Finest always draws the full mesh
+    enum class LodPolicy
+    {
+        Finest,
+        ScreenSpaceError,
+    };
+
+    LodPolicy lodPolicy = LodPolicy::ScreenSpaceError;
+
+    // largest projected simplification error allowed, in pixels
+    const float lodPixelError = 1.f;
+
+    // sweeps the camera distance for every LOD policy, then runs interactively
+    const bool runLodBenchmark = false;
+
+    // parse the OBJ in initResources straight into the device buffers through a ring of staging blocks,
+    // without building the vertex and index arrays on the host. Skips everything that needs the whole mesh
+    // at once: mesh cache, mesh optimization, LODs, index chunks and meshlets.
+    // A first pass counts the records, so the device buffers are created once at their final size
+    const bool useStreamingLoader = false;
+
+    // host memory of the streaming loader: half for the staging ring, half for the positions, texcoords
+    // and dedup keys and table. Arrays that do not fit their half go to a mapped temporary file the OS
+    // pages out, so the heap stays within the budget whatever the model size
+    const size_t streamingBudget = 64 * 1024 * 1024;
+    const size_t stagingBlockCount = 4;
+
+    // upload the mip chain built by loadTexture in one copy instead of blitting it on the GPU
+    const bool useCpuMipmaps = true;
+
+    // times the blit path against the CPU box and Kaiser chains at startup
+    const bool runMipBenchmark = false;
+
+    // block compress the texture and its mips, falling back to the other format and then to RGBA8
+    // when the device cannot sample it. BC1 is only picked for textures without alpha
+    enum class TextureCompression
+    {
+        None,
+        BC1,
+        BC7,
+    };
+
+    const TextureCompression textureCompression = TextureCompression::BC7;
+
+    // keep the final mip chain in a KTX2 style container next to the texture and map it on later starts,
+    // instead of decoding the JPEG and building the chain again. Written whenever the chain was built on the CPU
+    const bool useTextureContainer = true;
+
+    // host visible memory for texture uploads, bigger chains are copied in bands of rows
+    const VkDeviceSize textureStagingBudget = 32 * 1024 * 1024;
+
+    // times decoding the JPEG against mapping the container, both up to a sampled image, then runs interactively
+    const bool runTextureBenchmark = false;
+
+    // depth and beauty only live within the render pass: create them transient, on lazily allocated
+    // memory when the device has some, so a tiler keeps them on chip and never backs them in memory
+    const bool useTransientAttachments = true;
+
+    // renders a few frames at 1080p and 4K and reports, per attachment, its size against the memory the
+    // driver actually committed to it
+    const bool runTransientAttachmentBenchmark = false;
+
+    // preferred size of the device memory blocks buffers and images are sub-allocated from
+    const VkDeviceSize deviceMemoryBlockSize = 64 * 1024 * 1024;
+
+    // allocates and frees random buffers and images at startup, then reports timings and fragmentation
+    const bool runAllocatorStressTest = false;
+
+    // record every startup upload into batches submitted once with a fence, instead of a submit and
+    // a queue wait per copy or transition
+    const bool useBatchedUploads = true;
+
+    // run buffer and texture copies on a transfer only queue family when the device has one, handing
+    // each resource over to the graphics family once copied
+    const bool useTransferQueue = true;
+
+    // streams a large buffer while rendering, without uploads, through the graphics queue and through
+    // the transfer queue, and reports the frame times of each, then runs interactively
+    const bool runStreamingUploadBenchmark = false;
+
+    // cluster the index buffer into meshlets with culling bounds, uploaded to meshletBuffer
+    const bool useMeshlets = true;
 
     const std::vector<const char*> validationLayers = {
         "VK_LAYER_LUNARG_standard_validation",
@@ -50,6 +212,13 @@ protected:
         int graphicsFamily = -1;
         int presentFamily = -1;
         int computeFamily = -1;
+
+        // a family without graphics nor compute when the device has one, the graphics family otherwise
+        int transferFamily = -1;
+
+        // minImageTransferGranularity of transferFamily, (0,0,0) when it only copies whole mip levels
+        VkExtent3D transferGranularity = { 1, 1, 1 };
+
         bool isComplete()
         {
             return graphicsFamily >= 0 
@@ -73,18 +242,37 @@ protected:
     {
         float time;
         int vertexCount;
+        // compact vertices only
+        int halfTexCoords;
+        float padding;
+        glm::vec4 domainCenter;
+        glm::vec4 domainExtent;
     };
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 
     VkDevice device;
 
+    // every buffer and image memory comes out of its blocks
+    DeviceAllocator allocator;
+
+    // graphics queue uploads, staging is freed as batches complete: depth transitions and blitted mips
+    UploadContext upload;
+
+    // buffer and texture copies, on transferQueue with useTransferQueue
+    UploadContext transferUpload;
+
+    // granularity image copies recorded into transferUpload must respect, in texels or blocks
+    VkExtent3D transferImageGranularity = { 1, 1, 1 };
+
     VkQueue graphicsQueue;
 
     VkQueue computeQueue;
 
     VkQueue presentQueue;
 
+    VkQueue transferQueue;
+
     VkSurfaceKHR surface;
 
     VkSurfaceCapabilitiesKHR capabilities;
@@ -119,35 +307,81 @@ protected:
     VkCommandPool computeCommandPool;
 
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    DeviceAllocation depthImageMemory;
     VkImageView depthImageView;
 
     VkImage beautyImage;
-    VkDeviceMemory beautyImageMemory;
+    DeviceAllocation beautyImageMemory;
     VkImageView beautyImageView;
 
     uint32_t mipLevels;
+    VkFormat textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
     VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    DeviceAllocation textureImageMemory;
 
     VkImageView textureImageView;
 
     VkSampler textureImageSampler;
 
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    DeviceAllocation vertexBufferMemory;
 
-    VkBuffer quadBuffer;
-    VkDeviceMemory quadBufferMemory;
+    // compact vertices with compute deformation only
+    VkBuffer restPositionBuffer = VK_NULL_HANDLE;
+    DeviceAllocation restPositionBufferMemory;
 
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
+    // dequantizes compact positions, identity otherwise
+    QuantizationLayout quantization = {};
+    glm::mat4 modelTransform = glm::mat4(1.f);
 
-    std::vector<VkBuffer> graphicsUniformBuffers;
-    std::vector<VkDeviceMemory> graphicsUniformBufferMemories;
+    VkBuffer quadBuffer;
+    DeviceAllocation quadBufferMemory;
 
-    std::vector<VkBuffer> computeUniformBuffers;
-    std::vector<VkDeviceMemory> computeUniformBufferMemories;
+    VkBuffer indexBuffer;
+    DeviceAllocation indexBufferMemory;
+
+    // one chunk with a zero base vertex for 32-bit indices
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    std::vector<IndexChunk> indexChunks;
+
+    // chunks of LOD level l are [lodFirstChunks[l], lodFirstChunks[l + 1])
+    std::vector<uint32_t> lodFirstChunks;
+
+    // compute output drawn instead of vertexBuffer, which stays as uploaded and is the rest data:
+    // one per frame in flight with overlapCompute, a single one otherwise
+    std::vector<VkBuffer> deformedVertexBuffers;
+    std::vector<DeviceAllocation> deformedVertexBufferMemories;
+
+    // compute begin and end, graphics begin and end, for each frame slot
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    bool recordGpuTimestamps = false;
+    double timestampPeriod = 1.0;
+    std::vector<uint64_t> timestampFrames; // frame whose timestamps each slot holds, 0 for none
+
+    // ns, read back as frame slots are reused
+    std::vector<std::array<uint64_t, 4>> gpuFrameTimestamps;
+
+    // draws of the selected LOD level, rewritten every frame; padded with empty draws up to maxLodDraws
+    std::vector<VkBuffer> indirectBuffers;
+    std::vector<DeviceAllocation> indirectBufferMemories;
+    uint32_t maxLodDraws = 0;
+
+    size_t currentLod = 0;
+
+    // Meshlet array, then the meshlet vertex ids, then the local triangles, see MeshletData
+    VkBuffer meshletBuffer = VK_NULL_HANDLE;
+    DeviceAllocation meshletBufferMemory;
+    uint32_t meshletCount = 0;
+    VkDeviceSize meshletVerticesOffset = 0;
+    VkDeviceSize meshletTrianglesOffset = 0;
+
+    // one slice per frame in flight holding its Matrices then its ComputeData, both bound as dynamic
+    // uniform buffers. The command buffers of frame i are recorded with the offsets of slice i and the
+    // ring stays mapped
+    VkBuffer uniformRing;
+    DeviceAllocation uniformRingMemory;
+    VkDeviceSize uniformSliceSize = 0;
+    VkDeviceSize computeDataOffset = 0;
 
     VkDescriptorPool descriptorPool;
 
@@ -155,17 +389,41 @@ protected:
     std::vector<VkDescriptorSet> luminanceDescriptorSets;
     std::vector<VkDescriptorSet> computeDescriptorSets;
 
+    // one per frame in flight and swapchain image, see graphicsCommandBuffer()
     std::vector<VkCommandBuffer> graphicsCommandBuffers;
 
+    // one per frame in flight
     std::vector<VkCommandBuffer> computeCommandBuffers;
 
+    // beauty subpass of each frame in flight, executed by all its graphics command buffers
+    CommandRecorder graphicsRecorder;
+    std::vector<std::vector<VkCommandBuffer>> beautyCommandBuffers;
+
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
 
-    VkFence computeFence;
+    // compute and graphics submissions, CPU waits for free frame slots
+    FrameScheduler scheduler;
+
+    // shared by every pipeline creation, VK_NULL_HANDLE without usePipelineCache
+    PipelineCache pipelineCache;
 
+    // graphics, luminance and compute pipelines at startup
+    double pipelineCreationMs = 0.0;
+
+    // slot of the frame being recorded, scheduler frame number modulo framesInFlight
     size_t currentFrame = 0;
+
+    // scheduler.time() when the uniforms of each frame were written, 0 once its completion was recorded
+    std::vector<double> frameStartTimes;
+
+    // from the uniform writes to the graphics completion, seen at the next poll so within one frame of the truth
+    double frameLatencyTotal = 0.0;
+    uint32_t frameLatencyCount = 0;
+
+    // ms summed over the main loop, the fence wait and image acquisition are the part spent waiting on the GPU
+    double frameWaitTime = 0.0;
+    double uniformUpdateTime = 0.0;
 protected:
 
     void ensureValidationLayerSupport();
@@ -182,6 +440,8 @@ protected:
         const char* msg,
         void* userData);
 
+    void chooseVertexLayout();
+
     void createInstance();
 
     void setupDebugCallback();
@@ -198,6 +458,15 @@ protected:
 
     void createLogicalDevice();
 
+    void createPipelineCache();
+
+    // on shutdown, reports instead of throwing
+    void savePipelineCache();
+
+    void createAllocator();
+
+    void printAllocatorStats() const;
+
     void createSurface();
 
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
@@ -224,12 +493,23 @@ protected:
 
     void createLuminancePipeline();
 
+    // both graphics pipelines and their layouts
+    void destroyGraphicsPipelines();
+
+    // waits for the device, then rebuilds the graphics pipelines and the command buffers
+    void setDynamicViewport(bool dynamic);
+
+    // with dynamicViewport, the full swapchain extent
+    void setViewportAndScissor(VkCommandBuffer commandBuffer) const;
+
     void createComputePipeline();
 
     void createFramebuffers();
 
     void createCommandPools();
 
+    void createUploadContext();
+
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     VkFormat findDepthFormat();
@@ -240,6 +520,15 @@ protected:
 
     void createBeautyResources();
 
+    VkImageUsageFlags intermediateAttachmentUsage(VkImageUsageFlags usage) const;
+
+    VkMemoryPropertyFlags intermediateAttachmentMemory() const;
+
+    // required size of depth and beauty minus what vkGetDeviceMemoryCommitment reports, once frames were drawn
+    void printTransientAttachmentSavings();
+
+    void runTransientAttachmentSweep();
+
     void createImage(uint32_t width,
                      uint32_t height,
                      uint32_t mipLevels,
@@ -248,7 +537,7 @@ protected:
                      VkImageUsageFlags usage,
                      VkMemoryPropertyFlags properties,
                      VkImage* image,
-                     VkDeviceMemory* imageMemory);
+                     DeviceAllocation* imageMemory);
 
     void transitionImageLayout(VkImage image,
                                VkFormat format,
@@ -256,40 +545,127 @@ protected:
                                VkImageLayout newLayout,
                                uint32_t mipLevels);
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+    // copies through a staging buffer of at most textureStagingBudget, returns how many times it was filled
+    uint32_t copyLevelsToImage(UploadContext& context, VkImage image, VkFormat format, const std::vector<TextureLevel>& levels);
+
+    // transferUpload, unless its queue can only copy whole levels
+    UploadContext& imageUploadContext();
 
     void generateMipmaps(VkImage image, VkFormat format, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels);
 
+    void uploadImageLevels(VkImage image, VkFormat format, const std::vector<TextureLevel>& levels);
+
+    // base image and chain as RGBA8 levels
+    std::vector<TextureLevel> mipChainLevels(const MipChain& mips) const;
+
+    void uploadTextureImage(VkImage image, const MipChain* mips);
+
+    VkFormat selectTextureFormat() const;
+
+    // levels point into blocks
+    std::vector<TextureLevel> compressTexture(std::vector<uint8_t>& blocks);
+
+    void writeTextureContainer(const std::vector<TextureLevel>& levels);
+
     void createTextureImage();
 
+    void runMipBenchmarkPasses();
+
+    void runTextureBenchmarkPasses();
+
+    void runAllocatorStressPasses();
+
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 
     void createTextureImageView();
 
     void createTextureSampler();
 
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-
+    // concurrently shared by the queue families given, exclusive when there is none
     void createBuffer(VkDeviceSize size, 
                       VkBufferUsageFlags usage, 
                       VkMemoryPropertyFlags properties, 
                       VkBuffer* buffer, 
-                      VkDeviceMemory* bufferMemory);
+                      DeviceAllocation* bufferMemory,
+                      const std::vector<uint32_t>& sharingFamilies = std::vector<uint32_t>());
+
+    // commands recorded in between go to the open batch of the context
+    VkCommandBuffer beginUploadCommands(UploadContext& context);
+
+    void endUploadCommands(UploadContext& context);
 
-    VkCommandBuffer beginSingleTimeCommands();
+    // on the context, then handed over to the graphics queue for dstAccess from dstStage on
+    void copyBuffer(UploadContext& context, VkBuffer src, VkBuffer dst, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
 
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+    // graphics and compute families when they differ, for buffers both queues read, none otherwise
+    std::vector<uint32_t> computeSharingFamilies();
 
-    void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    // concurrent buffers take no ownership transfer, so they are filled on the graphics queue rather than
+    // handed over from the transfer queue
+    UploadContext& uploadContextFor(const std::vector<uint32_t>& sharingFamilies);
+
+    VkDeviceSize vertexStride() const;
 
     void createVertexBuffer();
 
+    void createCompactVertexBuffers();
+
+    // rebuilds the vertex buffers, pipelines and frame resources for the other layout
+    void setCompactVertices(bool compact);
+
+    void runVertexLayoutSweep();
+
     void createQuadBuffer();
 
     void createIndexBuffer();
 
+    void createMeshletBuffer();
+
+    void streamModel();
+
+    void createIndirectBuffers();
+
+    size_t selectLod() const;
+
+    void runLodBenchmarkSweep();
+
+    void runStreamingUploadPasses();
+
+    void runFramesInFlightSweep();
+
+    void runComputeOverlapSweep();
+
+    // waits for the device, then rebuilds the per frame resources
+    void setComputeOverlap(bool overlap);
+
+    // GPU copies of vertexBuffer, recorded on the graphics upload context
+    void createDeformedVertexBuffers();
+
+    VkBuffer drawnVertexBuffer(size_t frame) const;
+
+    void createTimestampQueries();
+
+    // timestamps of the frame that last used the slot, once it completed
+    void collectGpuTimestamps(size_t slot);
+
+    // waits for the device, then rebuilds every per frame resource for count frames, clamped to [1, maxFramesInFlight]
+    void setFramesInFlight(uint32_t count);
+
+    // uniform ring, indirect buffers, descriptor sets, semaphores and scheduler, not the command buffers
+    void createFrameResources();
+
+    void destroyFrameResources();
+
+    void freeCommandBuffers();
+
+    VkCommandBuffer graphicsCommandBuffer(size_t frame, size_t imageIndex) const { return graphicsCommandBuffers[frame * swapChainImages.size() + imageIndex]; }
+
+    void recordFrameLatency(size_t frame);
+
     void createUniformBuffers();
 
+    VkDeviceSize uniformSliceOffset(size_t slice) const { return slice * uniformSliceSize; }
+
     void createDescriptorPool();
 
     void updateGraphicsDescriptorSets();
@@ -306,17 +682,28 @@ protected:
 
     void fillGraphicsCommandBuffers();
 
+    // binds the beauty pipeline and its resources, then records LOD draws [begin, end), wrapping around
+    // maxLodDraws so the benchmark can ask for more draws than there are
+    void recordBeautyDraws(VkCommandBuffer commandBuffer, size_t frame, size_t begin, size_t end);
+
+    uint32_t recordThreads() const;
+
+    void runCommandRecordingSweep();
+
     void fillComputeCommandBuffers();
 
     void createCommandBuffers();
 
     void createSyncObjects();
 
+    // size dependent resources and the swapchain itself, not the render pass nor the pipelines
     void cleanupSwapChain();
 
     void recreateSwapChain();
 
-    void updateUniformBuffers(size_t imageIndex);
+    void runResizeStorm();
+
+    void updateUniformBuffers(size_t frame);
 
     void drawFrame();
 };
@@ -324,6 +711,9 @@ protected:
 VkVertexInputBindingDescription getVertexBindingDescription();
 std::array<VkVertexInputAttributeDescription, 3> getVertexAttributeDescriptions();
 
+VkVertexInputBindingDescription getCompactVertexBindingDescription();
+std::array<VkVertexInputAttributeDescription, 2> getCompactVertexAttributeDescriptions(TexCoordEncoding texCoordEncoding);
+
 VkVertexInputBindingDescription getQuadBindingDescription();
 VkVertexInputAttributeDescription getQuadAttributeDescription();
 
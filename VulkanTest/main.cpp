@@ -9,7 +9,7 @@
 #include <iostream>
 #include <stdexcept>
 
-int main()
+int main(int argc, char** argv)
 {
 #ifdef VULKAN_APPLICATION
     Application* app = new VulkanApplication();
@@ -17,8 +17,9 @@ int main()
     Application* app = new GlApplication();
 #endif
 
-    const auto modelPath = "models/chalet.obj";
-    const auto texturePath = "models/chalet.jpg";
+    // VulkanTest [model.obj [texture]], to try other assets such as a 16K test texture
+    const auto modelPath = argc > 1 ? argv[1] : "models/chalet.obj";
+    const auto texturePath = argc > 2 ? argv[2] : "models/chalet.jpg";
 
     try
     {
@@ -3,4 +3,13 @@ C:/VulkanSDK/1.1.73.0/Bin32/glslangValidator.exe -V shader.frag -o shader.frag.s
 C:/VulkanSDK/1.1.73.0/Bin32/glslangValidator.exe -V luminance.vert -o luminance.vert.spv
 C:/VulkanSDK/1.1.73.0/Bin32/glslangValidator.exe -V luminance.frag -o luminance.frag.spv
 C:/VulkanSDK/1.1.73.0/Bin32/glslangValidator.exe -V compute.comp -o compute.comp.spv
+C:/VulkanSDK/1.1.73.0/Bin32/glslangValidator.exe -V shader_compact.vert -o shader_compact.vert.spv
+C:/VulkanSDK/1.1.73.0/Bin32/glslangValidator.exe -V compute_compact.comp -o compute_compact.comp.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe shader.vert.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe shader.frag.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe luminance.vert.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe luminance.frag.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe compute.comp.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe shader_compact.vert.spv
+C:/VulkanSDK/1.1.73.0/Bin32/spirv-val.exe compute_compact.comp.spv
 pause
\ No newline at end of file